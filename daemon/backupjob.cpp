@@ -20,7 +20,15 @@
 
 #include "backupjob.h"
 #include "bupjob.h"
+#include "exclusionengine.h"
 #include "rsyncjob.h"
+#include "throttlecontroller.h"
+#include "toolcapabilities.h"
+
+#include <KFormat>
+#include <KProcess>
+
+#include <QTimer>
 
 #include <unistd.h>
 #include <sys/resource.h>
@@ -28,12 +36,90 @@
 #include <sys/syscall.h>
 #endif
 
+// Incomplete lines longer than this are written to the log anyway, a process
+// printing lots of text without line breaks should not make us use lots of memory.
+static const int cMaxPendingOutput = 64 * 1024;
+// Processes still running this long after being asked to terminate get killed.
+static const int cKillTimeout = 10000;
+
 BackupJob::BackupJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath)
-   :KJob(), mBackupPlan(pBackupPlan), mDestinationPath(pDestinationPath), mLogFilePath(pLogFilePath)
+   :KJob(), mBackupPlan(pBackupPlan), mDestinationPath(pDestinationPath), mLogFilePath(pLogFilePath),
+     mLastWasCarriageReturn(false), mThrottleController(NULL), mDestinationSizeInfo(SizeUnknown),
+     mDestinationSize(0), mExclusionEngine(NULL), mUrgent(false), mKilling(false)
 {
 	mLogFile.setFileName(mLogFilePath);
 	mLogFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
 	mLogStream.setDevice(&mLogFile);
+	mMetrics.mStartTime = QDateTime::currentDateTime().toUTC();
+	setCapabilities(KJob::Killable | KJob::Suspendable);
+}
+
+bool BackupJob::doSuspend() {
+	throttleController()->setPaused(ThrottleController::PausedByJob, true);
+	return true;
+}
+
+bool BackupJob::doResume() {
+	throttleController()->setPaused(ThrottleController::PausedByJob, false);
+	return true;
+}
+
+bool BackupJob::doKill() {
+	if(mKilling) {
+		return false;
+	}
+	mKilling = true;
+	// a stopped process would never get to handle being terminated.
+	if(mThrottleController != NULL) {
+		mThrottleController->releaseProcesses();
+	}
+	if(mExclusionEngine != NULL) {
+		mExclusionEngine->disconnect(this);
+	}
+	ToolCapabilities::instance()->disconnect(this);
+	return true;
+}
+
+void BackupJob::terminateProcesses(const QList<KProcess *> &pProcesses, const QString &pMessage) {
+	mKillMessage = pMessage;
+	foreach(KProcess *lProcess, pProcesses) {
+		lProcess->disconnect(this);
+		if(lProcess->state() != QProcess::NotRunning) {
+			mProcessesToStop.append(lProcess);
+			connect(lProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotKilledProcessFinished()));
+			lProcess->terminate();
+		}
+	}
+	if(mProcessesToStop.isEmpty()) {
+		QMetaObject::invokeMethod(this, "finishKill", Qt::QueuedConnection);
+	} else {
+		QTimer::singleShot(cKillTimeout, this, SLOT(slotKillTimeout()));
+	}
+}
+
+void BackupJob::slotKilledProcessFinished() {
+	KProcess *lProcess = qobject_cast<KProcess *>(sender());
+	if(lProcess == NULL || !mProcessesToStop.removeOne(lProcess)) {
+		return;
+	}
+	flushOutput(lProcess);
+	if(mProcessesToStop.isEmpty()) {
+		finishKill();
+	}
+}
+
+void BackupJob::slotKillTimeout() {
+	foreach(KProcess *lProcess, mProcessesToStop) {
+		mLogStream << QString(QStringLiteral("Process %1 did not exit when asked to, killing it."))
+		              .arg(lProcess->program().first()) << endl;
+		lProcess->kill();
+	}
+}
+
+void BackupJob::finishKill() {
+	mLogStream << endl << mKillMessage << endl;
+	setError(KilledJobError);
+	emitResult();
 }
 
 void BackupJob::makeNice(int pPid) {
@@ -44,6 +130,41 @@ void BackupJob::makeNice(int pPid) {
 	setpriority(PRIO_PROCESS, pPid, 19);
 }
 
+void BackupJob::throttleProcess(int pPid) {
+	makeNice(pPid);
+	throttleController()->setProcess(pPid);
+}
+
+void BackupJob::throttleExtraProcess(int pPid) {
+	makeNice(pPid);
+	throttleController()->addProcess(pPid);
+}
+
+void BackupJob::releaseProcess(int pPid) {
+	if(mThrottleController != NULL) {
+		mThrottleController->removeProcess(pPid);
+	}
+}
+
+ThrottleController *BackupJob::throttleController() {
+	if(mThrottleController == NULL) {
+		QStringList lPaths = mBackupPlan.mPathsIncluded;
+		lPaths << mDestinationPath;
+		mThrottleController = new ThrottleController(this, lPaths);
+		mThrottleController->setPauseConditions(mBackupPlan.mPauseOnBattery, mBackupPlan.mPauseWhileActive);
+		if(mUrgent) {
+			mThrottleController->keepFullSpeed();
+		}
+		connect(this, SIGNAL(finished(KJob*)), SLOT(logThroughput()));
+	}
+	return mThrottleController;
+}
+
+void BackupJob::logThroughput() {
+	mLogStream << endl << mThrottleController->throughputSummary();
+	mLogStream.flush();
+}
+
 QString BackupJob::quoteArgs(const QStringList &pCommand) {
 	QString lResult;
 	bool lFirst = true;
@@ -60,3 +181,123 @@ QString BackupJob::quoteArgs(const QStringList &pCommand) {
 	return lResult;
 }
 
+
+// Only one channel is logged. Stdout of the separated processes is not used, it
+// goes to /dev/null so that it does not pile up unread. Must be called after
+// the output channel mode has been set.
+void BackupJob::watchOutput(KProcess *pProcess) {
+	if(pProcess->outputChannelMode() == KProcess::MergedChannels) {
+		connect(pProcess, SIGNAL(readyReadStandardOutput()), SLOT(slotReadOutput()));
+	} else {
+		pProcess->setStandardOutputFile(QProcess::nullDevice());
+		connect(pProcess, SIGNAL(readyReadStandardError()), SLOT(slotReadOutput()));
+	}
+}
+
+void BackupJob::slotReadOutput() {
+	KProcess *lProcess = qobject_cast<KProcess *>(sender());
+	if(lProcess == NULL) {
+		return;
+	}
+	if(lProcess->outputChannelMode() == KProcess::MergedChannels) {
+		handleOutput(lProcess->readAllStandardOutput());
+	} else {
+		handleOutput(lProcess->readAllStandardError());
+	}
+}
+
+void BackupJob::flushOutput(KProcess *pProcess) {
+	if(pProcess->outputChannelMode() == KProcess::MergedChannels) {
+		handleOutput(pProcess->readAllStandardOutput());
+	} else {
+		handleOutput(pProcess->readAllStandardError());
+	}
+	if(!mPendingOutput.isEmpty()) {
+		QString lLine = QString::fromUtf8(mPendingOutput);
+		parseProgress(lLine);
+		mLogStream << lLine << endl;
+		mPendingOutput.clear();
+	}
+	mLastWasCarriageReturn = false;
+	mLogStream.flush();
+}
+
+void BackupJob::handleOutput(const QByteArray &pData) {
+	mPendingOutput.append(pData);
+	int lLineStart = 0;
+	for(int i = 0; i < mPendingOutput.size(); ++i) {
+		char lChar = mPendingOutput.at(i);
+		if(lChar != '\n' && lChar != '\r') {
+			continue;
+		}
+		// A line feed directly after a carriage return should not give an empty line.
+		if(!(lChar == '\n' && mLastWasCarriageReturn && i == lLineStart)) {
+			QString lLine = QString::fromUtf8(mPendingOutput.constData() + lLineStart, i - lLineStart);
+			parseProgress(lLine);
+			if(lChar == '\n') {
+				mLogStream << lLine << endl;
+			}
+		}
+		mLastWasCarriageReturn = lChar == '\r';
+		lLineStart = i + 1;
+	}
+	mPendingOutput.remove(0, lLineStart);
+	if(mPendingOutput.size() > cMaxPendingOutput) {
+		mLogStream << QString::fromUtf8(mPendingOutput);
+		mPendingOutput.clear();
+	}
+	mLogStream.flush();
+}
+
+void BackupJob::startPhase(const QString &pName) {
+	BackupPhaseMetrics lPhase;
+	lPhase.mName = pName;
+	mMetrics.mPhases.append(lPhase);
+	mPhaseTimer.start();
+}
+
+void BackupJob::endPhase(int pExitCode, QProcess::ExitStatus pExitStatus) {
+	currentPhase().mWallTime = mPhaseTimer.elapsed();
+	currentPhase().mExitCode = pExitStatus == QProcess::NormalExit ? pExitCode : -1;
+}
+
+BackupPhaseMetrics &BackupJob::currentPhase() {
+	if(mMetrics.mPhases.isEmpty()) {
+		startPhase(QString());
+	}
+	return mMetrics.mPhases.last();
+}
+
+void BackupJob::startExclusionScan(const QStringList *pChangedPaths, const char *pSlot) {
+	mExclusionEngine = new ExclusionEngine(mBackupPlan, mExclusionStateFilePath, this);
+	if(pChangedPaths != NULL) {
+		mExclusionEngine->setChangedPaths(*pChangedPaths);
+	}
+	connect(mExclusionEngine, SIGNAL(finished()), pSlot);
+	mExclusionEngine->start(QThread::LowestPriority);
+}
+
+void BackupJob::logExclusions() {
+	QStringList lCacheFolders = mExclusionEngine->cacheFolders();
+	if(!lCacheFolders.isEmpty()) {
+		mLogStream << QStringLiteral("Excluding cache folders: ") << lCacheFolders.join(QStringLiteral(", ")) << endl;
+	}
+	if(!lCacheFolders.isEmpty() || !mBackupPlan.mExcludePatterns.isEmpty()) {
+		mLogStream << QStringLiteral("Cache folders and exclude patterns leave out about ")
+		           << KFormat().formatByteSize(mExclusionEngine->excludedBytes()) << endl;
+	}
+	QStringList lInvalidPatterns = mExclusionEngine->invalidPatterns();
+	if(!lInvalidPatterns.isEmpty()) {
+		mLogStream << QStringLiteral("Ignoring invalid exclude patterns: ") << lInvalidPatterns.join(QStringLiteral(", ")) << endl;
+	}
+	QStringList lSuggestions = mExclusionEngine->suggestions();
+	if(!lSuggestions.isEmpty()) {
+		mLogStream << QStringLiteral("These big folders change in nearly every backup, consider excluding them: ")
+		           << lSuggestions.join(QStringLiteral(", ")) << endl;
+	}
+	mLogStream << endl;
+}
+
+void BackupJob::parseProgress(const QString &pLine) {
+	Q_UNUSED(pLine)
+}
@@ -23,12 +23,19 @@
 
 #include <KJob>
 
+#include <QElapsedTimer>
 #include <QFile>
+#include <QProcess>
 #include <QStringList>
 #include <QTextStream>
 
+#include "backupmetrics.h"
 #include "backupplan.h"
 
+class ExclusionEngine;
+class KProcess;
+class ThrottleController;
+
 class BackupJob : public KJob
 {
 	Q_OBJECT
@@ -38,16 +45,87 @@ public:
 		ErrorWithoutLog,
 		ErrorSuggestRepair
 	};
+	const BackupRunMetrics &metrics() {
+		return mMetrics;
+	}
+	// What the job found out about the size of the destination afterwards.
+	enum SizeInfo {SizeUnknown, SizeChange, SizeTotal};
+	SizeInfo destinationSizeInfo() {
+		return mDestinationSizeInfo;
+	}
+	qint64 destinationSize() {
+		return mDestinationSize;
+	}
+	// Run at full speed even while the user is active.
+	void setUrgent() {
+		mUrgent = true;
+	}
+	// Where the exclusion engine keeps what it found out in earlier backups.
+	void setExclusionStateFilePath(const QString &pFilePath) {
+		mExclusionStateFilePath = pFilePath;
+	}
+
+protected slots:
+	void slotReadOutput();
+	void logThroughput();
+	void slotKilledProcessFinished();
+	void slotKillTimeout();
+	void finishKill();
 
 protected:
 	BackupJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath);
+	// Suspending stops the running processes where they are, killing disconnects them
+	// from the job so that nothing more happens after the result has been emitted.
+	// Returns false if the job is already being killed.
+	virtual bool doSuspend();
+	virtual bool doResume();
+	virtual bool doKill();
+	// Terminates the processes without blocking, the result is emitted with
+	// KilledJobError once they have exited. pMessage is logged then. Subclasses
+	// call this from doKill() and return false from it, since KJob would emit the
+	// result right away otherwise.
+	void terminateProcesses(const QList<KProcess *> &pProcesses, const QString &pMessage);
 	static void makeNice(int pPid);
+	// Like makeNice(), but the priority is raised while the user is away.
+	void throttleProcess(int pPid);
+	// For processes running at the same time as the one above, released again when they exit.
+	void throttleExtraProcess(int pPid);
+	void releaseProcess(int pPid);
+	ThrottleController *throttleController();
 	QString quoteArgs(const QStringList &pCommand);
+	// Output of a watched process is written to the log while it is running,
+	// instead of being kept in memory until it exits.
+	void watchOutput(KProcess *pProcess);
+	void flushOutput(KProcess *pProcess);
+	void handleOutput(const QByteArray &pData);
+	// Called for every line of output, also the ones terminated by a carriage
+	// return, which are progress updates and not written to the log.
+	virtual void parseProgress(const QString &pLine);
+	void startPhase(const QString &pName);
+	void endPhase(int pExitCode, QProcess::ExitStatus pExitStatus);
+	BackupPhaseMetrics &currentPhase();
+	// Looks for cache folders and such while the job gets ready, all included
+	// folders are walked if pChangedPaths is NULL. pSlot is called when done.
+	void startExclusionScan(const QStringList *pChangedPaths, const char *pSlot);
+	void logExclusions();
 	const BackupPlan &mBackupPlan;
 	QString mDestinationPath;
 	QString mLogFilePath;
 	QFile mLogFile;
 	QTextStream mLogStream;
+	QByteArray mPendingOutput;
+	bool mLastWasCarriageReturn;
+	BackupRunMetrics mMetrics;
+	QElapsedTimer mPhaseTimer;
+	ThrottleController *mThrottleController;
+	SizeInfo mDestinationSizeInfo;
+	qint64 mDestinationSize;
+	QString mExclusionStateFilePath;
+	ExclusionEngine *mExclusionEngine;
+	bool mUrgent;
+	bool mKilling;
+	QList<KProcess *> mProcessesToStop;
+	QString mKillMessage;
 };
 
 #endif // BACKUPJOB_H
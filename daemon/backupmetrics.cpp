@@ -0,0 +1,151 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "backupmetrics.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+// When the file grows past the limit it is rewritten with only the newest half.
+static const qint64 cMaxFileSize = 256 * 1024;
+
+BackupMetrics::BackupMetrics(const QString &pFilePath)
+   : mFilePath(pFilePath)
+{
+}
+
+void BackupMetrics::append(const BackupRunMetrics &pRun) {
+	QFile lFile(mFilePath);
+	if(!lFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		return;
+	}
+	QByteArray lStartTime = QByteArray::number(pRun.mStartTime.toMSecsSinceEpoch() / 1000);
+	QByteArray lRecord;
+	foreach(const BackupPhaseMetrics &lPhase, pRun.mPhases) {
+		lRecord += lStartTime + '\t' + QByteArray::number(pRun.mResult) + '\t' + lPhase.mName.toUtf8() + '\t';
+		lRecord += QByteArray::number(lPhase.mExitCode) + '\t' + QByteArray::number(lPhase.mWallTime) + '\t';
+		lRecord += QByteArray::number(lPhase.mBytesRead) + '\t' + QByteArray::number(lPhase.mBytesWritten) + '\t';
+		lRecord += QByteArray::number(lPhase.mFilesScanned) + '\t' + QByteArray::number(lPhase.mFilesChanged) + '\n';
+	}
+	// one write call, so that a run is never stored half.
+	lFile.write(lRecord);
+	bool lNeedsCompacting = lFile.size() > cMaxFileSize;
+	lFile.close();
+	if(lNeedsCompacting) {
+		compact();
+	}
+}
+
+void BackupMetrics::compact() {
+	QFile lFile(mFilePath);
+	if(!lFile.open(QIODevice::ReadOnly)) {
+		return;
+	}
+	QByteArray lData = lFile.readAll();
+	lFile.close();
+	int lCut = lData.indexOf('\n', lData.size() / 2);
+	// don't split a run, move the cut forward past the remaining lines of the same run.
+	while(lCut >= 0 && lCut + 1 < lData.size()) {
+		int lLineStart = lData.lastIndexOf('\n', lCut - 1) + 1;
+		QByteArray lRunStart = lData.mid(lLineStart, lData.indexOf('\t', lLineStart) - lLineStart + 1);
+		if(lData.mid(lCut + 1, lRunStart.size()) != lRunStart) {
+			break;
+		}
+		lCut = lData.indexOf('\n', lCut + 1);
+	}
+	if(lCut < 0) {
+		return;
+	}
+	QSaveFile lNewFile(mFilePath);
+	if(lNewFile.open(QIODevice::WriteOnly)) {
+		lNewFile.write(lData.constData() + lCut + 1, lData.size() - lCut - 1);
+		lNewFile.commit();
+	}
+}
+
+QList<BackupRunMetrics> BackupMetrics::load(int pMaxRuns) {
+	QList<BackupRunMetrics> lRuns;
+	QFile lFile(mFilePath);
+	if(!lFile.open(QIODevice::ReadOnly)) {
+		return lRuns;
+	}
+	qint64 lLastStartTime = -1;
+	forever {
+		QByteArray lLine = lFile.readLine();
+		if(lLine.isEmpty()) {
+			break;
+		}
+		QList<QByteArray> lFields = lLine.trimmed().split('\t');
+		if(lFields.count() != 9) {
+			continue;
+		}
+		qint64 lStartTime = lFields.at(0).toLongLong();
+		if(lRuns.isEmpty() || lStartTime != lLastStartTime) {
+			BackupRunMetrics lRun;
+			lRun.mStartTime = QDateTime::fromMSecsSinceEpoch(lStartTime * 1000).toUTC();
+			lRun.mResult = lFields.at(1).toInt();
+			lRuns.append(lRun);
+			lLastStartTime = lStartTime;
+		}
+		BackupPhaseMetrics lPhase;
+		lPhase.mName = QString::fromUtf8(lFields.at(2));
+		lPhase.mExitCode = lFields.at(3).toInt();
+		lPhase.mWallTime = lFields.at(4).toLongLong();
+		lPhase.mBytesRead = lFields.at(5).toULongLong();
+		lPhase.mBytesWritten = lFields.at(6).toULongLong();
+		lPhase.mFilesScanned = lFields.at(7).toULongLong();
+		lPhase.mFilesChanged = lFields.at(8).toULongLong();
+		lRuns.last().mPhases.append(lPhase);
+	}
+	while(pMaxRuns > 0 && lRuns.count() > pMaxRuns) {
+		lRuns.removeFirst();
+	}
+	return lRuns;
+}
+
+QString BackupMetrics::toJson(int pMaxRuns) {
+	QJsonArray lRunArray;
+	foreach(const BackupRunMetrics &lRun, load(pMaxRuns)) {
+		QJsonArray lPhaseArray;
+		foreach(const BackupPhaseMetrics &lPhase, lRun.mPhases) {
+			QJsonObject lPhaseObject;
+			lPhaseObject[QStringLiteral("name")] = lPhase.mName;
+			lPhaseObject[QStringLiteral("exitCode")] = lPhase.mExitCode;
+			lPhaseObject[QStringLiteral("wallTimeMs")] = (double)lPhase.mWallTime;
+			lPhaseObject[QStringLiteral("bytesRead")] = (double)lPhase.mBytesRead;
+			lPhaseObject[QStringLiteral("bytesWritten")] = (double)lPhase.mBytesWritten;
+			lPhaseObject[QStringLiteral("filesScanned")] = (double)lPhase.mFilesScanned;
+			lPhaseObject[QStringLiteral("filesChanged")] = (double)lPhase.mFilesChanged;
+			// bytes per second
+			lPhaseObject[QStringLiteral("throughput")] = lPhase.mWallTime > 0 ?
+			                                                (double)lPhase.mBytesRead * 1000 / lPhase.mWallTime : 0.0;
+			lPhaseArray.append(lPhaseObject);
+		}
+		QJsonObject lRunObject;
+		lRunObject[QStringLiteral("startTime")] = lRun.mStartTime.toString(Qt::ISODate);
+		lRunObject[QStringLiteral("result")] = lRun.mResult;
+		lRunObject[QStringLiteral("phases")] = lPhaseArray;
+		lRunArray.append(lRunObject);
+	}
+	return QString::fromUtf8(QJsonDocument(lRunArray).toJson(QJsonDocument::Compact));
+}
@@ -0,0 +1,63 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef BACKUPMETRICS_H
+#define BACKUPMETRICS_H
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+
+// What happened during one phase (fsck, index, save...) of a backup run.
+struct BackupPhaseMetrics {
+	BackupPhaseMetrics()
+	   : mWallTime(0), mBytesRead(0), mBytesWritten(0), mFilesScanned(0), mFilesChanged(0), mExitCode(0) {}
+	QString mName;
+	qint64 mWallTime; // milliseconds
+	quint64 mBytesRead;
+	quint64 mBytesWritten; // growth of the backup repository
+	quint64 mFilesScanned;
+	quint64 mFilesChanged;
+	int mExitCode;
+};
+
+struct BackupRunMetrics {
+	BackupRunMetrics() : mResult(0) {}
+	QDateTime mStartTime;
+	int mResult; // KJob error code
+	QList<BackupPhaseMetrics> mPhases;
+};
+
+// Append-only history of backup runs for one plan. Stored as tab separated
+// values, one line per phase. Old runs are dropped once the file grows too big.
+class BackupMetrics
+{
+public:
+	explicit BackupMetrics(const QString &pFilePath);
+	void append(const BackupRunMetrics &pRun);
+	QList<BackupRunMetrics> load(int pMaxRuns);
+	QString toJson(int pMaxRuns);
+
+protected:
+	void compact();
+	QString mFilePath;
+};
+
+#endif // BACKUPMETRICS_H
@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "blockdevice.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+static QString deviceNumber(dev_t pDevice) {
+	return QStringLiteral("%1:%2").arg(major(pDevice)).arg(minor(pDevice));
+}
+
+// Filesystems like btrfs give files an anonymous device number, look up what
+// is actually mounted there instead.
+static QString mountSourceDevice(const QString &pDeviceNumber) {
+	QFile lMountInfo(QStringLiteral("/proc/self/mountinfo"));
+	if(!lMountInfo.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		return QString();
+	}
+	// don't use atEnd() to detect when finished reading file, size of
+	// this special file is 0 but still returns data when read.
+	forever {
+		QByteArray lLine = lMountInfo.readLine();
+		if(lLine.isEmpty()) {
+			break;
+		}
+		QList<QByteArray> lFields = lLine.split(' ');
+		int lSeparator = lFields.indexOf("-");
+		if(lFields.count() < 3 || lSeparator < 0 || lSeparator + 2 >= lFields.count() ||
+		      QString::fromLatin1(lFields.at(2)) != pDeviceNumber) {
+			continue;
+		}
+		QByteArray lSource = lFields.at(lSeparator + 2);
+		struct stat lStat;
+		if(lSource.startsWith("/dev/") && 0 == stat(lSource.constData(), &lStat) && S_ISBLK(lStat.st_mode)) {
+			return deviceNumber(lStat.st_rdev);
+		}
+	}
+	return QString();
+}
+
+QString diskDeviceNumber(const QString &pPath) {
+	struct stat lStat;
+	if(0 != stat(QFile::encodeName(pPath).constData(), &lStat)) {
+		return QString();
+	}
+	QString lNumber = deviceNumber(lStat.st_dev);
+	QString lSysPath = QStringLiteral("/sys/dev/block/") + lNumber;
+	if(!QFileInfo(lSysPath).exists()) {
+		lNumber = mountSourceDevice(lNumber);
+		if(lNumber.isEmpty()) {
+			return QString();
+		}
+		lSysPath = QStringLiteral("/sys/dev/block/") + lNumber;
+	}
+	if(QFileInfo(lSysPath + QStringLiteral("/partition")).exists()) {
+		QFile lDiskDevice(QFileInfo(lSysPath).canonicalFilePath() + QStringLiteral("/../dev"));
+		if(lDiskDevice.open(QIODevice::ReadOnly)) {
+			lNumber = QString::fromLatin1(lDiskDevice.readAll().trimmed());
+		}
+	}
+	return lNumber;
+}
@@ -19,38 +19,96 @@
  ***************************************************************************/
 
 #include "bupjob.h"
+#include "packverifier.h"
+#include "toolcapabilities.h"
 
 #include <QDir>
+#include <QFileSystemWatcher>
+#include <QRegularExpression>
+#include <QThread>
 #include <QTimer>
 
 #include <KLocalizedString>
 
-BupJob::BupJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath)
-   :BackupJob(pBackupPlan, pDestinationPath, pLogFilePath)
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// How long stopped par2 workers get to exit before they are killed.
+static const int cPar2KillTimeout = 10000;
+
+GroupedProcess::GroupedProcess(QObject *pParent)
+   : KProcess(pParent)
 {
-	mFsckProcess.setOutputChannelMode(KProcess::SeparateChannels);
+}
+
+void GroupedProcess::signalGroup(int pSignal) {
+	if(pid() > 0) {
+		::kill(-pid(), pSignal);
+	}
+}
+
+void GroupedProcess::terminateGroup(int pKillTimeout) {
+	setParent(NULL);
+	if(state() == QProcess::NotRunning) {
+		deleteLater();
+		return;
+	}
+	connect(this, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(deleteLater()));
+	signalGroup(SIGTERM);
+	// the group could have been stopped by the throttling of the job.
+	signalGroup(SIGCONT);
+	QTimer::singleShot(pKillTimeout, this, SLOT(killGroup()));
+}
+
+void GroupedProcess::killGroup() {
+	signalGroup(SIGKILL);
+}
+
+// runs in the child process, between fork and exec.
+void GroupedProcess::setupChildProcess() {
+	setpgid(0, 0);
+}
+
+BupJob::BupJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath,
+               const QString &pLedgerFilePath)
+   :BackupJob(pBackupPlan, pDestinationPath, pLogFilePath), mLedgerFilePath(pLedgerFilePath), mPackVerifier(NULL),
+     mSavePid(0), mSaveDone(false), mPackWatcher(NULL), mPar2Failed(false), mCheckingDone(false),
+     mExclusionScanDone(false), mRepositorySize(0), mSizeBeforeBackup(0), mOnlyChangedPaths(false),
+     mFolderBackup(false)
+{
+	mInitProcess.setOutputChannelMode(KProcess::SeparateChannels);
 	mIndexProcess.setOutputChannelMode(KProcess::SeparateChannels);
 	mSaveProcess.setOutputChannelMode(KProcess::SeparateChannels);
-	mPar2Process.setOutputChannelMode(KProcess::SeparateChannels);
+	// bup only prints progress when it thinks stderr is a terminal.
+	mIndexProcess.setEnv(QStringLiteral("BUP_FORCE_TTY"), QStringLiteral("2"));
+	mSaveProcess.setEnv(QStringLiteral("BUP_FORCE_TTY"), QStringLiteral("2"));
+	watchOutput(&mIndexProcess);
+	watchOutput(&mSaveProcess);
 }
 
 void BupJob::start() {
-	QTimer::singleShot(0, this, SLOT(startJob()));
+	connect(ToolCapabilities::instance(), SIGNAL(ready()), SLOT(startJob()), Qt::UniqueConnection);
+	ToolCapabilities::instance()->probe();
+}
+
+void BupJob::setChangedPaths(const QStringList &pPaths) {
+	mChangedPaths = pPaths;
+	mOnlyChangedPaths = true;
 }
 
 void BupJob::startJob() {
-	KProcess lPar2Process;
-	lPar2Process.setOutputChannelMode(KProcess::SeparateChannels);
-	lPar2Process << QStringLiteral("bup") << QStringLiteral("fsck") << QStringLiteral("--par2-ok");
-	int lExitCode = lPar2Process.execute();
-	if(lExitCode < 0) {
+	ToolCapabilities *lTools = ToolCapabilities::instance();
+	disconnect(lTools, SIGNAL(ready()), this, SLOT(startJob()));
+	if(lTools->bupVersion().isEmpty()) {
 		setError(ErrorWithoutLog);
 		setErrorText(xi18nc("@info notification",
 		                    "The <application>bup</application> program is "
 		                    "needed but could not be found, maybe it is not installed?"));
 		emitResult();
 		return;
-	} else if(mBackupPlan.mGenerateRecoveryInfo && lExitCode != 0) {
+	} else if(mBackupPlan.mGenerateRecoveryInfo && !lTools->par2Available()) {
 		setError(ErrorWithoutLog);
 		setErrorText(xi18nc("@info notification",
 		                    "The <application>par2</application> program is "
@@ -62,15 +120,25 @@ void BupJob::startJob() {
 	mLogStream << QStringLiteral("Kup is starting bup backup job at ")
 	           << QLocale().toString(QDateTime::currentDateTime())
 	           << endl << endl;
+	startExclusionScan(mOnlyChangedPaths ? &mChangedPaths : NULL, SLOT(slotExclusionScanDone()));
 
-	KProcess lInitProcess;
-	lInitProcess.setOutputChannelMode(KProcess::SeparateChannels);
-	lInitProcess << QStringLiteral("bup");
-	lInitProcess << QStringLiteral("-d") << mDestinationPath;
-	lInitProcess << QStringLiteral("init");
-	mLogStream << quoteArgs(lInitProcess.program()) << endl;
-	if(lInitProcess.execute() != 0) {
-		mLogStream << QString::fromUtf8(lInitProcess.readAllStandardError()) << endl;
+	if(QFileInfo(mDestinationPath + QStringLiteral("/objects/pack")).isDir() &&
+	      QFileInfo(mDestinationPath + QStringLiteral("/refs")).isDir() &&
+	      QFileInfo(mDestinationPath + QStringLiteral("/HEAD")).exists()) {
+		startChecking();
+		return;
+	}
+	mInitProcess << QStringLiteral("bup");
+	mInitProcess << QStringLiteral("-d") << mDestinationPath;
+	mInitProcess << QStringLiteral("init");
+	connect(&mInitProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotInitDone(int,QProcess::ExitStatus)));
+	mLogStream << quoteArgs(mInitProcess.program()) << endl;
+	mInitProcess.start();
+}
+
+void BupJob::slotInitDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
+	if(pExitStatus != QProcess::NormalExit || pExitCode != 0) {
+		mLogStream << QString::fromUtf8(mInitProcess.readAllStandardError()) << endl;
 		mLogStream << endl << QStringLiteral("Kup did not successfully complete the bup backup job: "
 		                                     "failed to initialize backup destination.") << endl;
 		setError(ErrorWithLog);
@@ -79,28 +147,55 @@ void BupJob::startJob() {
 		emitResult();
 		return;
 	}
+	startChecking();
+}
 
-	if(mBackupPlan.mCheckBackups) {
-		mFsckProcess << QStringLiteral("bup");
-		mFsckProcess << QStringLiteral("-d") << mDestinationPath;
-		mFsckProcess << QStringLiteral("fsck") << QStringLiteral("--quick");
+// bup finishes the pack it is writing when it reaches this size, default is 1GB.
+// Objects in finished packs survive an interrupted save, bup has recorded their
+// hashes in its index and the next run does not read those files again. Given to
+// bup save through the environment, like "git -c" does, so that the repository
+// config is left alone.
+static const char cPackSizeLimit[] = "'pack.packsizelimit=268435456'";
 
-		connect(&mFsckProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotCheckingDone(int,QProcess::ExitStatus)));
-		connect(&mFsckProcess, SIGNAL(started()), SLOT(slotCheckingStarted()));
-		mLogStream << quoteArgs(mFsckProcess.program()) << endl;
-		mFsckProcess.start();
-	} else {
-		slotCheckingDone(0, QProcess::NormalExit);
+void BupJob::limitPackSize() {
+	QFile lConfig(mDestinationPath + QStringLiteral("/config"));
+	if(lConfig.open(QIODevice::ReadOnly | QIODevice::Text) && lConfig.readAll().toLower().contains("packsizelimit")) {
+		return; // keep what is there, could have been set by the user.
+	}
+	QByteArray lParameters = qgetenv("GIT_CONFIG_PARAMETERS");
+	if(!lParameters.isEmpty()) {
+		lParameters += ' ';
 	}
+	lParameters += cPackSizeLimit;
+	mSaveProcess.setEnv(QStringLiteral("GIT_CONFIG_PARAMETERS"), QString::fromLocal8Bit(lParameters));
 }
 
-void BupJob::slotCheckingStarted() {
-	makeNice(mFsckProcess.pid());
+void BupJob::startChecking() {
+	mSizeBeforeBackup = repositoryFilesSize();
+	if(mBackupPlan.mCheckBackups && !mFolderBackup) {
+		mPackVerifier = new PackVerifier(mDestinationPath, mLedgerFilePath, this);
+		connect(mPackVerifier, SIGNAL(finished(bool)), SLOT(slotCheckingDone(bool)));
+		mLogStream << QStringLiteral("Verifying checksums of packfiles") << endl;
+		startPhase(QStringLiteral("verify"));
+		mPackVerifier->start(PackVerifier::ChecksumLevel, mBackupPlan.mFullVerificationInterval);
+	} else {
+		mCheckingDone = true;
+		startIndexing();
+	}
 }
 
-void BupJob::slotCheckingDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
-	mLogStream << QString::fromUtf8(mFsckProcess.readAllStandardError());
-	if(pExitStatus != QProcess::NormalExit || pExitCode != 0) {
+void BupJob::slotCheckingDone(bool pSuccess) {
+	foreach(const QString &lFailure, mPackVerifier->failures()) {
+		mLogStream << lFailure << endl;
+	}
+	mLogStream << QString(QStringLiteral("%1 packfiles checked%2, %3 already verified earlier."))
+	              .arg(mPackVerifier->packsChecked())
+	              .arg(mPackVerifier->wasFullPass() ? QStringLiteral(" (complete pass)") : QString())
+	              .arg(mPackVerifier->packsSkipped()) << endl;
+	currentPhase().mBytesRead = mPackVerifier->bytesRead();
+	currentPhase().mFilesScanned = mPackVerifier->packsChecked();
+	endPhase(pSuccess ? 0 : 1, QProcess::NormalExit);
+	if(!pSuccess) {
 		mLogStream << endl << QStringLiteral("Kup did not successfully complete the bup backup job: "
 		                                     "failed integrity check. Your backups could be "
 		                                     "corrupted! See above for details.") << endl;
@@ -118,6 +213,57 @@ void BupJob::slotCheckingDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
 		emitResult();
 		return;
 	}
+	mCheckingDone = true;
+	startIndexing();
+}
+
+void BupJob::slotExclusionScanDone() {
+	mExclusionScanDone = true;
+	startIndexing();
+}
+
+// Changed paths are passed to bup index on one command line, above this size
+// all included folders are indexed instead. Far below ARG_MAX on any system.
+static const int cMaxIndexArgumentsSize = 128 * 1024;
+
+// bup index stops on a path that does not exist, a file deleted after the journal
+// recorded it is replaced by its closest existing parent folder. Paths inside
+// another path of the list are left out, bup index recurses into that one anyway.
+static QStringList existingPaths(const QStringList &pPaths) {
+	QStringList lPaths;
+	foreach(QString lPath, pPaths) {
+		QFileInfo lInfo(lPath);
+		while(!lInfo.exists() && !lInfo.isSymLink() && lPath != QStringLiteral("/")) {
+			lPath = lInfo.path();
+			lInfo.setFile(lPath);
+		}
+		lPaths.append(lPath);
+	}
+	lPaths.sort();
+	QStringList lResult;
+	QString lPrefix;
+	foreach(const QString &lPath, lPaths) {
+		if(!lResult.isEmpty() && (lPath == lResult.last() || lPath.startsWith(lPrefix))) {
+			continue;
+		}
+		lResult.append(lPath);
+		lPrefix = lPath.endsWith(QLatin1Char('/')) ? lPath : lPath + QLatin1Char('/');
+	}
+	return lResult;
+}
+
+// Runs when both the integrity check and the exclusion scan are done.
+void BupJob::startIndexing() {
+	if(!mCheckingDone || !mExclusionScanDone) {
+		return;
+	}
+	logExclusions();
+	if(mOnlyChangedPaths && mChangedPaths.isEmpty()) {
+		mLogStream << QStringLiteral("Nothing has changed since the last backup, no need to update the index.")
+		           << endl;
+		startSaving();
+		return;
+	}
 	mIndexProcess << QStringLiteral("bup");
 	mIndexProcess << QStringLiteral("-d") << mDestinationPath;
 	mIndexProcess << QStringLiteral("index") << QStringLiteral("-u");
@@ -126,20 +272,37 @@ void BupJob::slotCheckingDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
 		mIndexProcess << QStringLiteral("--exclude");
 		mIndexProcess << lExclude;
 	}
-	mIndexProcess << mBackupPlan.mPathsIncluded;
+	mIndexProcess << mExclusionEngine->bupArguments();
+	QStringList lPaths = mBackupPlan.mPathsIncluded;
+	if(mOnlyChangedPaths) {
+		QStringList lChangedPaths = existingPaths(mChangedPaths);
+		int lSize = 0;
+		foreach(const QString &lPath, lChangedPaths) {
+			lSize += lPath.toLocal8Bit().size() + 1;
+		}
+		if(lSize <= cMaxIndexArgumentsSize) {
+			lPaths = lChangedPaths;
+		} else {
+			mLogStream << QStringLiteral("Too many changed paths for one command, indexing all included folders.")
+			           << endl;
+		}
+	}
+	mIndexProcess << lPaths;
 
 	connect(&mIndexProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotIndexingDone(int,QProcess::ExitStatus)));
 	connect(&mIndexProcess, SIGNAL(started()), SLOT(slotIndexingStarted()));
 	mLogStream << quoteArgs(mIndexProcess.program()) << endl;
+	startPhase(QStringLiteral("index"));
 	mIndexProcess.start();
 }
 
 void BupJob::slotIndexingStarted() {
-	makeNice(mIndexProcess.pid());
+	throttleProcess(mIndexProcess.pid());
 }
 
 void BupJob::slotIndexingDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
-	mLogStream << QString::fromUtf8(mIndexProcess.readAllStandardError());
+	flushOutput(&mIndexProcess);
+	endPhase(pExitCode, pExitStatus);
 	if(pExitStatus != QProcess::NormalExit || pExitCode != 0) {
 		mLogStream << endl << QStringLiteral("Kup did not successfully complete the bup backup job: failed to index everything.") << endl;
 		setErrorText(xi18nc("@info notification", "Failed to index the file system. "
@@ -148,64 +311,269 @@ void BupJob::slotIndexingDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
 		emitResult();
 		return;
 	}
+	startSaving();
+}
 
+void BupJob::startSaving() {
 	mSaveProcess << QStringLiteral("bup");
 	mSaveProcess << QStringLiteral("-d") << mDestinationPath;
 	mSaveProcess << QStringLiteral("save");
 	mSaveProcess << QStringLiteral("-n") << QStringLiteral("kup");
 	mSaveProcess << mBackupPlan.mPathsIncluded;
+	limitPackSize();
 
 	connect(&mSaveProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotSavingDone(int,QProcess::ExitStatus)));
 	connect(&mSaveProcess, SIGNAL(started()), SLOT(slotSavingStarted()));
 	mLogStream << quoteArgs(mSaveProcess.program()) << endl;
+	startPhase(QStringLiteral("save"));
+	mRepositorySize = packDirectorySize();
+	if(mBackupPlan.mGenerateRecoveryInfo) {
+		// packs from earlier backups are left for the sweep after saving
+		QString lPackDirPath = mDestinationPath + QStringLiteral("/objects/pack");
+		foreach(const QString &lIndex, QDir(lPackDirPath).entryList(QStringList() << QStringLiteral("pack-*.idx"),
+		                                                              QDir::Files)) {
+			mPar2Seen.insert(lIndex.left(lIndex.length() - 4));
+		}
+		mPackWatcher = new QFileSystemWatcher(QStringList() << lPackDirPath, this);
+		connect(mPackWatcher, SIGNAL(directoryChanged(QString)), SLOT(slotPackDirectoryChanged()));
+	}
 	mSaveProcess.start();
 }
 
 void BupJob::slotSavingStarted() {
-	makeNice(mSaveProcess.pid());
+	mSavePid = mSaveProcess.pid();
+	throttleProcess(mSavePid);
 }
 
 void BupJob::slotSavingDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
-	mLogStream << QString::fromUtf8(mSaveProcess.readAllStandardError());
+	flushOutput(&mSaveProcess);
+	releaseProcess(mSavePid);
+	endPhase(pExitCode, pExitStatus);
+	delete mPackWatcher;
+	mPackWatcher = NULL;
+	quint64 lRepositorySize = packDirectorySize();
+	currentPhase().mBytesWritten = lRepositorySize > mRepositorySize ? lRepositorySize - mRepositorySize : 0;
 	if(pExitStatus != QProcess::NormalExit || pExitCode != 0) {
 		mLogStream << endl << QStringLiteral("Kup did not successfully complete the bup backup job: "
 		                                     "failed to save everything.") << endl;
 		setErrorText(xi18nc("@info notification", "Failed to save the complete backup. "
 		                                          "See log file for more details."));
 		setError(ErrorWithLog);
+		stopPar2Workers();
 		emitResult();
 		return;
 	}
 	if(mBackupPlan.mGenerateRecoveryInfo) {
-		mPar2Process << QStringLiteral("bup");
-		mPar2Process << QStringLiteral("-d") << mDestinationPath;
-		mPar2Process << QStringLiteral("fsck") << QStringLiteral("-g");
-
-		connect(&mPar2Process, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotRecoveryInfoDone(int,QProcess::ExitStatus)));
-		connect(&mPar2Process, SIGNAL(started()), SLOT(slotRecoveryInfoStarted()));
-		mLogStream << quoteArgs(mPar2Process.program()) << endl;
-		mPar2Process.start();
+		mSaveDone = true;
+		startPhase(QStringLiteral("par2"));
+		mRepositorySize = packDirectorySize();
+		queuePacksForPar2(!mFolderBackup);
+		startPar2Workers();
+		if(mPar2Workers.isEmpty()) {
+			finishRecoveryInfo();
+		}
 	} else {
+		recordSizeChange();
 		mLogStream << endl << QStringLiteral("Kup successfully completed the bup backup job at ")
 		           << QLocale().toString(QDateTime::currentDateTime()) << endl;
 		emitResult();
 	}
 }
 
-void BupJob::slotRecoveryInfoStarted() {
-	makeNice(mPar2Process.pid());
+void BupJob::slotPackDirectoryChanged() {
+	queuePacksForPar2(false);
+	startPar2Workers();
 }
 
-void BupJob::slotRecoveryInfoDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
-	mLogStream << QString::fromUtf8(mPar2Process.readAllStandardError());
-	if(pExitStatus != QProcess::NormalExit || pExitCode != 0) {
+// bup renames the index into place after the pack is complete, so a new index
+// means a finished pack. The sweep after saving also picks up packs which were
+// missed or are left without recovery info by an earlier backup.
+void BupJob::queuePacksForPar2(bool pSweep) {
+	QDir lPackDir(mDestinationPath + QStringLiteral("/objects/pack"));
+	QSet<QString> lRunning;
+	foreach(const Par2Worker &lWorker, mPar2Workers) {
+		lRunning.insert(lWorker.mPack);
+	}
+	foreach(const QString &lIndex, lPackDir.entryList(QStringList() << QStringLiteral("pack-*.idx"), QDir::Files)) {
+		QString lPack = lIndex.left(lIndex.length() - 4);
+		if(pSweep) {
+			if(lPackDir.exists(lPack + QStringLiteral(".par2")) || mPar2Queue.contains(lPack) ||
+			      lRunning.contains(lPack)) {
+				continue;
+			}
+		} else if(mPar2Seen.contains(lPack)) {
+			continue;
+		}
+		mPar2Seen.insert(lPack);
+		mPar2Queue.append(lPack);
+	}
+}
+
+void BupJob::startPar2Workers() {
+	while(!mPar2Queue.isEmpty() && mPar2Workers.count() < par2WorkerLimit()) {
+		Par2Worker lWorker;
+		lWorker.mPack = mPar2Queue.takeFirst();
+		GroupedProcess *lProcess = new GroupedProcess(this);
+		lProcess->setOutputChannelMode(KProcess::SeparateChannels);
+		*lProcess << QStringLiteral("bup");
+		*lProcess << QStringLiteral("-d") << mDestinationPath;
+		*lProcess << QStringLiteral("fsck") << QStringLiteral("-g");
+		*lProcess << mDestinationPath + QStringLiteral("/objects/pack/") + lWorker.mPack + QStringLiteral(".pack");
+		watchOutput(lProcess);
+		connect(lProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotPar2WorkerDone(int,QProcess::ExitStatus)));
+		connect(lProcess, SIGNAL(error(QProcess::ProcessError)), SLOT(slotPar2WorkerError(QProcess::ProcessError)));
+		mLogStream << quoteArgs(lProcess->program()) << endl;
+		lProcess->start();
+		lWorker.mPid = lProcess->pid();
+		mPar2Workers.insert(lProcess, lWorker);
+		if(lWorker.mPid > 0) {
+			throttleExtraProcess(lWorker.mPid);
+		}
+	}
+}
+
+// As many workers as there are cores not busy with something else, while
+// saving one core is left for bup save.
+int BupJob::par2WorkerLimit() {
+	int lCores = qMax(1, QThread::idealThreadCount());
+	int lReserved = mSaveDone ? 0 : 1;
+	int lOthers = 0;
+	double lLoad;
+	if(getloadavg(&lLoad, 1) == 1) {
+		lOthers = qMax(0, (int)ceil(lLoad) - mPar2Workers.count() - lReserved);
+	}
+	return qMax(1, lCores - lReserved - lOthers);
+}
+
+void BupJob::slotPar2WorkerDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
+	par2WorkerFinished(qobject_cast<GroupedProcess *>(sender()), pExitStatus == QProcess::NormalExit && pExitCode == 0);
+}
+
+void BupJob::slotPar2WorkerError(QProcess::ProcessError pError) {
+	// no finished() signal will follow
+	if(pError == QProcess::FailedToStart) {
+		par2WorkerFinished(qobject_cast<GroupedProcess *>(sender()), false);
+	}
+}
+
+void BupJob::par2WorkerFinished(GroupedProcess *pProcess, bool pSuccess) {
+	if(!mPar2Workers.contains(pProcess)) {
+		return;
+	}
+	Par2Worker lWorker = mPar2Workers.take(pProcess);
+	flushOutput(pProcess);
+	releaseProcess(lWorker.mPid);
+	pProcess->deleteLater();
+	if(!pSuccess) {
+		mLogStream << QString(QStringLiteral("Failed to generate recovery info for %1")).arg(lWorker.mPack) << endl;
+		mPar2Failed = true;
+	}
+	startPar2Workers();
+	if(mSaveDone && mPar2Workers.isEmpty()) {
+		finishRecoveryInfo();
+	}
+}
+
+// Does not wait for the workers to exit, their pids are released when they have.
+void BupJob::stopPar2Workers() {
+	mPar2Queue.clear();
+	foreach(GroupedProcess *lProcess, mPar2Workers.keys()) {
+		lProcess->disconnect(this);
+		if(lProcess->state() == QProcess::NotRunning) {
+			releaseProcess(mPar2Workers.take(lProcess).mPid);
+		} else {
+			connect(lProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotPar2WorkerStopped()));
+		}
+		lProcess->terminateGroup(cPar2KillTimeout);
+	}
+}
+
+void BupJob::slotPar2WorkerStopped() {
+	GroupedProcess *lProcess = qobject_cast<GroupedProcess *>(sender());
+	if(mPar2Workers.contains(lProcess)) {
+		releaseProcess(mPar2Workers.take(lProcess).mPid);
+	}
+}
+
+void BupJob::finishRecoveryInfo() {
+	endPhase(mPar2Failed ? 1 : 0, QProcess::NormalExit);
+	quint64 lRepositorySize = packDirectorySize();
+	currentPhase().mBytesWritten = lRepositorySize > mRepositorySize ? lRepositorySize - mRepositorySize : 0;
+	if(mPar2Failed) {
 		mLogStream << endl << QStringLiteral("Kup did not successfully complete the bup backup job: "
 		                                     "failed to generate recovery info.") << endl;
 		setErrorText(xi18nc("@info notification", "Failed to generate recovery info for the backup. "
 		                                          "See log file for more details."));
 		setError(ErrorWithLog);
 	} else {
+		recordSizeChange();
 		mLogStream << endl << QStringLiteral("Kup successfully completed the bup backup job.") << endl;
 	}
 	emitResult();
 }
+
+bool BupJob::doKill() {
+	if(!BackupJob::doKill()) {
+		return false;
+	}
+	if(mPackVerifier != NULL) {
+		mPackVerifier->disconnect(this);
+	}
+	delete mPackWatcher;
+	mPackWatcher = NULL;
+	stopPar2Workers();
+	terminateProcesses(QList<KProcess *>() << &mInitProcess << &mIndexProcess << &mSaveProcess,
+	                   QStringLiteral("Kup interrupted the bup backup job. Files in packs which bup "
+	                                  "finished writing will not be read again by the next backup."));
+	return false; // result is emitted when the processes have exited
+}
+
+void BupJob::parseProgress(const QString &pLine) {
+	static const QRegularExpression lSavingRegExp(
+	         QStringLiteral("^Saving: [\\d.]+% \\((\\d+)/(\\d+)k, (\\d+)/(\\d+) files\\)(?:.* (\\d+)k/s)?"));
+	static const QRegularExpression lIndexingRegExp(QStringLiteral("^Indexing: (\\d+)"));
+
+	QRegularExpressionMatch lMatch = lSavingRegExp.match(pLine);
+	if(lMatch.hasMatch()) {
+		setTotalAmount(KJob::Bytes, lMatch.captured(2).toULongLong() * 1024);
+		setTotalAmount(KJob::Files, lMatch.captured(4).toULongLong());
+		setProcessedAmount(KJob::Files, lMatch.captured(3).toULongLong());
+		setProcessedAmount(KJob::Bytes, lMatch.captured(1).toULongLong() * 1024);
+		currentPhase().mBytesRead = processedAmount(KJob::Bytes);
+		currentPhase().mFilesChanged = totalAmount(KJob::Files);
+		if(!lMatch.captured(5).isEmpty()) {
+			emitSpeed(lMatch.captured(5).toULong() * 1024);
+		}
+		return;
+	}
+	lMatch = lIndexingRegExp.match(pLine);
+	if(lMatch.hasMatch()) {
+		// total is not known until indexing is done
+		setProcessedAmount(KJob::Files, lMatch.captured(1).toULongLong());
+		currentPhase().mFilesScanned = processedAmount(KJob::Files);
+	}
+}
+
+quint64 BupJob::packDirectorySize() {
+	quint64 lSize = 0;
+	QDir lPackDir(mDestinationPath + QStringLiteral("/objects/pack"));
+	foreach(const QFileInfo &lInfo, lPackDir.entryInfoList(QDir::Files)) {
+		lSize += lInfo.size();
+	}
+	return lSize;
+}
+
+// Everything bup writes: packfiles with their indexes, bloom filters and
+// recovery info in objects/pack, the index of the filesystem at the top level.
+quint64 BupJob::repositoryFilesSize() {
+	quint64 lSize = packDirectorySize();
+	foreach(const QFileInfo &lInfo, QDir(mDestinationPath).entryInfoList(QDir::Files | QDir::Hidden)) {
+		lSize += lInfo.size();
+	}
+	return lSize;
+}
+
+void BupJob::recordSizeChange() {
+	mDestinationSizeInfo = SizeChange;
+	mDestinationSize = (qint64)repositoryFilesSize() - (qint64)mSizeBeforeBackup;
+}
@@ -25,30 +25,105 @@
 
 #include <KProcess>
 
+#include <QHash>
+#include <QSet>
+
+class PackVerifier;
+class QFileSystemWatcher;
+
+// A process in a process group of its own, bup fsck -g runs par2 in child
+// processes and signals to the group reach those too.
+class GroupedProcess : public KProcess
+{
+	Q_OBJECT
+
+public:
+	explicit GroupedProcess(QObject *pParent = NULL);
+	void signalGroup(int pSignal);
+	// Asks the group to exit without waiting for it. The process no longer belongs
+	// to a job after this, it deletes itself once it has exited and the group is
+	// killed if that takes longer than pKillTimeout milliseconds.
+	void terminateGroup(int pKillTimeout);
+
+protected slots:
+	void killGroup();
+
+protected:
+	virtual void setupChildProcess();
+};
+
 class BupJob : public BackupJob
 {
 	Q_OBJECT
 
 public:
-	BupJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath);
+	BupJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath,
+	       const QString &pLedgerFilePath);
 	virtual void start();
+	// Only index these paths instead of everything in the backup plan.
+	void setChangedPaths(const QStringList &pPaths);
+	// For a backup of a single folder the user is waiting for. Checking the archive
+	// and adding recovery info to packs of earlier backups is left to the next
+	// complete backup.
+	void setFolderBackup() {
+		mFolderBackup = true;
+	}
 
 protected slots:
 	void startJob();
-	void slotCheckingStarted();
-	void slotCheckingDone(int pExitCode, QProcess::ExitStatus pExitStatus);
+	void slotInitDone(int pExitCode, QProcess::ExitStatus pExitStatus);
+	void slotExclusionScanDone();
+	void slotCheckingDone(bool pSuccess);
 	void slotIndexingStarted();
 	void slotIndexingDone(int pExitCode, QProcess::ExitStatus pExitStatus);
 	void slotSavingStarted();
 	void slotSavingDone(int pExitCode, QProcess::ExitStatus pExitStatus);
-	void slotRecoveryInfoStarted();
-	void slotRecoveryInfoDone(int pExitCode, QProcess::ExitStatus pExitStatus);
+	void slotPackDirectoryChanged();
+	void slotPar2WorkerDone(int pExitCode, QProcess::ExitStatus pExitStatus);
+	void slotPar2WorkerError(QProcess::ProcessError pError);
+	void slotPar2WorkerStopped();
 
 protected:
-	KProcess mFsckProcess;
+	virtual bool doKill();
+	virtual void parseProgress(const QString &pLine);
+	void limitPackSize();
+	void startChecking();
+	void startIndexing();
+	void startSaving();
+	quint64 packDirectorySize();
+	quint64 repositoryFilesSize();
+	void recordSizeChange();
+	void queuePacksForPar2(bool pSweep);
+	void startPar2Workers();
+	int par2WorkerLimit();
+	void par2WorkerFinished(GroupedProcess *pProcess, bool pSuccess);
+	void stopPar2Workers();
+	void finishRecoveryInfo();
+	QString mLedgerFilePath;
+	PackVerifier *mPackVerifier;
+	KProcess mInitProcess;
 	KProcess mIndexProcess;
 	KProcess mSaveProcess;
-	KProcess mPar2Process;
+	int mSavePid;
+	bool mSaveDone;
+	// Recovery info is generated for each pack as soon as bup save has closed
+	// it, by a few par2 processes running next to bup save.
+	struct Par2Worker {
+		QString mPack;
+		int mPid;
+	};
+	QFileSystemWatcher *mPackWatcher;
+	QStringList mPar2Queue;
+	QSet<QString> mPar2Seen; // packs which existed before saving or have been queued
+	QHash<GroupedProcess *, Par2Worker> mPar2Workers;
+	bool mPar2Failed;
+	bool mCheckingDone;
+	bool mExclusionScanDone;
+	quint64 mRepositorySize; // size of packfiles before saving
+	quint64 mSizeBeforeBackup;
+	QStringList mChangedPaths;
+	bool mOnlyChangedPaths;
+	bool mFolderBackup;
 };
 
 #endif /*BUPJOB_H*/
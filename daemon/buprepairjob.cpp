@@ -19,8 +19,7 @@
  ***************************************************************************/
 
 #include "buprepairjob.h"
-
-#include <QTimer>
+#include "toolcapabilities.h"
 
 #include <KLocalizedString>
 
@@ -31,22 +30,21 @@ BupRepairJob::BupRepairJob(const BackupPlan &pBackupPlan, const QString &pDestin
 }
 
 void BupRepairJob::start() {
-	QTimer::singleShot(0, this, SLOT(startJob()));
+	connect(ToolCapabilities::instance(), SIGNAL(ready()), SLOT(startJob()), Qt::UniqueConnection);
+	ToolCapabilities::instance()->probe();
 }
 
 void BupRepairJob::startJob() {
-	KProcess lPar2Process;
-	lPar2Process.setOutputChannelMode(KProcess::SeparateChannels);
-	lPar2Process << QStringLiteral("bup") << QStringLiteral("fsck") << QStringLiteral("--par2-ok");
-	int lExitCode = lPar2Process.execute();
-	if(lExitCode < 0) {
+	ToolCapabilities *lTools = ToolCapabilities::instance();
+	disconnect(lTools, SIGNAL(ready()), this, SLOT(startJob()));
+	if(lTools->bupVersion().isEmpty()) {
 		setError(ErrorWithoutLog);
 		setErrorText(xi18nc("@info notification",
 		                    "The <application>bup</application> program is needed but could not be found, "
 		                    "maybe it is not installed?"));
 		emitResult();
 		return;
-	} else if(mBackupPlan.mGenerateRecoveryInfo && lExitCode != 0) {
+	} else if(mBackupPlan.mGenerateRecoveryInfo && !lTools->par2Available()) {
 		setError(ErrorWithoutLog);
 		setErrorText(xi18nc("@info notification",
 		                    "The <application>par2</application> program is needed but could not be found, "
@@ -0,0 +1,277 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "bupreplicator.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+static const int cCopyBufferSize = 1 << 20;
+
+// The order new files are copied in. An idx only shows up after its pack and the
+// files which refer to several packs come after all of those.
+static int packFileRank(const QString &pName) {
+	if(pName.startsWith(QStringLiteral("pack-"))) {
+		if(pName.endsWith(QStringLiteral(".pack"))) {
+			return 0;
+		}
+		if(pName.endsWith(QStringLiteral(".idx"))) {
+			return 1;
+		}
+		if(pName.endsWith(QStringLiteral(".par2"))) {
+			return 2;
+		}
+	} else if(pName.startsWith(QStringLiteral("midx-")) && pName.endsWith(QStringLiteral(".midx"))) {
+		return 3;
+	} else if(pName == QStringLiteral("bup.bloom")) {
+		return 4;
+	}
+	return -1; // temporary files and anything else bup might leave around
+}
+
+BupReplicator::BupReplicator(const QString &pSourcePath, const QString &pReplicaPath, QObject *pParent)
+   : QThread(pParent), mSourcePath(QDir::cleanPath(pSourcePath)), mReplicaPath(QDir::cleanPath(pReplicaPath)),
+     mSucceeded(false), mFilesCopied(0), mBytesCopied(0)
+{
+}
+
+BupReplicator::~BupReplicator() {
+	requestInterruption();
+	wait();
+}
+
+void BupReplicator::run() {
+#ifdef Q_OS_LINUX
+	// idle I/O class for this thread only, see Documentation/block/ioprio.txt
+	syscall(SYS_ioprio_set, 1, syscall(SYS_gettid), 3 << 13 | 7);
+#endif
+	// Refs are read before the packs are listed. bup writes a pack before updating
+	// any ref to point into it, so everything these refs need gets copied even if
+	// another backup adds new packs meanwhile.
+	readRef(QStringLiteral("packed-refs"));
+	readRefs(QStringLiteral("refs"));
+	if(!prepareReplica() || !replicatePacks() || !writeRefs()) {
+		return;
+	}
+	mSucceeded = true;
+}
+
+bool BupReplicator::prepareReplica() {
+	QFileInfo lReplicaInfo(mReplicaPath);
+	if(!lReplicaInfo.exists()) {
+		// Only create the last level, a missing parent folder most likely means
+		// that the drive holding the replica is not mounted.
+		QDir lParent = lReplicaInfo.dir();
+		if(!lParent.exists() || !lParent.mkdir(lReplicaInfo.fileName())) {
+			mErrorString = QStringLiteral("Replica destination %1 is not available.").arg(mReplicaPath);
+			return false;
+		}
+	} else if(lReplicaInfo.canonicalFilePath() == QFileInfo(mSourcePath).canonicalFilePath()) {
+		mErrorString = QStringLiteral("Replica destination is the same as the backup destination.");
+		return false;
+	}
+	QDir lReplica(mReplicaPath);
+	if(!lReplica.mkpath(QStringLiteral("objects/pack")) || !lReplica.mkpath(QStringLiteral("refs/heads")) ||
+	   !lReplica.mkpath(QStringLiteral("refs/tags"))) {
+		mErrorString = QStringLiteral("Could not create folders in replica destination %1.").arg(mReplicaPath);
+		return false;
+	}
+	return replicateFile(QStringLiteral("config"), true) && replicateFile(QStringLiteral("HEAD"), true);
+}
+
+bool BupReplicator::replicatePacks() {
+	const QString lPackFolder = QStringLiteral("objects/pack");
+	QStringList lSourceNames = QDir(mSourcePath + QLatin1Char('/') + lPackFolder).entryList(QDir::Files);
+	QList<QStringList> lRanks;
+	for(int i = 0; i <= 4; ++i) {
+		lRanks.append(QStringList());
+	}
+	foreach(const QString &lName, lSourceNames) {
+		int lRank = packFileRank(lName);
+		if(lRank >= 0) {
+			lRanks[lRank].append(lName);
+		}
+	}
+	for(int i = 0; i < lRanks.count(); ++i) {
+		foreach(const QString &lName, lRanks.at(i)) {
+			if(isInterruptionRequested()) {
+				mErrorString = QStringLiteral("Replication was interrupted.");
+				return false;
+			}
+			// midx and bloom files are rewritten by bup as packs are added
+			if(!replicateFile(lPackFolder + QLatin1Char('/') + lName, i <= 2)) {
+				return false;
+			}
+		}
+	}
+
+	// bup replaces old midx files when it combines indexes, drop those the primary no longer has.
+	QDir lReplicaPackDir(mReplicaPath + QLatin1Char('/') + lPackFolder);
+	foreach(const QString &lName, lReplicaPackDir.entryList(QStringList() << QStringLiteral("midx-*.midx"), QDir::Files)) {
+		if(!lRanks.at(3).contains(lName)) {
+			lReplicaPackDir.remove(lName);
+		}
+	}
+	// objects must be on disk before any ref pointing to them is.
+	return syncFolder(lPackFolder);
+}
+
+void BupReplicator::readRefs(const QString &pRelativePath) {
+	QDir lSourceDir(mSourcePath + QLatin1Char('/') + pRelativePath);
+	foreach(const QFileInfo &lInfo, lSourceDir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot)) {
+		QString lRelativePath = pRelativePath + QLatin1Char('/') + lInfo.fileName();
+		if(lInfo.isDir()) {
+			readRefs(lRelativePath);
+		} else {
+			readRef(lRelativePath);
+		}
+	}
+}
+
+void BupReplicator::readRef(const QString &pRelativePath) {
+	QFile lFile(mSourcePath + QLatin1Char('/') + pRelativePath);
+	if(lFile.open(QIODevice::ReadOnly)) {
+		mRefs.insert(pRelativePath, lFile.readAll());
+	}
+}
+
+bool BupReplicator::writeRefs() {
+	QSet<QString> lFolders;
+	QMapIterator<QString, QByteArray> i(mRefs);
+	while(i.hasNext()) {
+		i.next();
+		QFile lExisting(mReplicaPath + QLatin1Char('/') + i.key());
+		if(lExisting.open(QIODevice::ReadOnly) && lExisting.readAll() == i.value()) {
+			continue;
+		}
+		lExisting.close();
+		QString lFolder = QFileInfo(i.key()).path();
+		if(!QDir(mReplicaPath).mkpath(lFolder)) {
+			mErrorString = QStringLiteral("Could not create folder %1 in replica destination.").arg(lFolder);
+			return false;
+		}
+		QSaveFile lTarget(lExisting.fileName());
+		if(!lTarget.open(QIODevice::WriteOnly) || lTarget.write(i.value()) != i.value().size() || !lTarget.commit()) {
+			mErrorString = QStringLiteral("Could not write %1: %2").arg(lTarget.fileName(), lTarget.errorString());
+			return false;
+		}
+		++mFilesCopied;
+		mBytesCopied += i.value().size();
+		lFolders.insert(lFolder);
+	}
+	foreach(const QString &lFolder, lFolders) {
+		if(!syncFolder(lFolder)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool BupReplicator::replicateFile(const QString &pRelativePath, bool pImmutable) {
+	struct stat lSourceStat;
+	if(0 != stat(QFile::encodeName(mSourcePath + QLatin1Char('/') + pRelativePath).constData(), &lSourceStat)) {
+		return true; // optional file or removed by bup since the listing, nothing to copy.
+	}
+	struct stat lReplicaStat;
+	if(0 == stat(QFile::encodeName(mReplicaPath + QLatin1Char('/') + pRelativePath).constData(), &lReplicaStat) &&
+	   lReplicaStat.st_size == lSourceStat.st_size) {
+		// FAT filesystems only store modification times with two seconds resolution.
+		if(pImmutable || labs(lReplicaStat.st_mtime - lSourceStat.st_mtime) <= 2) {
+			return true;
+		}
+	}
+	return copyFile(pRelativePath, lSourceStat);
+}
+
+bool BupReplicator::copyFile(const QString &pRelativePath, const struct stat &pSourceStat) {
+	QFile lSource(mSourcePath + QLatin1Char('/') + pRelativePath);
+	if(!lSource.open(QIODevice::ReadOnly)) {
+		mErrorString = QStringLiteral("Could not read %1: %2").arg(lSource.fileName(), lSource.errorString());
+		return false;
+	}
+	// written to a temporary file in the same folder and renamed over the target by commit().
+	QSaveFile lTarget(mReplicaPath + QLatin1Char('/') + pRelativePath);
+	if(!lTarget.open(QIODevice::WriteOnly)) {
+		mErrorString = QStringLiteral("Could not write %1: %2").arg(lTarget.fileName(), lTarget.errorString());
+		return false;
+	}
+	QByteArray lBuffer(cCopyBufferSize, Qt::Uninitialized);
+	qint64 lRead;
+	while((lRead = lSource.read(lBuffer.data(), lBuffer.size())) > 0) {
+		if(isInterruptionRequested()) {
+			lTarget.cancelWriting();
+			mErrorString = QStringLiteral("Replication was interrupted.");
+			return false;
+		}
+		if(lTarget.write(lBuffer.constData(), lRead) != lRead) {
+			mErrorString = QStringLiteral("Could not write %1: %2").arg(lTarget.fileName(), lTarget.errorString());
+			lTarget.cancelWriting();
+			return false;
+		}
+	}
+	if(lRead < 0) {
+		mErrorString = QStringLiteral("Could not read %1: %2").arg(lSource.fileName(), lSource.errorString());
+		lTarget.cancelWriting();
+		return false;
+	}
+	// keep the modification time, it tells if a mutable file needs copying next time.
+	lTarget.flush();
+	struct timespec lTimes[2] = {pSourceStat.st_atim, pSourceStat.st_mtim};
+	futimens(lTarget.handle(), lTimes);
+	if(!lTarget.commit()) {
+		mErrorString = QStringLiteral("Could not write %1: %2").arg(lTarget.fileName(), lTarget.errorString());
+		return false;
+	}
+	++mFilesCopied;
+	mBytesCopied += pSourceStat.st_size;
+	return true;
+}
+
+bool BupReplicator::syncFolder(const QString &pRelativePath) {
+	QByteArray lPath = QFile::encodeName(mReplicaPath + QLatin1Char('/') + pRelativePath);
+	int lFd = open(lPath.constData(), O_RDONLY | O_DIRECTORY);
+	if(lFd < 0) {
+		mErrorString = QStringLiteral("Could not open %1: %2").arg(QFile::decodeName(lPath),
+		                                                            QString::fromLocal8Bit(strerror(errno)));
+		return false;
+	}
+	// some filesystems do not support syncing a folder.
+	if(0 != fsync(lFd) && errno != EINVAL) {
+		mErrorString = QStringLiteral("Could not sync %1: %2").arg(QFile::decodeName(lPath),
+		                                                            QString::fromLocal8Bit(strerror(errno)));
+		close(lFd);
+		return false;
+	}
+	close(lFd);
+	return true;
+}
@@ -0,0 +1,78 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef BUPREPLICATOR_H
+#define BUPREPLICATOR_H
+
+#include <QMap>
+#include <QStringList>
+#include <QThread>
+
+struct stat;
+
+// Brings a second bup repository up to date with the primary one, in a separate
+// thread and with idle I/O priority. Packs never change once written so only the
+// ones missing in the replica get copied, the cost follows the amount of new data.
+// Every file is written under a temporary name and renamed into place, and refs are
+// copied last, after all the objects they point to are on disk. An interrupted
+// replication leaves the replica as it was after the previous one.
+class BupReplicator : public QThread
+{
+	Q_OBJECT
+
+public:
+	BupReplicator(const QString &pSourcePath, const QString &pReplicaPath, QObject *pParent);
+	virtual ~BupReplicator();
+	// valid after the finished() signal.
+	bool succeeded() const {
+		return mSucceeded;
+	}
+	QString errorString() const {
+		return mErrorString;
+	}
+	int filesCopied() const {
+		return mFilesCopied;
+	}
+	quint64 bytesCopied() const {
+		return mBytesCopied;
+	}
+
+protected:
+	virtual void run();
+	bool prepareReplica();
+	bool replicatePacks();
+	void readRefs(const QString &pRelativePath);
+	void readRef(const QString &pRelativePath);
+	bool writeRefs();
+	bool replicateFile(const QString &pRelativePath, bool pImmutable);
+	bool copyFile(const QString &pRelativePath, const struct stat &pSourceStat);
+	bool syncFolder(const QString &pRelativePath);
+
+	QString mSourcePath;
+	QString mReplicaPath;
+	bool mSucceeded;
+	QString mErrorString;
+	int mFilesCopied;
+	quint64 mBytesCopied;
+	// path relative to the repository and content of each ref file.
+	QMap<QString, QByteArray> mRefs;
+};
+
+#endif // BUPREPLICATOR_H
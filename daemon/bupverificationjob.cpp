@@ -19,15 +19,17 @@
  ***************************************************************************/
 
 #include "bupverificationjob.h"
+#include "packverifier.h"
 
 #include <QTimer>
 
 #include <KLocalizedString>
 
 BupVerificationJob::BupVerificationJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath,
-                                       const QString &pLogFilePath)
-   : BackupJob(pBackupPlan, pDestinationPath, pLogFilePath){
-	mFsckProcess.setOutputChannelMode(KProcess::SeparateChannels);
+                                       const QString &pLogFilePath, const QString &pLedgerFilePath)
+   : BackupJob(pBackupPlan, pDestinationPath, pLogFilePath), mLedgerFilePath(pLedgerFilePath),
+     mPackVerifier(NULL), mForceFullPass(false)
+{
 }
 
 void BupVerificationJob::start() {
@@ -35,52 +37,34 @@ void BupVerificationJob::start() {
 }
 
 void BupVerificationJob::startJob() {
-	KProcess lVersionProcess;
-	lVersionProcess.setOutputChannelMode(KProcess::SeparateChannels);
-	lVersionProcess << QStringLiteral("bup") << QStringLiteral("version");
-	if(lVersionProcess.execute() < 0) {
-		setError(ErrorWithoutLog);
-		setErrorText(xi18nc("@info notification",
-		                    "The <application>bup</application> program is needed but could not be found, "
-		                    "maybe it is not installed?"));
-		emitResult();
-		return;
-	}
-
 	mLogStream << QStringLiteral("Kup is starting bup verification job at ")
 	           << QLocale().toString(QDateTime::currentDateTime())
 	           << endl << endl;
 
-	mFsckProcess << QStringLiteral("bup");
-	mFsckProcess << QStringLiteral("-d") << mDestinationPath;
-	mFsckProcess << QStringLiteral("fsck") << QStringLiteral("--quick");
-
-	connect(&mFsckProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotCheckingDone(int,QProcess::ExitStatus)));
-	connect(&mFsckProcess, SIGNAL(started()), SLOT(slotCheckingStarted()));
-	mLogStream << mFsckProcess.program().join(QStringLiteral(" ")) << endl;
-	mFsckProcess.start();
+	// Unlike the check before each backup, every object is inflated here.
+	mPackVerifier = new PackVerifier(mDestinationPath, mLedgerFilePath, this);
+	connect(mPackVerifier, SIGNAL(progress(int,int)), SLOT(slotProgress(int,int)));
+	connect(mPackVerifier, SIGNAL(finished(bool)), SLOT(slotCheckingDone(bool)));
+	mLogStream << QStringLiteral("Verifying all objects in packfiles") << endl;
+	mPackVerifier->start(PackVerifier::ObjectLevel, mForceFullPass ? 0 : mBackupPlan.mFullVerificationInterval);
 }
 
-void BupVerificationJob::slotCheckingStarted() {
-	makeNice(mFsckProcess.pid());
+void BupVerificationJob::slotProgress(int pPacksDone, int pPacksTotal) {
+	setTotalAmount(KJob::Files, pPacksTotal);
+	setProcessedAmount(KJob::Files, pPacksDone);
+	setPercent(pPacksTotal > 0 ? 100 * pPacksDone / pPacksTotal : 100);
 }
 
-void BupVerificationJob::slotCheckingDone(int pExitCode, QProcess::ExitStatus pExitStatus) {
-	mLogStream << QString::fromUtf8(mFsckProcess.readAllStandardError());
+void BupVerificationJob::slotCheckingDone(bool pSuccess) {
+	foreach(const QString &lFailure, mPackVerifier->failures()) {
+		mLogStream << lFailure << endl;
+	}
+	mLogStream << QString(QStringLiteral("%1 packfiles checked%2, %3 already verified earlier."))
+	              .arg(mPackVerifier->packsChecked())
+	              .arg(mPackVerifier->wasFullPass() ? QStringLiteral(" (complete pass)") : QString())
+	              .arg(mPackVerifier->packsSkipped()) << endl;
 	setError(ErrorWithLog);
-	if(pExitStatus != QProcess::NormalExit) {
-		mLogStream << endl << QStringLiteral("Integrity check failed (the process crashed). Your backups could be "
-		                                    "corrupted! See above for details.") << endl;
-		if(mBackupPlan.mGenerateRecoveryInfo) {
-			setErrorText(xi18nc("@info notification",
-			                    "Failed backup integrity check. Your backups could be corrupted! "
-			                    "See log file for more details. Do you want to try repairing the backup files?"));
-			setError(ErrorSuggestRepair);
-		} else {
-			setErrorText(xi18nc("@info notification", "Failed backup integrity check. Your backups are corrupted! "
-			                                          "See log file for more details."));
-		}
-	} else if(pExitCode == 0) {
+	if(pSuccess) {
 		mLogStream << endl << QStringLiteral("Backup integrity test was successful. "
 		                                     "Your backups are fine. See above for details.") << endl;
 		setErrorText(xi18nc("@info notification", "Backup integrity test was successful, "
@@ -23,23 +23,32 @@
 
 #include "backupjob.h"
 
-#include <KProcess>
+class PackVerifier;
 
 class BupVerificationJob : public BackupJob
 {
 	Q_OBJECT
 
 public:
-	BupVerificationJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath);
+	BupVerificationJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath,
+	                   const QString &pLedgerFilePath);
 	virtual void start();
+	// Checks every packfile, also those in the ledger. The ledger only notices
+	// files which were replaced, not ones that have rotted in place, so a check
+	// the user asked for should not trust it.
+	void setForceFullPass() {
+		mForceFullPass = true;
+	}
 
 protected slots:
 	void startJob();
-	void slotCheckingStarted();
-	void slotCheckingDone(int pExitCode, QProcess::ExitStatus pExitStatus);
+	void slotProgress(int pPacksDone, int pPacksTotal);
+	void slotCheckingDone(bool pSuccess);
 
 protected:
-	KProcess mFsckProcess;
+	QString mLedgerFilePath;
+	PackVerifier *mPackVerifier;
+	bool mForceFullPass;
 
 };
 
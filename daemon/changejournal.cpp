@@ -0,0 +1,541 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "changejournal.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <QTextStream>
+#include <QTimer>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// More changes than this and a full index is probably just as fast. Keeps the
+// "bup index" command line at a sane length too.
+static const int cMaxChangedPaths = 10000;
+
+static const uint32_t cInotifyMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM |
+                                     IN_MOVED_TO | IN_DONT_FOLLOW | IN_ONLYDIR;
+#ifdef FAN_REPORT_DFID_NAME
+static const uint64_t cFanotifyMask = FAN_CREATE | FAN_DELETE | FAN_MODIFY | FAN_ATTRIB | FAN_MOVED_FROM |
+                                      FAN_MOVED_TO | FAN_ONDIR;
+#endif
+
+static bool isUnder(const QString &pPath, const QString &pFolder) {
+	if(!pPath.startsWith(pFolder)) {
+		return false;
+	}
+	return pPath.length() == pFolder.length() || pFolder.endsWith(QLatin1Char('/')) ||
+	      pPath.at(pFolder.length()) == QLatin1Char('/');
+}
+
+static QString childPath(const QString &pFolder, const QString &pName) {
+	if(pFolder.endsWith(QLatin1Char('/'))) {
+		return pFolder + pName;
+	}
+	return pFolder + QLatin1Char('/') + pName;
+}
+
+void InotifyWatchSetup::run() {
+	InotifyWatcher::QueuedFolder lFolder;
+	while(!isInterruptionRequested() && mWatcher->takeQueuedFolder(lFolder)) {
+		bool lOk;
+		if(lFolder.mRecursive) {
+			lOk = mWatcher->addInotifyWatches(lFolder.mPath);
+		} else {
+			// parent of a single included file, its other subfolders are not needed.
+			lOk = mWatcher->addFolderWatch(lFolder.mPath) >= 0 || errno != ENOSPC;
+		}
+		if(lFolder.mRoot) {
+			mWatcher->mPendingRoots.deref();
+		}
+		if(!lOk) {
+			QMetaObject::invokeMethod(mWatcher, "dropWatches", Qt::QueuedConnection);
+			return;
+		}
+	}
+}
+
+InotifyWatcher *InotifyWatcher::mInstance = NULL;
+
+InotifyWatcher::InotifyWatcher()
+   : mNotifier(NULL), mSetupRunning(false), mPendingRoots(0)
+{
+	mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(mFd >= 0) {
+		mNotifier = new QSocketNotifier(mFd, QSocketNotifier::Read, this);
+		connect(mNotifier, SIGNAL(activated(int)), SLOT(readEvents()));
+	}
+	mWatchSetup = new InotifyWatchSetup(this);
+}
+
+InotifyWatcher::~InotifyWatcher() {
+	mWatchSetup->requestInterruption();
+	mWatchSetup->wait();
+	delete mWatchSetup;
+	if(mFd >= 0) {
+		close(mFd);
+	}
+}
+
+InotifyWatcher *InotifyWatcher::subscribe(ChangeJournal *pJournal) {
+	if(mInstance == NULL) {
+		mInstance = new InotifyWatcher();
+		if(mInstance->mFd < 0) {
+			delete mInstance;
+			mInstance = NULL;
+			return NULL;
+		}
+	}
+	{
+		QMutexLocker lLocker(&mInstance->mMutex);
+		mInstance->mJournals.append(pJournal);
+	}
+	foreach(const QString &lPath, pJournal->mIncludedPaths) {
+		QFileInfo lInfo(lPath);
+		if(lInfo.isDir()) {
+			mInstance->queueFolder(QFile::encodeName(lPath), true, true);
+		} else {
+			mInstance->queueFolder(QFile::encodeName(lInfo.absolutePath()), false, true);
+		}
+	}
+	return mInstance;
+}
+
+// Watches stay until the last journal is gone, the daemon drops all journals
+// at once when reloading its configuration anyway.
+void InotifyWatcher::unsubscribe(ChangeJournal *pJournal) {
+	if(mInstance == NULL) {
+		return;
+	}
+	// don't lose what is still queued up for this journal.
+	mInstance->readEvents();
+	bool lLast;
+	{
+		QMutexLocker lLocker(&mInstance->mMutex);
+		mInstance->mJournals.removeAll(pJournal);
+		lLast = mInstance->mJournals.isEmpty();
+	}
+	if(lLast) {
+		delete mInstance;
+		mInstance = NULL;
+	}
+}
+
+void InotifyWatcher::queueFolder(const QByteArray &pPath, bool pRecursive, bool pRoot) {
+	QMutexLocker lLocker(&mMutex);
+	if(mFd < 0) {
+		return;
+	}
+	QueuedFolder lFolder;
+	lFolder.mPath = pPath;
+	lFolder.mRecursive = pRecursive;
+	lFolder.mRoot = pRoot;
+	mQueue.append(lFolder);
+	if(pRoot) {
+		mPendingRoots.ref();
+	}
+	if(!mSetupRunning) {
+		mSetupRunning = true;
+		// the thread may still be on its way out after finding the queue empty, it
+		// does not take the mutex again then.
+		mWatchSetup->wait();
+		mWatchSetup->start(QThread::LowestPriority);
+	}
+}
+
+bool InotifyWatcher::takeQueuedFolder(QueuedFolder &pFolder) {
+	QMutexLocker lLocker(&mMutex);
+	if(mQueue.isEmpty()) {
+		mSetupRunning = false;
+		return false;
+	}
+	pFolder = mQueue.takeFirst();
+	return true;
+}
+
+bool InotifyWatcher::isIncluded(const QString &pPath) {
+	QMutexLocker lLocker(&mMutex);
+	foreach(ChangeJournal *lJournal, mJournals) {
+		if(lJournal->isIncluded(pPath)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int InotifyWatcher::addFolderWatch(const QByteArray &pPath) {
+	int lWatch = inotify_add_watch(mFd, pPath.constData(), cInotifyMask);
+	if(lWatch >= 0) {
+		QMutexLocker lLocker(&mMutex);
+		mWatchedFolders.insert(lWatch, QFile::decodeName(pPath));
+	}
+	return lWatch;
+}
+
+// Runs in the setup thread. Returns false when out of inotify watches.
+bool InotifyWatcher::addInotifyWatches(const QByteArray &pPath) {
+	QList<QByteArray> lFolders;
+	lFolders.append(pPath);
+	while(!lFolders.isEmpty()) {
+		if(QThread::currentThread()->isInterruptionRequested()) {
+			return true;
+		}
+		QByteArray lFolder = lFolders.takeLast();
+		if(!isIncluded(QFile::decodeName(lFolder))) {
+			continue;
+		}
+		if(addFolderWatch(lFolder) < 0) {
+			if(errno == ENOSPC) {
+				return false;
+			}
+			continue;
+		}
+		DIR *lDir = opendir(lFolder.constData());
+		if(lDir == NULL) {
+			continue;
+		}
+		struct dirent *lEntry;
+		while((lEntry = readdir(lDir)) != NULL) {
+			if(0 == strcmp(lEntry->d_name, ".") || 0 == strcmp(lEntry->d_name, "..")) {
+				continue;
+			}
+			bool lIsDir = lEntry->d_type == DT_DIR;
+			if(lEntry->d_type == DT_UNKNOWN) {
+				struct stat lStat;
+				lIsDir = 0 == fstatat(dirfd(lDir), lEntry->d_name, &lStat, AT_SYMLINK_NOFOLLOW) &&
+				         S_ISDIR(lStat.st_mode);
+			}
+			if(lIsDir) {
+				lFolders.append(lFolder.endsWith('/') ? lFolder + lEntry->d_name : lFolder + '/' + lEntry->d_name);
+			}
+		}
+		closedir(lDir);
+	}
+	return true;
+}
+
+// Out of inotify watches. A partial set would use up the user's whole budget and
+// still miss changes, closing the inotify instance releases all of them at once.
+void InotifyWatcher::dropWatches() {
+	qWarning("Out of inotify watches, changed files will be found by full indexing instead.");
+	mWatchSetup->requestInterruption();
+	mWatchSetup->wait();
+	delete mNotifier;
+	mNotifier = NULL;
+	QList<ChangeJournal *> lJournals;
+	{
+		QMutexLocker lLocker(&mMutex);
+		close(mFd);
+		mFd = -1;
+		mWatchedFolders.clear();
+		mQueue.clear();
+		lJournals = mJournals;
+	}
+	foreach(ChangeJournal *lJournal, lJournals) {
+		lJournal->markIncomplete();
+	}
+}
+
+void InotifyWatcher::readEvents() {
+	if(mFd < 0) {
+		return;
+	}
+	char lBuffer[64 * 1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	forever {
+		ssize_t lLength = read(mFd, lBuffer, sizeof(lBuffer));
+		if(lLength <= 0) {
+			break;
+		}
+		char *lPosition = lBuffer;
+		while(lPosition < lBuffer + lLength) {
+			struct inotify_event *lEvent = (struct inotify_event *)lPosition;
+			lPosition += sizeof(struct inotify_event) + lEvent->len;
+			if(lEvent->mask & IN_Q_OVERFLOW) {
+				foreach(ChangeJournal *lJournal, mJournals) {
+					lJournal->markIncomplete();
+				}
+				continue;
+			}
+			QString lFolder;
+			{
+				QMutexLocker lLocker(&mMutex);
+				if(lEvent->mask & IN_IGNORED) {
+					mWatchedFolders.remove(lEvent->wd);
+					continue;
+				}
+				lFolder = mWatchedFolders.value(lEvent->wd);
+			}
+			if(lFolder.isEmpty()) {
+				continue;
+			}
+			QString lPath = lFolder;
+			// bup index needs to look at the folder to notice that something is gone.
+			if(lEvent->len > 0 && !(lEvent->mask & (IN_DELETE | IN_MOVED_FROM))) {
+				lPath = childPath(lFolder, QFile::decodeName(lEvent->name));
+			}
+			foreach(ChangeJournal *lJournal, mJournals) {
+				lJournal->markChanged(lPath);
+			}
+			if(lPath != lFolder && (lEvent->mask & IN_ISDIR) && (lEvent->mask & (IN_CREATE | IN_MOVED_TO))) {
+				// the folder itself is marked as changed, so nothing is missed while it is walked.
+				queueFolder(QFile::encodeName(lPath), true, false);
+			}
+		}
+	}
+}
+
+ChangeJournal::ChangeJournal(const QStringList &pIncludedPaths, const QStringList &pExcludedPaths,
+                             const QString &pJournalFilePath, QObject *pParent)
+   : QObject(pParent), mIncludedPaths(pIncludedPaths), mExcludedPaths(pExcludedPaths),
+     mJournalFilePath(pJournalFilePath), mFanotifyFd(-1), mNotifier(NULL), mInotifyWatcher(NULL),
+     mComplete(false)
+{
+	mSaveTimer = new QTimer(this);
+	mSaveTimer->setSingleShot(true);
+	mSaveTimer->setInterval(10000);
+	connect(mSaveTimer, SIGNAL(timeout()), SLOT(save()));
+
+	if(!startFanotify()) {
+		mInotifyWatcher = InotifyWatcher::subscribe(this);
+	}
+	load();
+}
+
+ChangeJournal::~ChangeJournal() {
+	// don't lose what is still queued up, the journal could be picked up again
+	// by a new instance after the daemon has reloaded its configuration.
+	if(mFanotifyFd >= 0) {
+		readFanotifyEvents();
+		close(mFanotifyFd);
+	}
+	if(mInotifyWatcher != NULL) {
+		InotifyWatcher::unsubscribe(this);
+	}
+	foreach(int lMountFd, mMountFds) {
+		close(lMountFd);
+	}
+	save();
+}
+
+bool ChangeJournal::takeChangedPaths(QStringList &pPaths) {
+	bool lWasComplete = mComplete && (mInotifyWatcher == NULL || !mInotifyWatcher->hasFailed());
+	pPaths.clear();
+	// folders cover everything below them, no need to list their contents too.
+	foreach(const QString &lPath, mChangedPaths) {
+		bool lCovered = false;
+		for(int i = lPath.lastIndexOf(QLatin1Char('/')); i > 0 && !lCovered; i = lPath.lastIndexOf(QLatin1Char('/'), i - 1)) {
+			lCovered = mChangedPaths.contains(lPath.left(i));
+		}
+		if(!lCovered) {
+			pPaths.append(lPath);
+		}
+	}
+	pPaths.sort();
+	mChangedPaths.clear();
+	// From now on the journal is complete if all folders are being watched.
+	mComplete = mNotifier != NULL || (mInotifyWatcher != NULL && mInotifyWatcher->isReady());
+	save();
+	return lWasComplete;
+}
+
+void ChangeJournal::restoreChangedPaths(const QStringList &pPaths, bool pWasComplete) {
+	if(!pWasComplete) {
+		markIncomplete();
+		return;
+	}
+	foreach(const QString &lPath, pPaths) {
+		markChanged(lPath);
+	}
+}
+
+bool ChangeJournal::startFanotify() {
+#ifdef FAN_REPORT_DFID_NAME
+	// Needs CAP_SYS_ADMIN for watching whole filesystems, will fail for most users.
+	mFanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC,
+	                            O_RDONLY | O_LARGEFILE);
+	if(mFanotifyFd < 0) {
+		return false;
+	}
+	foreach(const QString &lPath, mIncludedPaths) {
+		QByteArray lEncodedPath = QFile::encodeName(lPath);
+		int lMountFd = open(lEncodedPath.constData(), O_RDONLY | O_CLOEXEC);
+		if(lMountFd < 0 || 0 != fanotify_mark(mFanotifyFd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, cFanotifyMask,
+		                                       AT_FDCWD, lEncodedPath.constData())) {
+			if(lMountFd >= 0) {
+				close(lMountFd);
+			}
+			foreach(int lOpenedFd, mMountFds) {
+				close(lOpenedFd);
+			}
+			mMountFds.clear();
+			close(mFanotifyFd);
+			mFanotifyFd = -1;
+			return false;
+		}
+		mMountFds.append(lMountFd);
+	}
+	mNotifier = new QSocketNotifier(mFanotifyFd, QSocketNotifier::Read, this);
+	connect(mNotifier, SIGNAL(activated(int)), SLOT(readFanotifyEvents()));
+	return true;
+#else
+	return false;
+#endif
+}
+
+void ChangeJournal::readFanotifyEvents() {
+#ifdef FAN_REPORT_DFID_NAME
+	char lBuffer[64 * 1024] __attribute__ ((aligned(__alignof__(struct fanotify_event_metadata))));
+	forever {
+		ssize_t lLength = read(mFanotifyFd, lBuffer, sizeof(lBuffer));
+		if(lLength <= 0) {
+			break;
+		}
+		struct fanotify_event_metadata *lEvent = (struct fanotify_event_metadata *)lBuffer;
+		for(; FAN_EVENT_OK(lEvent, lLength); lEvent = FAN_EVENT_NEXT(lEvent, lLength)) {
+			if(lEvent->mask & FAN_Q_OVERFLOW) {
+				markIncomplete();
+				continue;
+			}
+			struct fanotify_event_info_fid *lInfo = (struct fanotify_event_info_fid *)(lEvent + 1);
+			if(lInfo->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+				continue;
+			}
+			struct file_handle *lHandle = (struct file_handle *)lInfo->handle;
+			QString lName = QFile::decodeName((const char *)(lHandle->f_handle + lHandle->handle_bytes));
+			// the event only has a handle of the folder, find out its path.
+			QString lFolder;
+			foreach(int lMountFd, mMountFds) {
+				int lFolderFd = open_by_handle_at(lMountFd, lHandle, O_PATH);
+				if(lFolderFd < 0) {
+					continue;
+				}
+				char lTarget[PATH_MAX];
+				QByteArray lProcPath = "/proc/self/fd/" + QByteArray::number(lFolderFd);
+				ssize_t lTargetLength = readlink(lProcPath.constData(), lTarget, sizeof(lTarget));
+				close(lFolderFd);
+				if(lTargetLength > 0) {
+					lFolder = QFile::decodeName(QByteArray(lTarget, lTargetLength));
+					break;
+				}
+			}
+			if(lFolder.isEmpty()) {
+				// can't tell what changed, better to look at everything next time.
+				markIncomplete();
+			} else if(lName == QStringLiteral(".") || (lEvent->mask & (FAN_DELETE | FAN_MOVED_FROM))) {
+				markChanged(lFolder);
+			} else {
+				markChanged(childPath(lFolder, lName));
+			}
+		}
+	}
+#endif
+}
+
+void ChangeJournal::markChanged(const QString &pPath) {
+	if(!mComplete || !isIncluded(pPath)) {
+		return; // a full index will be done anyway
+	}
+	mChangedPaths.insert(pPath);
+	if(mChangedPaths.count() > cMaxChangedPaths) {
+		markIncomplete();
+		return;
+	}
+	if(!mSaveTimer->isActive()) {
+		mSaveTimer->start();
+	}
+}
+
+void ChangeJournal::markIncomplete() {
+	mComplete = false;
+	mChangedPaths.clear();
+	if(!mSaveTimer->isActive()) {
+		mSaveTimer->start();
+	}
+}
+
+bool ChangeJournal::isIncluded(const QString &pPath) const {
+	foreach(const QString &lExcluded, mExcludedPaths) {
+		if(isUnder(pPath, lExcluded)) {
+			return false;
+		}
+	}
+	foreach(const QString &lIncluded, mIncludedPaths) {
+		if(isUnder(pPath, lIncluded)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// File format: first line is the process id of the daemon which wrote the
+// journal and whether it was complete, then one changed path per line.
+void ChangeJournal::save() {
+	mSaveTimer->stop();
+	QSaveFile lFile(mJournalFilePath);
+	if(!lFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		return;
+	}
+	QTextStream lStream(&lFile);
+	lStream.setCodec("UTF-8");
+	lStream << QCoreApplication::applicationPid() << ' ' << (mComplete ? 1 : 0) << '\n';
+	foreach(const QString &lPath, mChangedPaths) {
+		lStream << lPath << '\n';
+	}
+	lStream.flush();
+	lFile.commit();
+}
+
+void ChangeJournal::load() {
+	QFile lFile(mJournalFilePath);
+	if(!lFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		return;
+	}
+	QTextStream lStream(&lFile);
+	lStream.setCodec("UTF-8");
+	qint64 lPid = 0;
+	int lComplete = 0;
+	lStream >> lPid >> lComplete;
+	lStream.readLine();
+	// Journal written by this same process before it reloaded its configuration.
+	// Only fanotify starts watching instantly, with inotify some changes could
+	// have been missed while setting up watches again.
+	if(lPid != QCoreApplication::applicationPid() || lComplete == 0 || mFanotifyFd < 0) {
+		return; // remains incomplete
+	}
+	mComplete = true;
+	while(!lStream.atEnd()) {
+		QString lPath = lStream.readLine();
+		if(!lPath.isEmpty()) {
+			markChanged(lPath);
+		}
+	}
+}
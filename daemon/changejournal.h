@@ -0,0 +1,149 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef CHANGEJOURNAL_H
+#define CHANGEJOURNAL_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QThread>
+
+class ChangeJournal;
+class InotifyWatcher;
+
+class QSocketNotifier;
+class QTimer;
+
+// Adding inotify watches to every folder of a big home directory takes a
+// while, do it in a separate thread. Also walks folders created later on.
+class InotifyWatchSetup: public QThread {
+	Q_OBJECT
+
+public:
+	explicit InotifyWatchSetup(InotifyWatcher *pWatcher)
+	   : mWatcher(pWatcher) {}
+
+protected:
+	virtual void run();
+	InotifyWatcher *mWatcher;
+};
+
+// One set of inotify watches shared by the journals of all plans, so that a
+// folder included in several plans only uses up one of the user's limited
+// number of watches. Events are handed to every journal, each of them filters
+// out what is not in its plan. If the watch limit is reached, all watches are
+// dropped again instead of keeping an incomplete set which would leave no
+// watches for other applications. The journals then fall back to full indexing.
+class InotifyWatcher : public QObject
+{
+	Q_OBJECT
+
+public:
+	// Returns NULL if inotify is not available.
+	static InotifyWatcher *subscribe(ChangeJournal *pJournal);
+	static void unsubscribe(ChangeJournal *pJournal);
+	// All included folders of the subscribed journals are being watched.
+	bool isReady() const {
+		return mFd >= 0 && mPendingRoots.load() == 0;
+	}
+	bool hasFailed() const {
+		return mFd < 0;
+	}
+
+public slots:
+	void readEvents();
+
+protected slots:
+	void dropWatches();
+
+protected:
+	friend class InotifyWatchSetup;
+	struct QueuedFolder {
+		QByteArray mPath;
+		bool mRecursive; // only the folder itself otherwise
+		bool mRoot; // an included path of a journal, not a folder created later
+	};
+	InotifyWatcher();
+	virtual ~InotifyWatcher();
+	void queueFolder(const QByteArray &pPath, bool pRecursive, bool pRoot);
+	bool takeQueuedFolder(QueuedFolder &pFolder);
+	bool isIncluded(const QString &pPath);
+	int addFolderWatch(const QByteArray &pPath);
+	bool addInotifyWatches(const QByteArray &pPath);
+
+	static InotifyWatcher *mInstance;
+	int mFd;
+	QSocketNotifier *mNotifier;
+	InotifyWatchSetup *mWatchSetup;
+	QMutex mMutex; // for the members below, used by the setup thread too
+	QList<ChangeJournal *> mJournals;
+	QHash<int, QString> mWatchedFolders; // inotify watch descriptor -> path
+	QList<QueuedFolder> mQueue;
+	bool mSetupRunning;
+	QAtomicInt mPendingRoots;
+};
+
+// Keeps track of which files and folders in a backup plan have changed since
+// the last backup was started, so that "bup index" only needs to look at those.
+// Uses fanotify to watch whole filesystems where the daemon is allowed to,
+// otherwise falls back to inotify watches on every folder, shared between plans.
+class ChangeJournal : public QObject
+{
+	Q_OBJECT
+
+public:
+	ChangeJournal(const QStringList &pIncludedPaths, const QStringList &pExcludedPaths,
+	              const QString &pJournalFilePath, QObject *pParent = 0);
+	virtual ~ChangeJournal();
+	// Hands over the changed paths and starts a new journal. Returns false if
+	// changes could have been missed, a full index is needed then.
+	bool takeChangedPaths(QStringList &pPaths);
+	// Puts back what was taken by takeChangedPaths(), for when the backup failed.
+	void restoreChangedPaths(const QStringList &pPaths, bool pWasComplete);
+
+protected slots:
+	void readFanotifyEvents();
+	void save();
+
+protected:
+	friend class InotifyWatcher;
+	bool startFanotify();
+	void markChanged(const QString &pPath);
+	void markIncomplete();
+	bool isIncluded(const QString &pPath) const;
+	void load();
+
+	QStringList mIncludedPaths;
+	QStringList mExcludedPaths;
+	QString mJournalFilePath;
+	int mFanotifyFd;
+	QList<int> mMountFds; // for resolving the file handles in fanotify events
+	QSocketNotifier *mNotifier;
+	InotifyWatcher *mInotifyWatcher;
+	QSet<QString> mChangedPaths;
+	bool mComplete;
+	QTimer *mSaveTimer;
+};
+
+#endif // CHANGEJOURNAL_H
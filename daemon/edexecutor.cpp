@@ -27,8 +27,6 @@
 #include <QMenu>
 #include <QTimer>
 
-#include <KDiskFreeSpaceInfo>
-#include <KIO/DirectorySizeJob>
 #include <KLocalizedString>
 #include <KNotification>
 
@@ -79,6 +77,8 @@ void EDExecutor::deviceAdded(const QString &pUdi) {
 
 void EDExecutor::deviceRemoved(const QString &pUdi) {
 	if(mCurrentUdi == pUdi) {
+		// the next backup continues from what bup had finished writing, see BupJob::doKill().
+		stopRunningBackup();
 		mWantsToRunBackup = false;
 		mCurrentUdi.clear();
 		mStorageAccess = NULL;
@@ -134,36 +134,6 @@ void EDExecutor::startBackup() {
 	}
 }
 
-void EDExecutor::slotBackupDone(KJob *pJob) {
-	if(pJob->error()) {
-		notifyBackupFailed(pJob);
-		exitBackupRunningState(false);
-	} else {
-		mPlan->mLastCompleteBackup = QDateTime::currentDateTime().toUTC();
-		KDiskFreeSpaceInfo lSpaceInfo = KDiskFreeSpaceInfo::freeSpaceInfo(mDestinationPath);
-		if(lSpaceInfo.isValid())
-			mPlan->mLastAvailableSpace = (double)lSpaceInfo.available();
-		else
-			mPlan->mLastAvailableSpace = -1.0; //unknown size
-
-		KIO::DirectorySizeJob *lSizeJob = KIO::directorySize(QUrl::fromLocalFile(mDestinationPath));
-		connect(lSizeJob, SIGNAL(result(KJob*)), SLOT(slotBackupSizeDone(KJob*)));
-		lSizeJob->start();
-	}
-}
-
-void EDExecutor::slotBackupSizeDone(KJob *pJob) {
-	if(pJob->error()) {
-		KNotification::event(KNotification::Error, xi18nc("@title:window", "Problem"), pJob->errorText());
-		mPlan->mLastBackupSize = -1.0; //unknown size
-	} else {
-		KIO::DirectorySizeJob *lSizeJob = qobject_cast<KIO::DirectorySizeJob *>(pJob);
-		mPlan->mLastBackupSize = (double)lSizeJob->totalSize();
-	}
-	mPlan->save();
-	exitBackupRunningState(pJob->error() == 0);
-}
-
 void EDExecutor::showFilesClicked() {
 	if(!mStorageAccess)
 		return;
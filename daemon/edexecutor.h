@@ -48,8 +48,6 @@ protected slots:
 	void deviceRemoved(const QString &pUdi);
 	void updateAccessibility();
 	virtual void startBackup();
-	void slotBackupDone(KJob *pJob);
-	void slotBackupSizeDone(KJob *pJob);
 
 protected:
 	Solid::StorageAccess *mStorageAccess;
@@ -0,0 +1,487 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "exclusionengine.h"
+#include "backupplan.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include <KFormat>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+const qint64 cFullScanInterval = 7LL * 24 * 3600 * 1000;
+const char cCacheDirSignature[] = "Signature: 8a477f597d28d172789f06886806bc55";
+// churn is a moving average, each backup has this much weight
+const double cChurnWeight = 0.2;
+const double cMinChurn = 0.6;
+const int cMinRuns = 5;
+const int cMaxChurnEntries = 5000;
+const int cMaxSuggestions = 10;
+const quint64 cMinSuggestionSize = 100 * 1024 * 1024;
+
+bool isBelow(const QString &pPath, const QString &pFolder) {
+	return pPath.startsWith(pFolder) && pPath.length() > pFolder.length() && pPath.at(pFolder.length()) == QLatin1Char('/');
+}
+
+}
+
+void ExclusionState::load(const QString &pFilePath) {
+	QFile lFile(pFilePath);
+	if(pFilePath.isEmpty() || !lFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		return;
+	}
+	QTextStream lStream(&lFile);
+	lStream.setCodec("UTF-8");
+	while(!lStream.atEnd()) {
+		QStringList lFields = lStream.readLine().split(QLatin1Char('\t'));
+		if(lFields.count() == 2 && lFields.at(0) == QStringLiteral("fullscan")) {
+			mLastFullScan = lFields.at(1).toLongLong();
+		} else if(lFields.count() == 2 && lFields.at(0) == QStringLiteral("patternbytes")) {
+			mPatternBytes = lFields.at(1).toULongLong();
+		} else if(lFields.count() == 2 && lFields.at(0) == QStringLiteral("runs")) {
+			mRuns = lFields.at(1).toInt();
+		} else if(lFields.count() == 3 && lFields.at(0) == QStringLiteral("cache")) {
+			mCacheFolders.insert(lFields.at(2), lFields.at(1).toULongLong());
+		} else if(lFields.count() == 3 && lFields.at(0) == QStringLiteral("churn")) {
+			mChurn.insert(lFields.at(2), lFields.at(1).toDouble());
+		} else if(lFields.count() == 3 && lFields.at(0) == QStringLiteral("suggest")) {
+			mSuggestions.append(qMakePair(lFields.at(2), lFields.at(1).toULongLong()));
+		}
+	}
+}
+
+void ExclusionState::save(const QString &pFilePath) {
+	if(pFilePath.isEmpty()) {
+		return;
+	}
+	QSaveFile lFile(pFilePath);
+	if(!lFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		return;
+	}
+	QTextStream lStream(&lFile);
+	lStream.setCodec("UTF-8");
+	lStream << QStringLiteral("fullscan\t") << mLastFullScan << endl;
+	lStream << QStringLiteral("patternbytes\t") << mPatternBytes << endl;
+	lStream << QStringLiteral("runs\t") << mRuns << endl;
+	QMapIterator<QString, quint64> i(mCacheFolders);
+	while(i.hasNext()) {
+		i.next();
+		lStream << QStringLiteral("cache\t") << i.value() << QLatin1Char('\t') << i.key() << endl;
+	}
+	QHashIterator<QString, double> j(mChurn);
+	while(j.hasNext()) {
+		j.next();
+		lStream << QStringLiteral("churn\t") << j.value() << QLatin1Char('\t') << j.key() << endl;
+	}
+	for(int k = 0; k < mSuggestions.count(); ++k) {
+		lStream << QStringLiteral("suggest\t") << mSuggestions.at(k).second << QLatin1Char('\t')
+		        << mSuggestions.at(k).first << endl;
+	}
+	lStream.flush();
+	lFile.commit();
+}
+
+ExclusionEngine::ExclusionEngine(const BackupPlan &pPlan, const QString &pStateFilePath, QObject *pParent)
+   : QThread(pParent), mStateFilePath(pStateFilePath), mExcludeCacheFolders(pPlan.mExcludeCacheFolders),
+     mPatterns(pPlan.mExcludePatterns), mHaveChangedPaths(false)
+{
+	foreach(const QString &lPath, pPlan.mPathsIncluded) {
+		mPathsIncluded.append(QFile::encodeName(lPath));
+	}
+	foreach(const QString &lPath, pPlan.mPathsExcluded) {
+		mPathsExcluded.insert(QFile::encodeName(lPath));
+	}
+	foreach(const QString &lPattern, mPatterns) {
+		QRegularExpression lRegExp(lPattern.startsWith(QStringLiteral("re:")) ? lPattern.mid(3)
+		                                                                      : globToRegExp(lPattern));
+		if(lRegExp.isValid()) {
+			mRegExps.append(lRegExp);
+		} else {
+			mInvalidPatterns.append(lPattern);
+		}
+	}
+}
+
+ExclusionEngine::~ExclusionEngine() {
+	requestInterruption();
+	wait();
+}
+
+void ExclusionEngine::setChangedPaths(const QStringList &pPaths) {
+	mChangedPaths = pPaths;
+	mHaveChangedPaths = true;
+}
+
+QStringList ExclusionEngine::bupArguments() const {
+	QStringList lArguments;
+	foreach(const QString &lFolder, mState.mCacheFolders.keys()) {
+		lArguments << QStringLiteral("--exclude") << lFolder;
+	}
+	foreach(const QString &lPattern, mPatterns) {
+		// bup index refuses to run at all when given a broken expression
+		if(mInvalidPatterns.contains(lPattern)) {
+			continue;
+		}
+		lArguments << QStringLiteral("--exclude-rx");
+		lArguments << (lPattern.startsWith(QStringLiteral("re:")) ? lPattern.mid(3) : globToRegExp(lPattern));
+	}
+	return lArguments;
+}
+
+// rsync has no regular expressions, those patterns are left out.
+QStringList ExclusionEngine::rsyncArguments() const {
+	QStringList lArguments;
+	foreach(const QString &lFolder, mState.mCacheFolders.keys()) {
+		lArguments << QString(QStringLiteral("--exclude=%1/")).arg(lFolder);
+	}
+	foreach(const QString &lPattern, mPatterns) {
+		if(!lPattern.startsWith(QStringLiteral("re:"))) {
+			lArguments << QString(QStringLiteral("--exclude=%1")).arg(lPattern);
+		}
+	}
+	return lArguments;
+}
+
+quint64 ExclusionEngine::excludedBytes() const {
+	quint64 lTotal = mState.mPatternBytes;
+	foreach(quint64 lSize, mState.mCacheFolders) {
+		lTotal += lSize;
+	}
+	return lTotal;
+}
+
+QStringList ExclusionEngine::suggestions() const {
+	QStringList lLines;
+	KFormat lFormat;
+	for(int i = 0; i < mState.mSuggestions.count(); ++i) {
+		lLines << QString(QStringLiteral("%1 (%2)")).arg(mState.mSuggestions.at(i).first,
+		                                                 lFormat.formatByteSize(mState.mSuggestions.at(i).second));
+	}
+	return lLines;
+}
+
+// Like rsync, a pattern without a slash matches a name anywhere in the path, a
+// leading slash anchors it at the root and a trailing one only matches folders.
+// "*" and "?" do not match slashes, "**" does. bup adds a slash to folder names.
+QString ExclusionEngine::globToRegExp(const QString &pGlob) {
+	QString lGlob = pGlob;
+	bool lFoldersOnly = lGlob.endsWith(QLatin1Char('/'));
+	if(lFoldersOnly) {
+		lGlob.chop(1);
+	}
+	QString lResult = lGlob.startsWith(QLatin1Char('/')) ? QStringLiteral("^") : QStringLiteral("(^|/)");
+	for(int i = 0; i < lGlob.length(); ++i) {
+		QChar c = lGlob.at(i);
+		if(c == QLatin1Char('*')) {
+			if(i + 1 < lGlob.length() && lGlob.at(i + 1) == QLatin1Char('*')) {
+				lResult.append(QStringLiteral(".*"));
+				++i;
+			} else {
+				lResult.append(QStringLiteral("[^/]*"));
+			}
+		} else if(c == QLatin1Char('?')) {
+			lResult.append(QStringLiteral("[^/]"));
+		} else if(c == QLatin1Char('[')) {
+			int lEnd = lGlob.indexOf(QLatin1Char(']'), i + 2);
+			if(lEnd < 0) {
+				lResult.append(QStringLiteral("\\["));
+				continue;
+			}
+			QString lClass = lGlob.mid(i + 1, lEnd - i - 1);
+			if(lClass.startsWith(QLatin1Char('!'))) {
+				lClass[0] = QLatin1Char('^');
+			}
+			lResult.append(QLatin1Char('[') + lClass.replace(QLatin1Char('\\'), QStringLiteral("\\\\")) + QLatin1Char(']'));
+			i = lEnd;
+		} else {
+			lResult.append(QRegularExpression::escape(c));
+		}
+	}
+	lResult.append(lFoldersOnly ? QStringLiteral("/") : QStringLiteral("(/|$)"));
+	return lResult;
+}
+
+void ExclusionEngine::run() {
+#ifdef Q_OS_LINUX
+	// idle I/O class for this thread only, see Documentation/block/ioprio.txt
+	syscall(SYS_ioprio_set, 1, syscall(SYS_gettid), 3 << 13 | 7);
+#endif
+	mState.load(mStateFilePath);
+	qint64 lNow = QDateTime::currentMSecsSinceEpoch();
+	if(mState.mLastFullScan == 0 || lNow - mState.mLastFullScan > cFullScanInterval) {
+		fullScan();
+		if(isInterruptionRequested()) {
+			return;
+		}
+		mState.mLastFullScan = lNow;
+	} else {
+		incrementalScan();
+	}
+	findSuggestions();
+	if(!isInterruptionRequested()) {
+		mState.save(mStateFilePath);
+	}
+}
+
+void ExclusionEngine::fullScan() {
+	mState.mCacheFolders.clear();
+	mState.mPatternBytes = 0;
+	QList<QByteArray> lFolders = mPathsIncluded;
+	while(!lFolders.isEmpty()) {
+		if(isInterruptionRequested()) {
+			return;
+		}
+		QByteArray lFolder = lFolders.takeLast();
+		if(mExcludeCacheFolders && isCacheFolder(lFolder)) {
+			mState.mCacheFolders.insert(QFile::decodeName(lFolder), folderSize(lFolder));
+			continue;
+		}
+		DIR *lDir = opendir(lFolder.constData());
+		if(lDir == NULL) {
+			continue;
+		}
+		struct dirent *lEntry;
+		while((lEntry = readdir(lDir)) != NULL) {
+			if(0 == strcmp(lEntry->d_name, ".") || 0 == strcmp(lEntry->d_name, "..")) {
+				continue;
+			}
+			QByteArray lPath = lFolder + '/' + lEntry->d_name;
+			struct stat lStat;
+			if(mPathsExcluded.contains(lPath) || 0 != fstatat(dirfd(lDir), lEntry->d_name, &lStat, AT_SYMLINK_NOFOLLOW)) {
+				continue;
+			}
+			if(S_ISDIR(lStat.st_mode)) {
+				if(matchesPattern(lPath + '/')) {
+					mState.mPatternBytes += folderSize(lPath);
+				} else {
+					lFolders.append(lPath);
+				}
+			} else if(matchesPattern(lPath)) {
+				mState.mPatternBytes += lStat.st_size;
+			}
+		}
+		closedir(lDir);
+	}
+}
+
+// New cache folders show up among the changed paths, either the folder itself
+// or its CACHEDIR.TAG file.
+void ExclusionEngine::incrementalScan() {
+	QMutableMapIterator<QString, quint64> i(mState.mCacheFolders);
+	while(i.hasNext()) {
+		i.next();
+		if(!mExcludeCacheFolders || !isCacheFolder(QFile::encodeName(i.key()))) {
+			i.remove();
+		}
+	}
+	if(!mExcludeCacheFolders || !mHaveChangedPaths) {
+		return;
+	}
+	foreach(const QString &lChangedPath, mChangedPaths) {
+		if(isInterruptionRequested()) {
+			return;
+		}
+		QString lCandidate = lChangedPath;
+		if(lCandidate.endsWith(QStringLiteral("/CACHEDIR.TAG"))) {
+			lCandidate.chop(13);
+		}
+		if(mState.mCacheFolders.contains(lCandidate)) {
+			continue;
+		}
+		QByteArray lPath = QFile::encodeName(lCandidate);
+		if(!isCacheFolder(lPath) || isExcluded(lPath)) {
+			continue;
+		}
+		bool lBelowKnown = false;
+		foreach(const QString &lKnown, mState.mCacheFolders.keys()) {
+			if(isBelow(lCandidate, lKnown)) {
+				lBelowKnown = true;
+				break;
+			}
+		}
+		if(!lBelowKnown) {
+			mState.mCacheFolders.insert(lCandidate, folderSize(lPath));
+		}
+	}
+}
+
+void ExclusionEngine::findSuggestions() {
+	mState.mSuggestions.clear();
+	if(mState.mRuns < cMinRuns) {
+		return;
+	}
+	QStringList lCandidates;
+	QHashIterator<QString, double> i(mState.mChurn);
+	while(i.hasNext()) {
+		i.next();
+		QByteArray lPath = QFile::encodeName(i.key());
+		if(i.value() >= cMinChurn && !isExcluded(lPath) && !mPathsIncluded.contains(lPath) &&
+		      i.key() != QDir::homePath()) {
+			lCandidates.append(i.key());
+		}
+	}
+	// of nested candidates only the outermost is interesting
+	lCandidates.sort();
+	QStringList lOutermost;
+	foreach(const QString &lCandidate, lCandidates) {
+		if(lOutermost.isEmpty() || !isBelow(lCandidate, lOutermost.last())) {
+			lOutermost.append(lCandidate);
+		}
+	}
+	QList<QPair<quint64, QString> > lSized;
+	foreach(const QString &lCandidate, lOutermost) {
+		if(isInterruptionRequested()) {
+			return;
+		}
+		quint64 lSize = folderSize(QFile::encodeName(lCandidate));
+		if(lSize >= cMinSuggestionSize) {
+			lSized.append(qMakePair(lSize, lCandidate));
+		}
+	}
+	qSort(lSized);
+	for(int j = lSized.count() - 1; j >= 0 && mState.mSuggestions.count() < cMaxSuggestions; --j) {
+		mState.mSuggestions.append(qMakePair(lSized.at(j).second, lSized.at(j).first));
+	}
+}
+
+bool ExclusionEngine::isCacheFolder(const QByteArray &pPath) {
+	QFile lTagFile(QFile::decodeName(pPath + "/CACHEDIR.TAG"));
+	if(!lTagFile.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	return lTagFile.read(sizeof cCacheDirSignature - 1) == QByteArray(cCacheDirSignature);
+}
+
+// excluded by the plan or by being inside a cache folder
+bool ExclusionEngine::isExcluded(const QByteArray &pPath) {
+	QString lPath = QFile::decodeName(pPath);
+	foreach(const QByteArray &lExcluded, mPathsExcluded) {
+		QString lExcludedPath = QFile::decodeName(lExcluded);
+		if(lPath == lExcludedPath || isBelow(lPath, lExcludedPath)) {
+			return true;
+		}
+	}
+	foreach(const QString &lCacheFolder, mState.mCacheFolders.keys()) {
+		if(lPath == lCacheFolder || isBelow(lPath, lCacheFolder)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ExclusionEngine::matchesPattern(const QByteArray &pPath) {
+	if(mRegExps.isEmpty()) {
+		return false;
+	}
+	QString lPath = QFile::decodeName(pPath);
+	foreach(const QRegularExpression &lRegExp, mRegExps) {
+		if(lRegExp.match(lPath).hasMatch()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+quint64 ExclusionEngine::folderSize(const QByteArray &pPath) {
+	quint64 lTotal = 0;
+	QList<QByteArray> lFolders;
+	lFolders.append(pPath);
+	while(!lFolders.isEmpty() && !isInterruptionRequested()) {
+		QByteArray lFolder = lFolders.takeLast();
+		DIR *lDir = opendir(lFolder.constData());
+		if(lDir == NULL) {
+			continue;
+		}
+		struct dirent *lEntry;
+		while((lEntry = readdir(lDir)) != NULL) {
+			if(0 == strcmp(lEntry->d_name, ".") || 0 == strcmp(lEntry->d_name, "..")) {
+				continue;
+			}
+			struct stat lStat;
+			if(0 != fstatat(dirfd(lDir), lEntry->d_name, &lStat, AT_SYMLINK_NOFOLLOW)) {
+				continue;
+			}
+			if(S_ISDIR(lStat.st_mode)) {
+				lFolders.append(lFolder + '/' + lEntry->d_name);
+			} else {
+				lTotal += lStat.st_size;
+			}
+		}
+		closedir(lDir);
+	}
+	return lTotal;
+}
+
+// Each changed path counts for the folder it is in and the one above that, as
+// long as they are inside the backup.
+void ExclusionEngine::recordChanges(const QString &pStateFilePath, const QStringList &pPathsIncluded,
+                                    const QStringList &pChangedPaths)
+{
+	ExclusionState lState;
+	lState.load(pStateFilePath);
+	QSet<QString> lChanged;
+	foreach(const QString &lChangedPath, pChangedPaths) {
+		QString lFolder = lChangedPath;
+		for(int lLevel = 0; lLevel < 2; ++lLevel) {
+			lFolder = lFolder.left(qMax(0, lFolder.lastIndexOf(QLatin1Char('/'))));
+			bool lInside = false;
+			foreach(const QString &lIncluded, pPathsIncluded) {
+				if(isBelow(lFolder, lIncluded)) {
+					lInside = true;
+					break;
+				}
+			}
+			if(!lInside) {
+				break;
+			}
+			lChanged.insert(lFolder);
+		}
+	}
+	QMutableHashIterator<QString, double> i(lState.mChurn);
+	while(i.hasNext()) {
+		i.next();
+		i.setValue(i.value() * (1.0 - cChurnWeight) + (lChanged.remove(i.key()) ? cChurnWeight : 0.0));
+		if(i.value() < 0.05) {
+			i.remove();
+		}
+	}
+	foreach(const QString &lFolder, lChanged) {
+		if(lState.mChurn.count() >= cMaxChurnEntries) {
+			break;
+		}
+		lState.mChurn.insert(lFolder, cChurnWeight);
+	}
+	++lState.mRuns;
+	lState.save(pStateFilePath);
+}
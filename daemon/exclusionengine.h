@@ -0,0 +1,101 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef EXCLUSIONENGINE_H
+#define EXCLUSIONENGINE_H
+
+#include <QHash>
+#include <QMap>
+#include <QRegularExpression>
+#include <QSet>
+#include <QStringList>
+#include <QThread>
+
+class BackupPlan;
+
+// What the exclusion engine remembers between backups of a plan.
+struct ExclusionState {
+	ExclusionState() : mLastFullScan(0), mPatternBytes(0), mRuns(0) {}
+	void load(const QString &pFilePath);
+	void save(const QString &pFilePath);
+	qint64 mLastFullScan; // ms since epoch
+	quint64 mPatternBytes; // size of everything matching the patterns at the last full scan
+	QMap<QString, quint64> mCacheFolders; // with their sizes
+	int mRuns; // backups recorded in mChurn
+	QHash<QString, double> mChurn; // how often each folder has changed lately, 0 to 1
+	QList<QPair<QString, quint64> > mSuggestions;
+};
+
+// Finds out what to leave out of a backup on top of the excluded folders of the
+// plan: folders tagged with a CACHEDIR.TAG file (see http://www.brynosaurus.com/cachedir/)
+// and paths matching the exclude patterns. Patterns are globs like rsync uses
+// them, or regular expressions when prefixed with "re:" (bup only).
+//
+// Walking all included folders takes a while, so it is only done once a week.
+// In between only the paths which have changed are checked for new cache folders.
+// Big folders which change in nearly every backup are suggested for exclusion.
+class ExclusionEngine : public QThread
+{
+	Q_OBJECT
+
+public:
+	ExclusionEngine(const BackupPlan &pPlan, const QString &pStateFilePath, QObject *pParent = NULL);
+	virtual ~ExclusionEngine();
+	void setChangedPaths(const QStringList &pPaths);
+	// valid after finished()
+	QStringList bupArguments() const;
+	QStringList rsyncArguments() const;
+	QStringList cacheFolders() const {
+		return mState.mCacheFolders.keys();
+	}
+	// patterns which are not valid regular expressions, left out of bupArguments()
+	QStringList invalidPatterns() const {
+		return mInvalidPatterns;
+	}
+	quint64 excludedBytes() const;
+	QStringList suggestions() const;
+	// Remembers which folders had changes in a successful backup.
+	static void recordChanges(const QString &pStateFilePath, const QStringList &pPathsIncluded,
+	                          const QStringList &pChangedPaths);
+	static QString globToRegExp(const QString &pGlob);
+
+protected:
+	virtual void run();
+	void fullScan();
+	void incrementalScan();
+	void findSuggestions();
+	bool isCacheFolder(const QByteArray &pPath);
+	bool isExcluded(const QByteArray &pPath);
+	bool matchesPattern(const QByteArray &pPath);
+	quint64 folderSize(const QByteArray &pPath);
+
+	QString mStateFilePath;
+	ExclusionState mState;
+	QList<QByteArray> mPathsIncluded;
+	QSet<QByteArray> mPathsExcluded;
+	bool mExcludeCacheFolders;
+	QStringList mPatterns;
+	QList<QRegularExpression> mRegExps;
+	QStringList mInvalidPatterns;
+	QStringList mChangedPaths;
+	bool mHaveChangedPaths;
+};
+
+#endif // EXCLUSIONENGINE_H
@@ -20,42 +20,27 @@
 
 #include "fsexecutor.h"
 #include "backupplan.h"
+#include "mountmonitor.h"
 
 #include <QAction>
 #include <QDir>
 #include <QFileInfo>
 #include <QTimer>
-#include <QTextStream>
 
 #include <KDirWatch>
-#include <KDiskFreeSpaceInfo>
-#include <KIO/DirectorySizeJob>
 #include <KLocalizedString>
 #include <KNotification>
 
-#include <fcntl.h>
-
 FSExecutor::FSExecutor(BackupPlan *pPlan, QObject *pParent)
-   :PlanExecutor(pPlan, pParent)
+   :PlanExecutor(pPlan, pParent), mWaitedForMount(false)
 {
 	mDestinationPath = QDir::cleanPath(mPlan->mFilesystemDestinationPath.toLocalFile());
 	mDirWatch = new KDirWatch(this);
 	connect(mDirWatch, SIGNAL(deleted(QString)), SLOT(checkStatus()));
-	mMountWatcher.start();
+	connect(MountMonitor::instance(), SIGNAL(mountPointChanged(QString)), SLOT(checkMountPoint(QString)));
 }
 
 void FSExecutor::checkStatus() {
-	static bool lComingBackLater = false;
-	if(!mWatchedParentDir.isEmpty() && !lComingBackLater) {
-		// came here because something happened to a parent folder,
-		// come back in a few seconds, give a new mount some time before checking
-		// status of destination folder
-		QTimer::singleShot(5000, this, SLOT(checkStatus()));
-		lComingBackLater = true;
-		return;
-	}
-	lComingBackLater = false;
-
 	QDir lDir(mDestinationPath);
 	if(!lDir.exists()) {
 		// Destination doesn't exist, find nearest existing parent folder and
@@ -76,7 +61,6 @@ void FSExecutor::checkStatus() {
 				mDirWatch->removeDir(mWatchedParentDir);
 			} else { // start watching a parent
 				connect(mDirWatch, SIGNAL(dirty(QString)), SLOT(checkStatus()));
-				connect(&mMountWatcher, SIGNAL(mountsChanged()), SLOT(checkMountPoints()), Qt::QueuedConnection);
 			}
 			mWatchedParentDir = lExisting;
 			mDirWatch->addDir(mWatchedParentDir);
@@ -85,10 +69,21 @@ void FSExecutor::checkStatus() {
 			enterNotAvailableState();
 		}
 	} else {
+		if(!mWatchedParentDir.isEmpty() && !MountMonitor::instance()->isMountPoint(mDestinationPath) &&
+		      lDir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden).isEmpty()) {
+			// Just appeared and is empty, could be a mount point created right before
+			// mounting. Wait for the mount, checkMountPoint() will come back here
+			// when it happens. Come back anyway after a while, maybe nothing gets mounted.
+			if(!mWaitedForMount) {
+				mWaitedForMount = true;
+				QTimer::singleShot(5000, this, SLOT(checkStatus()));
+				return;
+			}
+		}
+		mWaitedForMount = false;
 		// Destination exists... only watch for delete
 		if(!mWatchedParentDir.isEmpty()) {
 			disconnect(mDirWatch, SIGNAL(dirty(QString)), this, SLOT(checkStatus()));
-			disconnect(&mMountWatcher, SIGNAL(mountsChanged()), this, SLOT(checkMountPoints()));
 			mDirWatch->removeDir(mWatchedParentDir);
 			mWatchedParentDir.clear();
 		}
@@ -115,66 +110,11 @@ void FSExecutor::startBackup() {
 	lJob->start();
 }
 
-void FSExecutor::slotBackupDone(KJob *pJob) {
-	if(pJob->error()) {
-		notifyBackupFailed(pJob);
-		exitBackupRunningState(false);
-	} else {
-		mPlan->mLastCompleteBackup = QDateTime::currentDateTime().toUTC();
-		KDiskFreeSpaceInfo lSpaceInfo = KDiskFreeSpaceInfo::freeSpaceInfo(mDestinationPath);
-		if(lSpaceInfo.isValid())
-			mPlan->mLastAvailableSpace = (double)lSpaceInfo.available();
-		else
-			mPlan->mLastAvailableSpace = -1.0; //unknown size
-
-		KIO::DirectorySizeJob *lSizeJob = KIO::directorySize(QUrl::fromLocalFile(mDestinationPath));
-		connect(lSizeJob, SIGNAL(result(KJob*)), SLOT(slotBackupSizeDone(KJob*)));
-		lSizeJob->start();
-	}
-}
-
-void FSExecutor::slotBackupSizeDone(KJob *pJob) {
-	if(pJob->error()) {
-		KNotification::event(KNotification::Error, xi18nc("@title:window", "Problem"), pJob->errorText());
-		mPlan->mLastBackupSize = -1.0; //unknown size
-	} else {
-		KIO::DirectorySizeJob *lSizeJob = qobject_cast<KIO::DirectorySizeJob *>(pJob);
-		mPlan->mLastBackupSize = (double)lSizeJob->totalSize();
-	}
-	mPlan->save();
-	exitBackupRunningState(pJob->error() == 0);
-}
-
-void FSExecutor::checkMountPoints() {
-	QFile lMountsFile(QStringLiteral("/proc/mounts"));
-	if(!lMountsFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-		return;
-	}
-	// don't use atEnd() to detect when finished reading file, size of
-	// this special file is 0 but still returns data when read.
-	forever {
-		QByteArray lLine = lMountsFile.readLine();
-		if(lLine.isEmpty()) {
-			break;
-		}
-		QTextStream lTextStream(lLine);
-		QString lDevice, lMountPoint;
-		lTextStream >> lDevice >> lMountPoint;
-		if(lMountPoint == mWatchedParentDir) {
-			checkStatus();
-		}
-	}
-}
-
-void MountWatcher::run() {
-	int lMountsFd = open("/proc/mounts", O_RDONLY);
-	fd_set lFdSet;
-
-	forever {
-		FD_ZERO(&lFdSet);
-		FD_SET(lMountsFd, &lFdSet);
-		if(select(lMountsFd+1, NULL, NULL, &lFdSet, NULL) > 0) {
-			emit mountsChanged();
-		}
+void FSExecutor::checkMountPoint(const QString &pMountPoint) {
+	// Something got mounted on the folder being watched while waiting for the
+	// destination to appear, or the destination (or a parent) got unmounted.
+	if(pMountPoint == mWatchedParentDir || mDestinationPath == pMountPoint ||
+	      mDestinationPath.startsWith(pMountPoint.endsWith(QLatin1Char('/')) ? pMountPoint : pMountPoint + QLatin1Char('/'))) {
+		checkStatus();
 	}
 }
@@ -23,8 +23,6 @@
 
 #include "planexecutor.h"
 
-#include <QThread>
-
 class BackupPlan;
 
 class KDirWatch;
@@ -32,19 +30,6 @@ class KJob;
 
 class QTimer;
 
-// KDirWatch (well, inotify) does not detect when something gets mounted on a watched directory.
-// work around this problem by monitoring the mounts of the system in a separate thread.
-class MountWatcher: public QThread {
-	Q_OBJECT
-
-signals:
-	void mountsChanged();
-
-protected:
-	virtual void run();
-};
-
-
 // Plan executor that stores the backup to a path in the local
 // filesystem, uses KDirWatch to monitor for when the folder
 // becomes available/unavailable. Can be used for external
@@ -62,14 +47,12 @@ public slots:
 
 protected slots:
 	virtual void startBackup();
-	void slotBackupDone(KJob *pJob);
-	void slotBackupSizeDone(KJob *pJob);
-	void checkMountPoints();
+	void checkMountPoint(const QString &pMountPoint);
 
 protected:
 	QString mWatchedParentDir;
 	KDirWatch *mDirWatch;
-	MountWatcher mMountWatcher;
+	bool mWaitedForMount;
 };
 
 #endif // FSEXECUTOR_H
@@ -0,0 +1,169 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "jobscheduler.h"
+#include "blockdevice.h"
+#include "planexecutor.h"
+
+#include <QFile>
+
+#include <KLocalizedString>
+
+#include <sys/stat.h>
+
+JobScheduler::JobScheduler(QObject *pParent)
+   : QObject(pParent)
+{
+}
+
+void JobScheduler::requestRun(PlanExecutor *pExecutor, int pPriority) {
+	for(int i = 0; i < mRunning.count(); ++i) {
+		if(mRunning.at(i).mExecutor == pExecutor) {
+			return;
+		}
+	}
+	Entry lEntry;
+	lEntry.mExecutor = pExecutor;
+	lEntry.mPriority = pPriority;
+	for(int i = 0; i < mQueue.count(); ++i) {
+		if(mQueue.at(i).mExecutor == pExecutor) {
+			lEntry = mQueue.takeAt(i);
+			lEntry.mPriority = qMax(lEntry.mPriority, pPriority);
+			break;
+		}
+	}
+	// devices are looked up again, the destination could have been mounted since.
+	lEntry.mDevices = devicesUsed(pExecutor);
+	int lPosition = 0;
+	while(lPosition < mQueue.count() && mQueue.at(lPosition).mPriority >= lEntry.mPriority) {
+		++lPosition;
+	}
+	mQueue.insert(lPosition, lEntry);
+	startEligibleJobs();
+	emit queueChanged();
+}
+
+void JobScheduler::jobFinished(PlanExecutor *pExecutor) {
+	cancel(pExecutor);
+}
+
+void JobScheduler::cancel(PlanExecutor *pExecutor) {
+	for(int i = 0; i < mQueue.count(); ++i) {
+		if(mQueue.at(i).mExecutor == pExecutor) {
+			mQueue.removeAt(i);
+			break;
+		}
+	}
+	for(int i = 0; i < mRunning.count(); ++i) {
+		if(mRunning.at(i).mExecutor == pExecutor) {
+			mRunning.removeAt(i);
+			break;
+		}
+	}
+	startEligibleJobs();
+	emit queueChanged();
+}
+
+QStringList JobScheduler::queueDescription() {
+	QStringList lLines;
+	foreach(const Entry &lEntry, mQueue) {
+		QString lBlocker;
+		foreach(const Entry &lRunning, mRunning) {
+			if(sharesDevice(lEntry, lRunning)) {
+				lBlocker = lRunning.mExecutor->mPlan->mDescription;
+				break;
+			}
+		}
+		if(lBlocker.isEmpty()) {
+			// waiting behind a queued backup with higher priority
+			foreach(const Entry &lQueued, mQueue) {
+				if(lQueued.mExecutor == lEntry.mExecutor) {
+					break;
+				}
+				if(sharesDevice(lEntry, lQueued)) {
+					lBlocker = lQueued.mExecutor->mPlan->mDescription;
+					break;
+				}
+			}
+		}
+		lLines << xi18nc("@info:tooltip %1 is the description of a backup plan, %2 of another one",
+		                 "%1: waiting for %2, it uses the same disk",
+		                 lEntry.mExecutor->mPlan->mDescription, lBlocker);
+	}
+	return lLines;
+}
+
+QStringList JobScheduler::devicesUsed(PlanExecutor *pExecutor) {
+	QStringList lPaths = pExecutor->mPlan->mPathsIncluded;
+	lPaths << pExecutor->mDestinationPath;
+	QStringList lDevices;
+	foreach(const QString &lPath, lPaths) {
+		QString lDevice = diskDeviceNumber(lPath);
+		if(lDevice.isEmpty()) {
+			// not on a local disk, network mounts are identified by their filesystem instead.
+			struct stat lStat;
+			if(lPath.isEmpty() || 0 != stat(QFile::encodeName(lPath).constData(), &lStat)) {
+				continue;
+			}
+			lDevice = QStringLiteral("fs:%1").arg((qulonglong)lStat.st_dev);
+		}
+		if(!lDevices.contains(lDevice)) {
+			lDevices.append(lDevice);
+		}
+	}
+	return lDevices;
+}
+
+bool JobScheduler::sharesDevice(const Entry &pA, const Entry &pB) {
+	foreach(const QString &lDevice, pA.mDevices) {
+		if(pB.mDevices.contains(lDevice)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobScheduler::startEligibleJobs() {
+	QList<Entry> lBlocked;
+	QList<PlanExecutor *> lToStart;
+	for(int i = 0; i < mQueue.count();) {
+		Entry lEntry = mQueue.at(i);
+		bool lCanStart = true;
+		foreach(const Entry &lOther, mRunning + lBlocked) {
+			if(sharesDevice(lEntry, lOther)) {
+				lCanStart = false;
+				break;
+			}
+		}
+		if(!lCanStart) {
+			// later entries on the same disks have to wait for this one.
+			lBlocked.append(lEntry);
+			++i;
+			continue;
+		}
+		mQueue.removeAt(i);
+		mRunning.append(lEntry);
+		lToStart.append(lEntry.mExecutor);
+	}
+	// starting can fail right away and call back into the scheduler, do it last.
+	foreach(PlanExecutor *lExecutor, lToStart) {
+		lExecutor->startQueuedBackup();
+	}
+}
@@ -0,0 +1,66 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef JOBSCHEDULER_H
+#define JOBSCHEDULER_H
+
+#include <QObject>
+#include <QStringList>
+
+class PlanExecutor;
+
+// Decides when backups can run. Backups whose sources or destination are on
+// the same disk are run one at a time, they would only slow each other down.
+// Backups on separate disks run in parallel.
+class JobScheduler : public QObject
+{
+	Q_OBJECT
+
+public:
+	// Backups of a single folder the user asked for go before everything else.
+	enum Priority {ScheduledPriority, ManualPriority, FolderPriority};
+
+	explicit JobScheduler(QObject *pParent = 0);
+	// Starts the backup of pExecutor now if possible, queues it otherwise. If it
+	// is already queued only the priority gets raised.
+	void requestRun(PlanExecutor *pExecutor, int pPriority);
+	void jobFinished(PlanExecutor *pExecutor);
+	void cancel(PlanExecutor *pExecutor);
+	// One line per queued backup, saying what it is waiting for.
+	QStringList queueDescription();
+
+signals:
+	void queueChanged();
+
+protected:
+	struct Entry {
+		PlanExecutor *mExecutor;
+		int mPriority;
+		QStringList mDevices;
+	};
+	static QStringList devicesUsed(PlanExecutor *pExecutor);
+	static bool sharesDevice(const Entry &pA, const Entry &pB);
+	void startEligibleJobs();
+
+	QList<Entry> mQueue; // highest priority first, in order of arrival within a priority
+	QList<Entry> mRunning;
+};
+
+#endif // JOBSCHEDULER_H
@@ -20,27 +20,43 @@
 
 #include "kupdaemon.h"
 #include "kupsettings.h"
+#include "backupmetrics.h"
 #include "backupplan.h"
 #include "edexecutor.h"
+#include "exclusionengine.h"
 #include "fsexecutor.h"
+#include "jobscheduler.h"
+#include "toolcapabilities.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDBusConnection>
+#include <QDir>
 #include <QMenu>
 #include <QSessionManager>
 #include <QTimer>
 
 #include <KIdleTime>
 #include <KLocalizedString>
+#include <KNotification>
 #include <KRun>
 #include <KServiceTypeTrader>
 #include <KStandardAction>
 #include <KStatusNotifierItem>
 
+// how long a folder backup waits for the destination to show up.
+static const int cPendingPathTimeout = 20000;
+
 KupDaemon::KupDaemon() {
 	mWaitingToReloadConfig = false;
+	mPendingPathTimer = new QTimer(this);
+	mPendingPathTimer->setSingleShot(true);
+	mPendingPathTimer->setInterval(cPendingPathTimeout);
+	connect(mPendingPathTimer, SIGNAL(timeout()), SLOT(pendingPathsTimedOut()));
 	mConfig = KSharedConfig::openConfig(QStringLiteral("kuprc"));
 	mSettings = new KupSettings(mConfig, this);
+	mScheduler = new JobScheduler(this);
+	connect(mScheduler, SIGNAL(queueChanged()), SLOT(updateTrayIcon()));
 }
 
 KupDaemon::~KupDaemon() {
@@ -65,6 +81,9 @@ void KupDaemon::setupGuiStuff() {
 	connect(KIdleTime::instance(), SIGNAL(timeoutReached(int)), KIdleTime::instance(), SLOT(catchNextResumeEvent()));
 	connect(KIdleTime::instance(), SIGNAL(resumingFromIdle()), mUsageAccumulatorTimer, SLOT(start()));
 
+	// so that the first backup does not have to wait for it
+	ToolCapabilities::instance()->probe();
+
 	setupTrayIcon();
 	setupExecutors();
 	setupContextMenu();
@@ -139,13 +158,18 @@ void KupDaemon::updateTrayIcon() {
 		}
 	}
 	foreach(PlanExecutor *lExecutor, mExecutors) {
-		if(lExecutor->busy()) {
+		// queued backups are listed below instead
+		if(lExecutor->busy() && lExecutor->mState != PlanExecutor::BACKUP_QUEUED) {
 			lStatus = KStatusNotifierItem::NeedsAttention;
 			lToolTipIconName = QStringLiteral("kup");
 			lToolTipTitle = lExecutor->currentActivityTitle();
 			lToolTipSubTitle = lExecutor->mPlan->mDescription; // TODO: show percentage etc.
 		}
 	}
+	QStringList lQueue = mScheduler->queueDescription();
+	if(!lQueue.isEmpty()) {
+		lToolTipSubTitle += QStringLiteral("\n") + lQueue.join(QStringLiteral("\n"));
+	}
 	mStatusNotifier->setStatus(lStatus);
 	mStatusNotifier->setIconByName(lIconName);
 	mStatusNotifier->setToolTipIconByName(lToolTipIconName);
@@ -167,6 +191,153 @@ void KupDaemon::runIntegrityCheck(QString pPath) {
 	}
 }
 
+QString KupDaemon::backupMetrics(int pPlanNumber, int pMaxRuns) {
+	foreach(PlanExecutor *lExecutor, mExecutors) {
+		if(lExecutor->mPlan->planNumber() == pPlanNumber) {
+			return BackupMetrics(lExecutor->mMetricsFilePath).toJson(pMaxRuns);
+		}
+	}
+	return QStringLiteral("[]");
+}
+
+QStringList KupDaemon::exclusionSuggestions(int pPlanNumber) {
+	foreach(PlanExecutor *lExecutor, mExecutors) {
+		if(lExecutor->mPlan->planNumber() == pPlanNumber) {
+			ExclusionState lState;
+			lState.load(lExecutor->mExclusionsFilePath);
+			QStringList lFolders;
+			for(int i = 0; i < lState.mSuggestions.count(); ++i) {
+				lFolders << lState.mSuggestions.at(i).first;
+			}
+			return lFolders;
+		}
+	}
+	return QStringList();
+}
+
+bool KupDaemon::backupPath(QString pPath) {
+	QString lPath = QDir::cleanPath(pPath);
+	bool lIncluded;
+	executorForPath(lPath, &lIncluded);
+	if(!lIncluded) {
+		KNotification::event(KNotification::Error, xi18nc("@title:window", "Problem"),
+		                     xi18nc("notification %1 is a folder path",
+		                            "%1 is not included in any versioned backup plan.", lPath));
+		return false;
+	}
+	// Destinations are checked asynchronously, when the daemon was just started for
+	// this request no plan has found its destination yet. A busy plan takes the
+	// folder when it is done.
+	if(!mPendingPaths.contains(lPath)) {
+		mPendingPaths.append(lPath);
+	}
+	retryPendingPaths();
+	PlanExecutor *lExecutor = executorForPath(lPath, &lIncluded);
+	if(lExecutor != NULL && mPendingPaths.contains(lPath)) {
+		KNotification::event(KNotification::Notification, xi18nc("@title:window", "Backups"),
+		                     xi18nc("notification %1 is a folder path, %2 is the description of a backup plan",
+		                            "%1 will be saved when %2 is done.", lPath, lExecutor->mPlan->mDescription));
+	}
+	return true;
+}
+
+void KupDaemon::retryPendingPaths() {
+	bool lWaitingForDestination = false;
+	QMutableStringListIterator lIter(mPendingPaths);
+	while(lIter.hasNext()) {
+		bool lIncluded;
+		PlanExecutor *lExecutor = executorForPath(lIter.next(), &lIncluded);
+		if(lExecutor == NULL) {
+			lWaitingForDestination = true;
+		} else if(startPathBackup(lExecutor, lIter.value())) {
+			lIter.remove();
+		}
+	}
+	if(!lWaitingForDestination) {
+		mPendingPathTimer->stop();
+	} else if(!mPendingPathTimer->isActive()) {
+		mPendingPathTimer->start();
+	}
+}
+
+// Only gives up on folders without an available destination, the others wait
+// for their busy plan.
+void KupDaemon::pendingPathsTimedOut() {
+	QMutableStringListIterator lIter(mPendingPaths);
+	while(lIter.hasNext()) {
+		bool lIncluded;
+		if(executorForPath(lIter.next(), &lIncluded) != NULL) {
+			continue;
+		}
+		KNotification::event(KNotification::Error, xi18nc("@title:window", "Problem"),
+		                     lIncluded ? xi18nc("notification %1 is a folder path",
+		                                        "The backup destination for %1 is not available.", lIter.value())
+		                               : xi18nc("notification %1 is a folder path",
+		                                        "%1 is not included in any versioned backup plan.", lIter.value()));
+		lIter.remove();
+	}
+}
+
+PlanExecutor *KupDaemon::executorForPath(const QString &pPath, bool *pIncluded) {
+	PlanExecutor *lBestExecutor = NULL;
+	int lBestLength = -1;
+	*pIncluded = false;
+	foreach(PlanExecutor *lExecutor, mExecutors) {
+		BackupPlan *lPlan = lExecutor->mPlan;
+		if(lPlan->mBackupType != BackupPlan::BupType) {
+			continue;
+		}
+		int lIncludeLength = -1;
+		foreach(const QString &lInclude, lPlan->mPathsIncluded) {
+			if(pPath == lInclude || pPath.startsWith(lInclude.endsWith(QLatin1Char('/')) ? lInclude : lInclude + QLatin1Char('/'))) {
+				lIncludeLength = qMax(lIncludeLength, lInclude.length());
+			}
+		}
+		foreach(const QString &lExclude, lPlan->mPathsExcluded) {
+			if(pPath == lExclude || pPath.startsWith(lExclude + QLatin1Char('/'))) {
+				lIncludeLength = -1;
+			}
+		}
+		if(lIncludeLength < 0) {
+			continue;
+		}
+		*pIncluded = true;
+		// the plan with the most specific source wins, if its destination is there.
+		if(lExecutor->mState != PlanExecutor::NOT_AVAILABLE && lIncludeLength > lBestLength) {
+			lBestExecutor = lExecutor;
+			lBestLength = lIncludeLength;
+		}
+	}
+	return lBestExecutor;
+}
+
+// Returns false if the plan is busy.
+bool KupDaemon::startPathBackup(PlanExecutor *pExecutor, const QString &pPath) {
+	PlanExecutor::FolderBackupStart lStart = pExecutor->startFolderBackup(pPath);
+	if(lStart == PlanExecutor::CompleteBackupInstead) {
+		KNotification::event(KNotification::Notification, xi18nc("@title:window", "Backups"),
+		                     xi18nc("notification %1 is a folder path, %2 is the description of a backup plan",
+		                            "%1 will be saved by a complete backup of %2, this takes longer than "
+		                            "saving only the folder.", pPath, pExecutor->mPlan->mDescription));
+	}
+	return lStart != PlanExecutor::FolderBackupRefused;
+}
+
+QCommandLineOption KupDaemon::backupPathOption() {
+	return QCommandLineOption(QStringLiteral("backup-path"),
+	                          xi18nc("@info:shell", "Take a backup of this folder now, with the backup plan it belongs to."),
+	                          QStringLiteral("path"));
+}
+
+void KupDaemon::handleActivation(const QStringList &pArguments, const QString &pWorkingDirectory) {
+	QCommandLineParser lParser;
+	lParser.addOption(backupPathOption());
+	lParser.parse(pArguments);
+	if(lParser.isSet(backupPathOption())) {
+		backupPath(QDir(pWorkingDirectory).absoluteFilePath(lParser.value(backupPathOption())));
+	}
+}
+
 void KupDaemon::disableSessionManagement(QSessionManager &pManager) {
 	pManager.setRestartHint(QSessionManager::RestartNever);
 }
@@ -184,11 +355,14 @@ void KupDaemon::setupExecutors() {
 			continue;
 		}
 		//... add other types here
+		lExecutor->mScheduler = mScheduler;
 		mExecutors.append(lExecutor);
 	}
 	foreach(PlanExecutor *lExecutor, mExecutors) {
 		lExecutor->checkStatus(); //connect after to trigger less updates here, do one check after instead.
 		connect(lExecutor, SIGNAL(stateChanged()), SLOT(updateTrayIcon()));
+		// queued so that an executor which just became available has scheduled itself first.
+		connect(lExecutor, SIGNAL(stateChanged()), SLOT(retryPendingPaths()), Qt::QueuedConnection);
 		connect(lExecutor, SIGNAL(backupStatusChanged()), SLOT(updateTrayIcon()));
 		connect(mUsageAccumulatorTimer, SIGNAL(timeout()), lExecutor, SLOT(updateAccumulatedUsageTime()));
 	}
@@ -23,10 +23,13 @@
 
 #include <KSharedConfig>
 
+#include <QCommandLineOption>
+
 #define KUP_DBUS_SERVICE_NAME QStringLiteral("org.kde.kupdaemon")
 #define KUP_DBUS_OBJECT_PATH QStringLiteral("/DaemonControl")
 
 
+class JobScheduler;
 class KupSettings;
 class PlanExecutor;
 
@@ -45,28 +48,48 @@ public:
 	virtual ~KupDaemon();
 	bool shouldStart();
 	void setupGuiStuff();
+	static QCommandLineOption backupPathOption();
 
 public slots:
 	void reloadConfig();
 	void showConfig();
 	void updateTrayIcon();
 	void runIntegrityCheck(QString pPath);
+	// JSON array with the last pMaxRuns backup runs of a plan, all runs if pMaxRuns is 0.
+	QString backupMetrics(int pPlanNumber, int pMaxRuns);
+	// Big folders which change in nearly every backup of a plan, biggest first.
+	QStringList exclusionSuggestions(int pPlanNumber);
+	// Backs up a folder right away with the plan it belongs to, without looking
+	// for changes in the other sources of the plan. Waits a while for the destination
+	// if it is not available yet, and for the plan to finish what it is doing.
+	bool backupPath(QString pPath);
 
 private slots:
 	void disableSessionManagement(QSessionManager &pManager);
+	// arguments of another "kup-daemon" started while this one is running.
+	void handleActivation(const QStringList &pArguments, const QString &pWorkingDirectory);
+	void retryPendingPaths();
+	void pendingPathsTimedOut();
 
 private:
 	void setupExecutors();
 	void setupTrayIcon();
 	void setupContextMenu();
+	// most specific versioned plan for pPath with its destination available, NULL if there is none.
+	PlanExecutor *executorForPath(const QString &pPath, bool *pIncluded);
+	bool startPathBackup(PlanExecutor *pExecutor, const QString &pPath);
 
 	KSharedConfigPtr mConfig;
 	KupSettings *mSettings;
 	QList<PlanExecutor *> mExecutors;
+	JobScheduler *mScheduler;
 	KStatusNotifierItem *mStatusNotifier;
 	QMenu *mContextMenu;
 	QTimer *mUsageAccumulatorTimer;
 	bool mWaitingToReloadConfig;
+	// folders to back up once their destination becomes available.
+	QStringList mPendingPaths;
+	QTimer *mPendingPathTimer;
 };
 
 #endif /*KUPDAEMON_H*/
@@ -27,6 +27,7 @@
 #include <QApplication>
 #include <QDebug>
 #include <QCommandLineParser>
+#include <QDir>
 
 extern "C" int Q_DECL_EXPORT kdemain(int argc, char *argv[]) {
 	QApplication lApp(argc, argv);
@@ -58,13 +59,19 @@ extern "C" int Q_DECL_EXPORT kdemain(int argc, char *argv[]) {
 	lParser.addVersionOption();
 	lParser.addHelpOption();
 	lAbout.setupCommandLine(&lParser);
+	lParser.addOption(KupDaemon::backupPathOption());
 	lParser.process(lApp);
 	lAbout.processCommandLine(&lParser);
 
-	// This call will exit() if an instance is already running
+	// This call will exit() if an instance is already running, after passing on the arguments to it.
 	KDBusService lService(KDBusService::Unique);
+	lDaemon->connect(&lService, SIGNAL(activateRequested(QStringList,QString)), lDaemon,
+	                 SLOT(handleActivation(QStringList,QString)));
 
 	lDaemon->setupGuiStuff();
+	if(lParser.isSet(KupDaemon::backupPathOption())) {
+		lDaemon->backupPath(QDir::current().absoluteFilePath(lParser.value(KupDaemon::backupPathOption())));
+	}
 
 	// these calls will make session management not try (and fail because of KDBusService) to start
 	// this daemon. We have autostart for the purpose of launching this daemon instead.
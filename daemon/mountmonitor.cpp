@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "mountmonitor.h"
+
+#include <QCoreApplication>
+#include <QSocketNotifier>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+MountMonitor *MountMonitor::instance() {
+	static MountMonitor *sInstance = NULL;
+	if(sInstance == NULL) {
+		sInstance = new MountMonitor();
+	}
+	return sInstance;
+}
+
+MountMonitor::MountMonitor()
+   : QObject(QCoreApplication::instance()), mNotifier(NULL)
+{
+	mMountInfoFd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+	if(mMountInfoFd < 0) {
+		return;
+	}
+	mNotifier = new QSocketNotifier(mMountInfoFd, QSocketNotifier::Exception, this);
+	connect(mNotifier, SIGNAL(activated(int)), SLOT(readMountTable()));
+	readMountTable();
+}
+
+MountMonitor::~MountMonitor() {
+	if(mMountInfoFd >= 0) {
+		close(mMountInfoFd);
+	}
+}
+
+void MountMonitor::readMountTable() {
+	// the file has to be read from the start each time for the notification to be reset.
+	QByteArray lData;
+	char lBuffer[16 * 1024];
+	lseek(mMountInfoFd, 0, SEEK_SET);
+	forever {
+		ssize_t lLength = read(mMountInfoFd, lBuffer, sizeof(lBuffer));
+		if(lLength <= 0) {
+			break;
+		}
+		lData.append(lBuffer, lLength);
+	}
+
+	QSet<QString> lMountPoints;
+	foreach(const QByteArray &lLine, lData.split('\n')) {
+		// fields: mount id, parent id, major:minor, root, mount point, ...
+		QList<QByteArray> lFields = lLine.split(' ');
+		if(lFields.count() > 4) {
+			lMountPoints.insert(unescape(lFields.at(4)));
+		}
+	}
+	if(lMountPoints == mMountPoints) {
+		return;
+	}
+	QSet<QString> lChanged = (lMountPoints - mMountPoints) + (mMountPoints - lMountPoints);
+	mMountPoints = lMountPoints;
+	foreach(const QString &lMountPoint, lChanged) {
+		emit mountPointChanged(lMountPoint);
+	}
+}
+
+// Spaces, tabs, newlines and backslashes in paths are written as octal escapes.
+QString MountMonitor::unescape(const QByteArray &pField) {
+	QByteArray lResult;
+	for(int i = 0; i < pField.size(); ++i) {
+		if(pField.at(i) == '\\' && i + 3 < pField.size()) {
+			lResult.append((char)pField.mid(i + 1, 3).toInt(NULL, 8));
+			i += 3;
+		} else {
+			lResult.append(pField.at(i));
+		}
+	}
+	return QString::fromLocal8Bit(lResult);
+}
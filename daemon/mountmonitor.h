@@ -0,0 +1,61 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef MOUNTMONITOR_H
+#define MOUNTMONITOR_H
+
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+class QSocketNotifier;
+
+// KDirWatch (well, inotify) does not detect when something gets mounted on a
+// watched directory. This keeps the mount table of the system, /proc/self/mountinfo
+// becomes readable as an exception condition when it changes so it can be
+// monitored from the event loop. Shared by all executors.
+class MountMonitor : public QObject
+{
+	Q_OBJECT
+
+public:
+	static MountMonitor *instance();
+	bool isMountPoint(const QString &pPath) const {
+		return mMountPoints.contains(pPath);
+	}
+
+signals:
+	// Emitted for every mount point that was added or removed.
+	void mountPointChanged(const QString &pMountPoint);
+
+protected slots:
+	void readMountTable();
+
+protected:
+	MountMonitor();
+	virtual ~MountMonitor();
+	static QString unescape(const QByteArray &pField);
+
+	int mMountInfoFd;
+	QSocketNotifier *mNotifier;
+	QSet<QString> mMountPoints;
+};
+
+#endif // MOUNTMONITOR_H
@@ -0,0 +1,445 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "packverifier.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <QtAlgorithms>
+#include <QtEndian>
+
+#include <git2.h>
+#include <zlib.h>
+
+#include <string.h>
+#include <sys/mman.h>
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// A spinning disk only gets slower when more packs are read at once.
+const int cMaxThreads = 4;
+const qint64 cHashChunkSize = 1 << 20;
+const int cInflateBufferSize = 1 << 16;
+
+struct ObjectEntry {
+	quint64 mOffset;
+	quint32 mPosition; // in the index
+};
+
+bool operator <(const ObjectEntry &pA, const ObjectEntry &pB) {
+	return pA.mOffset < pB.mOffset;
+}
+
+class PackCheck : public QRunnable
+{
+public:
+	PackCheck(PackVerifier *pVerifier, QAtomicInt *pCancelled, const QString &pPackPath, bool pCheckObjects)
+	   : mVerifier(pVerifier), mCancelled(pCancelled), mPackPath(pPackPath), mCheckObjects(pCheckObjects),
+	     mBytesRead(0)
+	{}
+
+	virtual void run() {
+#ifdef Q_OS_LINUX
+		// idle I/O class for this thread only, see Documentation/block/ioprio.txt
+		syscall(SYS_ioprio_set, 1, syscall(SYS_gettid), 3 << 13 | 7);
+#endif
+		QThread::currentThread()->setPriority(QThread::IdlePriority);
+		QString lError = check();
+		if(mCancelled->load()) {
+			return;
+		}
+		QMetaObject::invokeMethod(mVerifier, "packChecked", Qt::QueuedConnection,
+		                          Q_ARG(QString, QFileInfo(mPackPath).fileName()),
+		                          Q_ARG(QString, lError), Q_ARG(qint64, mBytesRead));
+	}
+
+protected:
+	QString check() {
+		QString lIndexPath = mPackPath;
+		lIndexPath.chop(4);
+		lIndexPath.append(QStringLiteral("idx"));
+		QFile lIndexFile(lIndexPath);
+		if(!lIndexFile.open(QIODevice::ReadOnly)) {
+			return QStringLiteral("the index file could not be opened");
+		}
+		qint64 lIndexSize = lIndexFile.size();
+		const uchar *lIndex = lIndexFile.map(0, lIndexSize);
+		if(lIndex == NULL) {
+			return QStringLiteral("the index file could not be read");
+		}
+		int lVersion = 1;
+		const uchar *lFanout = lIndex;
+		if(lIndexSize >= 8 && 0 == memcmp(lIndex, "\377tOc", 4)) {
+			lVersion = qFromBigEndian<quint32>(lIndex + 4);
+			if(lVersion != 2) {
+				return QStringLiteral("unsupported index version %1").arg(lVersion);
+			}
+			lFanout = lIndex + 8;
+		}
+		qint64 lTableOffset = lFanout - lIndex + 256 * 4;
+		if(lIndexSize < lTableOffset + 40) {
+			return QStringLiteral("the index file is truncated");
+		}
+		quint32 lCount = qFromBigEndian<quint32>(lFanout + 255 * 4);
+		if(lIndexSize < lTableOffset + (qint64)lCount * (lVersion == 1 ? 24 : 28) + 40) {
+			return QStringLiteral("the index file is truncated");
+		}
+		mBytesRead += lIndexSize;
+		if(!hashMatches(lIndex, lIndexSize - 20, lIndex + lIndexSize - 20)) {
+			return QStringLiteral("checksum mismatch in the index file");
+		}
+
+		QFile lPackFile(mPackPath);
+		if(!lPackFile.open(QIODevice::ReadOnly)) {
+			return QStringLiteral("the pack file could not be opened");
+		}
+		qint64 lPackSize = lPackFile.size();
+		if(lPackSize < 32) {
+			return QStringLiteral("the pack file is truncated");
+		}
+		const uchar *lPack = lPackFile.map(0, lPackSize);
+		if(lPack == NULL) {
+			return QStringLiteral("the pack file could not be read");
+		}
+		posix_madvise(const_cast<uchar *>(lPack), lPackSize, POSIX_MADV_SEQUENTIAL);
+		if(0 != memcmp(lPack, "PACK", 4)) {
+			return QStringLiteral("not a pack file");
+		}
+		quint32 lPackVersion = qFromBigEndian<quint32>(lPack + 4);
+		if(lPackVersion != 2 && lPackVersion != 3) {
+			return QStringLiteral("unsupported pack version %1").arg(lPackVersion);
+		}
+		quint32 lPackCount = qFromBigEndian<quint32>(lPack + 8);
+		if(lPackCount != lCount) {
+			return QStringLiteral("the pack has %1 objects but its index lists %2").arg(lPackCount).arg(lCount);
+		}
+		mBytesRead += lPackSize;
+		if(!hashMatches(lPack, lPackSize - 20, lPack + lPackSize - 20)) {
+			return QStringLiteral("checksum mismatch in the pack file");
+		}
+		if(0 != memcmp(lIndex + lIndexSize - 40, lPack + lPackSize - 20, 20)) {
+			return QStringLiteral("the index file belongs to a different pack");
+		}
+		if(!mCheckObjects) {
+			return QString();
+		}
+		return checkObjects(lIndex + lTableOffset, lIndexSize - 40 - lTableOffset, lVersion, lCount,
+		                    lPack, lPackSize - 20);
+	}
+
+	bool hashMatches(const uchar *pData, qint64 pSize, const uchar *pExpected) {
+		QCryptographicHash lHash(QCryptographicHash::Sha1);
+		for(qint64 lPos = 0; lPos < pSize; lPos += cHashChunkSize) {
+			if(mCancelled->load()) {
+				return false;
+			}
+			lHash.addData(reinterpret_cast<const char *>(pData) + lPos, (int)qMin(cHashChunkSize, pSize - lPos));
+		}
+		return 0 == memcmp(lHash.result().constData(), pExpected, 20);
+	}
+
+	// pTables points past the fanout table, pDataSize excludes the trailer of the pack.
+	QString checkObjects(const uchar *pTables, qint64 pTablesSize, int pVersion, quint32 pCount,
+	                     const uchar *pPack, qint64 pDataSize)
+	{
+		QVector<ObjectEntry> lEntries(pCount);
+		const uchar *lLargeOffsets = pTables + (qint64)pCount * 28;
+		for(quint32 i = 0; i < pCount; ++i) {
+			lEntries[i].mPosition = i;
+			if(pVersion == 1) {
+				lEntries[i].mOffset = qFromBigEndian<quint32>(pTables + (qint64)i * 24);
+				continue;
+			}
+			quint32 lOffset = qFromBigEndian<quint32>(pTables + (qint64)pCount * 24 + (qint64)i * 4);
+			if(lOffset & 0x80000000) {
+				qint64 lLargeIndex = lOffset & 0x7fffffff;
+				if(lLargeOffsets + (lLargeIndex + 1) * 8 > pTables + pTablesSize) {
+					return QStringLiteral("the index file is truncated");
+				}
+				lEntries[i].mOffset = qFromBigEndian<quint64>(lLargeOffsets + lLargeIndex * 8);
+			} else {
+				lEntries[i].mOffset = lOffset;
+			}
+		}
+		qSort(lEntries);
+
+		z_stream lStream;
+		memset(&lStream, 0, sizeof lStream);
+		if(inflateInit(&lStream) != Z_OK) {
+			return QStringLiteral("zlib could not be initialized");
+		}
+		QByteArray lBuffer(cInflateBufferSize, Qt::Uninitialized);
+		QString lError;
+		for(int i = 0; i < lEntries.count() && lError.isEmpty(); ++i) {
+			if(mCancelled->load()) {
+				break;
+			}
+			const ObjectEntry &lEntry = lEntries.at(i);
+			const uchar *lObjectId = pVersion == 1 ? pTables + (qint64)lEntry.mPosition * 24 + 4
+			                                       : pTables + (qint64)lEntry.mPosition * 20;
+			quint64 lEnd = i + 1 < lEntries.count() ? lEntries.at(i + 1).mOffset : (quint64)pDataSize;
+			if(lEntry.mOffset < 12 || lEnd > (quint64)pDataSize || lEnd <= lEntry.mOffset) {
+				lError = QStringLiteral("object %1 has an invalid offset").arg(objectName(lObjectId));
+				break;
+			}
+			const uchar *lData = pPack + lEntry.mOffset;
+			quint64 lLength = lEnd - lEntry.mOffset;
+			if(pVersion == 2) {
+				quint32 lCrc = qFromBigEndian<quint32>(pTables + (qint64)pCount * 20 + (qint64)lEntry.mPosition * 4);
+				if(lLength > 0xffffffffu || crc32(0, lData, (uInt)lLength) != lCrc) {
+					lError = QStringLiteral("CRC mismatch for object %1").arg(objectName(lObjectId));
+					break;
+				}
+			}
+			lError = inflateObject(lStream, lData, lLength, lObjectId, lBuffer);
+			inflateReset(&lStream);
+		}
+		inflateEnd(&lStream);
+		return lError;
+	}
+
+	QString inflateObject(z_stream &pStream, const uchar *pData, quint64 pLength, const uchar *pObjectId,
+	                      QByteArray &pBuffer)
+	{
+		// object header: type and inflated size, then the base of a delta
+		quint64 lPos = 0;
+		uchar c = pData[lPos++];
+		int lType = (c >> 4) & 7;
+		quint64 lSize = c & 15;
+		int lShift = 4;
+		while(c & 0x80) {
+			if(lPos >= pLength || lShift > 57) {
+				return QStringLiteral("object %1 has an invalid header").arg(objectName(pObjectId));
+			}
+			c = pData[lPos++];
+			lSize |= (quint64)(c & 0x7f) << lShift;
+			lShift += 7;
+		}
+		if(lType == GIT_OBJ_OFS_DELTA) {
+			while(lPos < pLength && (pData[lPos++] & 0x80)) {}
+		} else if(lType == GIT_OBJ_REF_DELTA) {
+			lPos += 20;
+		} else if(lType < GIT_OBJ_COMMIT || lType > GIT_OBJ_TAG) {
+			return QStringLiteral("object %1 has an invalid type").arg(objectName(pObjectId));
+		}
+		if(lPos >= pLength || pLength - lPos > 0xffffffffu) {
+			return QStringLiteral("object %1 has an invalid header").arg(objectName(pObjectId));
+		}
+
+		// Deltas can not be checked against their id without resolving them,
+		// bup does not write any though.
+		bool lCheckId = lType <= GIT_OBJ_TAG;
+		QCryptographicHash lHash(QCryptographicHash::Sha1);
+		if(lCheckId) {
+			QByteArray lHeader(git_object_type2string((git_otype)lType));
+			lHeader.append(' ');
+			lHeader.append(QByteArray::number(lSize));
+			lHeader.append('\0');
+			lHash.addData(lHeader);
+		}
+		pStream.next_in = const_cast<Bytef *>(pData + lPos);
+		pStream.avail_in = (uInt)(pLength - lPos);
+		quint64 lInflated = 0;
+		int lResult;
+		do {
+			pStream.next_out = reinterpret_cast<Bytef *>(pBuffer.data());
+			pStream.avail_out = (uInt)pBuffer.size();
+			lResult = inflate(&pStream, Z_NO_FLUSH);
+			if(lResult != Z_OK && lResult != Z_STREAM_END) {
+				break;
+			}
+			int lProduced = pBuffer.size() - (int)pStream.avail_out;
+			lInflated += lProduced;
+			if(lCheckId) {
+				lHash.addData(pBuffer.constData(), lProduced);
+			}
+		} while(lResult == Z_OK);
+		if(lResult != Z_STREAM_END) {
+			return QStringLiteral("object %1 could not be inflated").arg(objectName(pObjectId));
+		}
+		if(lInflated != lSize) {
+			return QStringLiteral("object %1 has the wrong size").arg(objectName(pObjectId));
+		}
+		if(lCheckId && 0 != memcmp(lHash.result().constData(), pObjectId, 20)) {
+			return QStringLiteral("object %1 does not match its id").arg(objectName(pObjectId));
+		}
+		return QString();
+	}
+
+	static QString objectName(const uchar *pObjectId) {
+		git_oid lOid;
+		git_oid_fromraw(&lOid, pObjectId);
+		char lName[GIT_OID_HEXSZ + 1];
+		git_oid_tostr(lName, sizeof lName, &lOid);
+		return QString::fromLatin1(lName);
+	}
+
+	PackVerifier *mVerifier;
+	QAtomicInt *mCancelled;
+	QString mPackPath;
+	bool mCheckObjects;
+	qint64 mBytesRead;
+};
+
+}
+
+PackVerifier::PackVerifier(const QString &pRepositoryPath, const QString &pLedgerFilePath, QObject *pParent)
+   : QObject(pParent), mLedgerFilePath(pLedgerFilePath), mCancelled(0), mLevel(ChecksumLevel), mFullPass(false),
+     mPacksChecked(0), mPacksSkipped(0), mPacksTotal(0), mBytesRead(0)
+{
+	mPackDirPath = pRepositoryPath + QStringLiteral("/objects/pack");
+	mLastFullPass[0] = mLastFullPass[1] = 0;
+	mPool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), cMaxThreads));
+}
+
+PackVerifier::~PackVerifier() {
+	mCancelled.store(1);
+	mPool.clear();
+	mPool.waitForDone();
+}
+
+void PackVerifier::start(Level pLevel, int pFullIntervalDays) {
+	mLevel = pLevel;
+	mPacksChecked = mPacksSkipped = 0;
+	mBytesRead = 0;
+	mFailures.clear();
+	loadLedger();
+
+	QDir lPackDir(mPackDirPath);
+	if(!lPackDir.exists()) {
+		mFailures << QString(QStringLiteral("%1: folder does not exist")).arg(mPackDirPath);
+		QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection);
+		return;
+	}
+	qint64 lNow = QDateTime::currentMSecsSinceEpoch();
+	qint64 lLastFullPass = mLastFullPass[pLevel - 1];
+	mFullPass = pFullIntervalDays <= 0 || lLastFullPass == 0 ||
+	            lNow - lLastFullPass > (qint64)pFullIntervalDays * 24 * 3600 * 1000;
+
+	QHash<QString, LedgerEntry> lStillValid;
+	foreach(const QFileInfo &lInfo, lPackDir.entryInfoList(QStringList() << QStringLiteral("pack-*.pack"),
+	                                                       QDir::Files)) {
+		LedgerEntry lEntry;
+		lEntry.mSize = lInfo.size();
+		lEntry.mModified = lInfo.lastModified().toMSecsSinceEpoch();
+		QHash<QString, LedgerEntry>::const_iterator lOld = mLedger.constFind(lInfo.fileName());
+		if(lOld != mLedger.constEnd() && lOld->mSize == lEntry.mSize && lOld->mModified == lEntry.mModified) {
+			lStillValid.insert(lInfo.fileName(), lOld.value());
+			if(!mFullPass && lOld->mLevel >= pLevel) {
+				++mPacksSkipped;
+				continue;
+			}
+		}
+		mPending.insert(lInfo.fileName(), lEntry);
+		mPool.start(new PackCheck(this, &mCancelled, lInfo.absoluteFilePath(), pLevel == ObjectLevel));
+	}
+	// packs which were removed or rewritten are forgotten
+	mLedger = lStillValid;
+	mPacksTotal = mPending.count();
+	if(mPacksTotal == 0) {
+		QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection);
+	}
+}
+
+void PackVerifier::packChecked(const QString &pPackName, const QString &pError, qint64 pBytesRead) {
+	LedgerEntry lEntry = mPending.take(pPackName);
+	mBytesRead += pBytesRead;
+	++mPacksChecked;
+	if(pError.isEmpty()) {
+		// The pack has not changed since any earlier check at a higher level.
+		lEntry.mLevel = qMax((int)mLevel, mLedger.value(pPackName).mLevel);
+		lEntry.mVerified = QDateTime::currentMSecsSinceEpoch();
+		mLedger.insert(pPackName, lEntry);
+	} else {
+		mFailures << QString(QStringLiteral("%1: %2")).arg(pPackName, pError);
+		mLedger.remove(pPackName);
+	}
+	emit progress(mPacksChecked, mPacksTotal);
+	if(mPending.isEmpty()) {
+		finish();
+	}
+}
+
+void PackVerifier::finish() {
+	if(mFullPass && mFailures.isEmpty()) {
+		for(int i = 0; i < mLevel; ++i) {
+			mLastFullPass[i] = QDateTime::currentMSecsSinceEpoch();
+		}
+	}
+	saveLedger();
+	emit finished(mFailures.isEmpty());
+}
+
+// First line has the times of the last complete passes, then one line per pack:
+// name, size, modification time, level and time of verification.
+void PackVerifier::loadLedger() {
+	mLedger.clear();
+	mLastFullPass[0] = mLastFullPass[1] = 0;
+	QFile lFile(mLedgerFilePath);
+	if(!lFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		return;
+	}
+	QTextStream lStream(&lFile);
+	lStream.setCodec("UTF-8");
+	while(!lStream.atEnd()) {
+		QStringList lFields = lStream.readLine().split(QLatin1Char('\t'));
+		if(lFields.count() == 3 && lFields.at(0) == QStringLiteral("full")) {
+			mLastFullPass[0] = lFields.at(1).toLongLong();
+			mLastFullPass[1] = lFields.at(2).toLongLong();
+		} else if(lFields.count() == 5) {
+			LedgerEntry lEntry;
+			lEntry.mSize = lFields.at(1).toLongLong();
+			lEntry.mModified = lFields.at(2).toLongLong();
+			lEntry.mLevel = lFields.at(3).toInt();
+			lEntry.mVerified = lFields.at(4).toLongLong();
+			mLedger.insert(lFields.at(0), lEntry);
+		}
+	}
+}
+
+void PackVerifier::saveLedger() {
+	QSaveFile lFile(mLedgerFilePath);
+	if(!lFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		return;
+	}
+	QTextStream lStream(&lFile);
+	lStream.setCodec("UTF-8");
+	lStream << QStringLiteral("full\t") << mLastFullPass[0] << QLatin1Char('\t') << mLastFullPass[1] << endl;
+	QHashIterator<QString, LedgerEntry> i(mLedger);
+	while(i.hasNext()) {
+		i.next();
+		lStream << i.key() << QLatin1Char('\t') << i.value().mSize << QLatin1Char('\t') << i.value().mModified
+		        << QLatin1Char('\t') << i.value().mLevel << QLatin1Char('\t') << i.value().mVerified << endl;
+	}
+	lStream.flush();
+	lFile.commit();
+}
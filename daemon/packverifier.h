@@ -0,0 +1,101 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef PACKVERIFIER_H
+#define PACKVERIFIER_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+
+// Checks the packfiles of a bup repository without running bup, one pack per
+// thread. ChecksumLevel verifies the SHA-1 trailers of each pack and its index
+// and that they agree with each other, which is what "bup fsck --quick" does.
+// ObjectLevel also inflates every object and checks its CRC and object id.
+//
+// Packs which passed are recorded in a ledger file together with their size and
+// modification time, so later runs only need to look at new packs. Every pack
+// is checked again once the last complete pass is older than the given interval,
+// or always with an interval of zero.
+class PackVerifier : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Level {ChecksumLevel = 1, ObjectLevel = 2};
+	PackVerifier(const QString &pRepositoryPath, const QString &pLedgerFilePath, QObject *pParent = NULL);
+	virtual ~PackVerifier();
+	void start(Level pLevel, int pFullIntervalDays);
+	// valid after the finished() signal
+	bool wasFullPass() const {
+		return mFullPass;
+	}
+	int packsChecked() const {
+		return mPacksChecked;
+	}
+	int packsSkipped() const {
+		return mPacksSkipped;
+	}
+	quint64 bytesRead() const {
+		return mBytesRead;
+	}
+	// one line per pack that failed, with the reason
+	QStringList failures() const {
+		return mFailures;
+	}
+
+signals:
+	void progress(int pPacksDone, int pPacksTotal);
+	void finished(bool pSuccess);
+
+protected slots:
+	void packChecked(const QString &pPackName, const QString &pError, qint64 pBytesRead);
+	void finish();
+
+protected:
+	struct LedgerEntry {
+		LedgerEntry() : mSize(0), mModified(0), mLevel(0), mVerified(0) {}
+		qint64 mSize;
+		qint64 mModified; // all times in ms since epoch
+		int mLevel;
+		qint64 mVerified;
+	};
+	void loadLedger();
+	void saveLedger();
+
+	QString mPackDirPath;
+	QString mLedgerFilePath;
+	QHash<QString, LedgerEntry> mLedger;
+	qint64 mLastFullPass[2]; // per level, 0 if never
+	QHash<QString, LedgerEntry> mPending; // packs being checked now
+	QThreadPool mPool;
+	QAtomicInt mCancelled;
+	Level mLevel;
+	bool mFullPass;
+	int mPacksChecked;
+	int mPacksSkipped;
+	int mPacksTotal;
+	quint64 mBytesRead;
+	QStringList mFailures;
+};
+
+#endif // PACKVERIFIER_H
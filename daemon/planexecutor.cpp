@@ -20,6 +20,11 @@
 
 #include "planexecutor.h"
 #include "bupjob.h"
+#include "bupreplicator.h"
+#include "changejournal.h"
+#include "exclusionengine.h"
+#include "jobscheduler.h"
+#include "sizecalculator.h"
 #include "bupverificationjob.h"
 #include "buprepairjob.h"
 #include "rsyncjob.h"
@@ -27,16 +32,20 @@
 #include <QAction>
 #include <QDir>
 #include <QMenu>
+#include <QTextStream>
 #include <QTimer>
 
+#include <KDiskFreeSpaceInfo>
 #include <KFormat>
 #include <KLocalizedString>
 #include <KNotification>
 #include <KRun>
 
 PlanExecutor::PlanExecutor(BackupPlan *pPlan, QObject *pParent)
-   :QObject(pParent), mState(NOT_AVAILABLE), mPlan(pPlan), mQuestion(NULL),
-     mFailNotification(NULL), mIntegrityNotification(NULL), mRepairNotification(NULL)
+   :QObject(pParent), mState(NOT_AVAILABLE), mPlan(pPlan), mScheduler(NULL), mQuestion(NULL),
+     mFailNotification(NULL), mIntegrityNotification(NULL), mRepairNotification(NULL),
+     mChangeJournal(NULL), mTakenJournalWasComplete(false), mSizeCalculator(NULL), mReplicator(NULL),
+     mRunningJob(NULL), mUnsavedUsageTicks(0)
 {
 	QString lCachePath = QString::fromLocal8Bit(qgetenv("XDG_CACHE_HOME").constData());
 	if(lCachePath.isEmpty()) {
@@ -54,10 +63,35 @@ PlanExecutor::PlanExecutor(BackupPlan *pPlan, QObject *pParent)
 	mLogFilePath.append(QStringLiteral("/kup_plan"));
 	mLogFilePath.append(QString::number(mPlan->planNumber()));
 	mLogFilePath.append(QStringLiteral(".log"));
+	mMetricsFilePath = lCachePath;
+	mMetricsFilePath.append(QStringLiteral("/kup_plan"));
+	mMetricsFilePath.append(QString::number(mPlan->planNumber()));
+	mMetricsFilePath.append(QStringLiteral(".metrics"));
+	mLedgerFilePath = lCachePath;
+	mLedgerFilePath.append(QStringLiteral("/kup_plan"));
+	mLedgerFilePath.append(QString::number(mPlan->planNumber()));
+	mLedgerFilePath.append(QStringLiteral(".verified"));
+	mExclusionsFilePath = lCachePath;
+	mExclusionsFilePath.append(QStringLiteral("/kup_plan"));
+	mExclusionsFilePath.append(QString::number(mPlan->planNumber()));
+	mExclusionsFilePath.append(QStringLiteral(".exclusions"));
+
+	if(mPlan->mBackupType == BackupPlan::BupType) {
+		QString lJournalFilePath = lCachePath;
+		lJournalFilePath.append(QStringLiteral("/kup_plan"));
+		lJournalFilePath.append(QString::number(mPlan->planNumber()));
+		lJournalFilePath.append(QStringLiteral(".journal"));
+		mChangeJournal = new ChangeJournal(mPlan->mPathsIncluded, mPlan->mPathsExcluded, lJournalFilePath, this);
+	}
 
 	mRunBackupAction = new QAction(xi18nc("@action:inmenu", "Take Backup Now"), this);
 	mRunBackupAction->setEnabled(false);
-	connect(mRunBackupAction, SIGNAL(triggered()), SLOT(enterBackupRunningState()));
+	connect(mRunBackupAction, SIGNAL(triggered()), SLOT(startBackupManually()));
+
+	mPauseAction = new QAction(xi18nc("@action:inmenu", "Pause Backup"), this);
+	mPauseAction->setCheckable(true);
+	mPauseAction->setEnabled(false);
+	connect(mPauseAction, SIGNAL(toggled(bool)), SLOT(pauseBackup(bool)));
 
 	mShowFilesAction = new QAction(xi18nc("@action:inmenu", "Show Files"), this);
 	mShowFilesAction->setEnabled(false);
@@ -69,6 +103,7 @@ PlanExecutor::PlanExecutor(BackupPlan *pPlan, QObject *pParent)
 
 	mActionMenu = new QMenu(mPlan->mDescription);
 	mActionMenu->addAction(mRunBackupAction);
+	mActionMenu->addAction(mPauseAction);
 	mActionMenu->addAction(mShowFilesAction);
 	mActionMenu->addAction(mShowLogFileAction);
 
@@ -78,16 +113,30 @@ PlanExecutor::PlanExecutor(BackupPlan *pPlan, QObject *pParent)
 }
 
 PlanExecutor::~PlanExecutor() {
+	if(mUnsavedUsageTicks > 0) {
+		mPlan->saveState();
+	}
+	if(mScheduler != NULL) {
+		mScheduler->cancel(this);
+	}
 }
 
 QString PlanExecutor::currentActivityTitle() {
 	switch(mState) {
 	case BACKUP_RUNNING:
+		if(mRunningJob != NULL && mRunningJob->isSuspended()) {
+			return xi18nc("@info:tooltip", "Backup paused");
+		}
+		if(!mFolderToBackup.isEmpty()) {
+			return xi18nc("@info:tooltip %1 is a folder path", "Taking backup of %1", mFolderToBackup);
+		}
 		return xi18nc("@info:tooltip", "Taking new backup");
 	case INTEGRITY_TESTING:
 		return xi18nc("@info:tooltip", "Checking backup integrity");
 	case REPAIRING:
 		return xi18nc("@info:tooltip", "Repairing backups");
+	case BACKUP_QUEUED:
+		return xi18nc("@info:tooltip", "Waiting to take new backup");
 	default:
 		return QString();
 	}
@@ -156,6 +205,9 @@ void PlanExecutor::enterAvailableState() {
 
 void PlanExecutor::enterNotAvailableState() {
 	mSchedulingTimer->stop();
+	if(mState == BACKUP_QUEUED && mScheduler != NULL) {
+		mScheduler->cancel(this);
+	}
 	mShowFilesAction->setEnabled(false);
 	mRunBackupAction->setEnabled(false);
 	mState = NOT_AVAILABLE;
@@ -170,7 +222,7 @@ void PlanExecutor::askUser(const QString &pQuestion) {
 	QStringList lAnswers;
 	lAnswers << xi18nc("@action:button", "Yes") << xi18nc("@action:button", "No");
 	mQuestion->setActions(lAnswers);
-	connect(mQuestion, SIGNAL(action1Activated()), SLOT(enterBackupRunningState()));
+	connect(mQuestion, SIGNAL(action1Activated()), SLOT(startBackupManually()));
 	connect(mQuestion, SIGNAL(action2Activated()), SLOT(discardUserQuestion()));
 	connect(mQuestion, SIGNAL(closed()), SLOT(discardUserQuestion()));
 	connect(mQuestion, SIGNAL(ignored()), SLOT(discardUserQuestion()));
@@ -187,6 +239,89 @@ void PlanExecutor::discardUserQuestion() {
 	}
 }
 
+// How often the size of the destination is checked by walking all of it.
+static const int cFullSizeCheckInterval = 7 * 24 * 3600;
+
+void PlanExecutor::slotBackupDone(KJob *pJob) {
+	mRunningJob = NULL;
+	if(pJob->error() == KJob::KilledJobError) {
+		exitBackupRunningState(false);
+		return;
+	}
+	if(pJob->error()) {
+		notifyBackupFailed(pJob);
+		exitBackupRunningState(false);
+		return;
+	}
+	// the other sources were not looked at, this does not count as a complete backup.
+	if(mFolderToBackup.isEmpty()) {
+		mPlan->mLastCompleteBackup = QDateTime::currentDateTime().toUTC();
+	}
+	KDiskFreeSpaceInfo lSpaceInfo = KDiskFreeSpaceInfo::freeSpaceInfo(mDestinationPath);
+	if(lSpaceInfo.isValid())
+		mPlan->mLastAvailableSpace = (double)lSpaceInfo.available();
+	else
+		mPlan->mLastAvailableSpace = -1.0; //unknown size
+
+	BackupJob *lJob = qobject_cast<BackupJob *>(pJob);
+	bool lNeedsFullCheck = !mPlan->mLastFullSizeCheck.isValid() || mPlan->mLastBackupSize < 0.0 ||
+	                       mPlan->mLastFullSizeCheck.secsTo(mPlan->mLastCompleteBackup) > cFullSizeCheckInterval;
+	if(lJob != NULL && lJob->destinationSizeInfo() == BackupJob::SizeTotal) {
+		mPlan->mLastBackupSize = (double)lJob->destinationSize();
+		mPlan->mLastFullSizeCheck = mPlan->mLastCompleteBackup;
+		lNeedsFullCheck = false;
+	} else if(lJob != NULL && lJob->destinationSizeInfo() == BackupJob::SizeChange && mPlan->mLastBackupSize >= 0.0) {
+		mPlan->mLastBackupSize = qMax(0.0, mPlan->mLastBackupSize + lJob->destinationSize());
+	} else {
+		lNeedsFullCheck = true;
+	}
+	mPlan->saveState();
+	exitBackupRunningState(true);
+
+	if(lNeedsFullCheck && mSizeCalculator == NULL) {
+		mSizeCalculator = new SizeCalculator(mDestinationPath, this);
+		connect(mSizeCalculator, SIGNAL(finished()), SLOT(slotBackupSizeDone()));
+		mSizeCalculator->start(QThread::LowestPriority);
+	}
+
+	if(mPlan->mBackupType == BackupPlan::BupType && mPlan->mReplicate &&
+	   !mPlan->mReplicaDestinationPath.isEmpty() && mReplicator == NULL) {
+		mReplicator = new BupReplicator(mDestinationPath, mPlan->mReplicaDestinationPath.toLocalFile(), this);
+		connect(mReplicator, SIGNAL(finished()), SLOT(slotReplicationDone()));
+		mReplicator->start(QThread::LowestPriority);
+	}
+}
+
+void PlanExecutor::slotBackupSizeDone() {
+	if(mSizeCalculator->size() >= 0.0) {
+		mPlan->mLastBackupSize = mSizeCalculator->size();
+		mPlan->mLastFullSizeCheck = QDateTime::currentDateTime().toUTC();
+		mPlan->saveState();
+		emit backupStatusChanged();
+	}
+	mSizeCalculator->deleteLater();
+	mSizeCalculator = NULL;
+}
+
+void PlanExecutor::slotReplicationDone() {
+	// the backup job has closed the log file by now, add the outcome at the end.
+	QFile lLogFile(mLogFilePath);
+	if(lLogFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		QTextStream lLogStream(&lLogFile);
+		lLogStream << endl;
+		if(mReplicator->succeeded()) {
+			lLogStream << QStringLiteral("Replicated %1 files (%2) to %3").arg(mReplicator->filesCopied())
+			              .arg(KFormat().formatByteSize(mReplicator->bytesCopied()))
+			              .arg(mPlan->mReplicaDestinationPath.toLocalFile()) << endl;
+		} else {
+			lLogStream << QStringLiteral("Replication failed, will try again after next backup: ")
+			           << mReplicator->errorString() << endl;
+		}
+	}
+	mReplicator->deleteLater();
+	mReplicator = NULL;
+}
+
 void PlanExecutor::notifyBackupFailed(KJob *pFailedJob) {
 	discardFailNotification();
 	mFailNotification = new KNotification(QStringLiteral("BackupFailed"), KNotification::Persistent);
@@ -225,7 +360,9 @@ void PlanExecutor::startIntegrityCheck() {
 	if(mPlan->mBackupType != BackupPlan::BupType || busy() || mState == NOT_AVAILABLE) {
 		return;
 	}
-	KJob *lJob = new BupVerificationJob(*mPlan, mDestinationPath, mLogFilePath);
+	BupVerificationJob *lJob = new BupVerificationJob(*mPlan, mDestinationPath, mLogFilePath, mLedgerFilePath);
+	// only ever started on request of the user
+	lJob->setForceFullPass();
 	connect(lJob, SIGNAL(result(KJob*)), SLOT(integrityCheckFinished(KJob*)));
 	lJob->start();
 	mLastState = mState;
@@ -310,21 +447,87 @@ void PlanExecutor::discardRepairNotification() {
 }
 
 void PlanExecutor::enterBackupRunningState() {
+	requestBackup(JobScheduler::ScheduledPriority);
+}
+
+void PlanExecutor::startBackupManually() {
+	requestBackup(JobScheduler::ManualPriority);
+}
+
+void PlanExecutor::requestBackup(int pPriority) {
 	discardUserQuestion();
+	if(mState == BACKUP_RUNNING) {
+		return;
+	}
+	mRunBackupAction->setEnabled(false);
+	if(mScheduler == NULL) {
+		startQueuedBackup();
+		return;
+	}
+	mState = BACKUP_QUEUED;
+	emit stateChanged();
+	mScheduler->requestRun(this, pPriority);
+}
+
+PlanExecutor::FolderBackupStart PlanExecutor::startFolderBackup(const QString &pPath) {
+	if(mPlan->mBackupType != BackupPlan::BupType || mState == NOT_AVAILABLE || mState == BACKUP_RUNNING ||
+	      mState == INTEGRITY_TESTING || mState == REPAIRING) {
+		return FolderBackupRefused;
+	}
+	// bup save takes everything else from the index, which is only complete after a
+	// first backup. A backup already waiting in the queue includes the folder anyway.
+	FolderBackupStart lStart = CompleteBackupInstead;
+	if(mPlan->mLastCompleteBackup.isValid() && mState != BACKUP_QUEUED) {
+		mFolderToBackup = pPath;
+		lStart = FolderBackupStarted;
+	}
+	requestBackup(JobScheduler::FolderPriority);
+	return lStart;
+}
+
+void PlanExecutor::startQueuedBackup() {
 	mState = BACKUP_RUNNING;
 	emit stateChanged();
-	mRunBackupAction->setEnabled(false);
 	startBackup();
 }
 
+void PlanExecutor::pauseBackup(bool pPaused) {
+	if(mRunningJob == NULL) {
+		return;
+	}
+	if(pPaused) {
+		mRunningJob->suspend();
+	} else {
+		mRunningJob->resume();
+	}
+	emit stateChanged();
+}
+
+// The job emits its result once its processes have exited, the destination
+// may have become unavailable by then.
+void PlanExecutor::stopRunningBackup() {
+	if(mState == BACKUP_RUNNING && mRunningJob != NULL) {
+		mPauseAction->setEnabled(false);
+		mRunningJob->kill(KJob::EmitResult);
+	}
+}
+
 void PlanExecutor::exitBackupRunningState(bool pWasSuccessful) {
-	mRunBackupAction->setEnabled(true);
+	bool lWasFolderBackup = !mFolderToBackup.isEmpty();
+	mFolderToBackup.clear();
+	if(mScheduler != NULL) {
+		mScheduler->jobFinished(this);
+	}
+	mRunBackupAction->setEnabled(mState != NOT_AVAILABLE);
+	mPauseAction->setEnabled(false);
+	mPauseAction->setChecked(false);
 	mShowLogFileAction->setEnabled(QFileInfo(mLogFilePath).exists());
 	if(pWasSuccessful) {
-		if(mPlan->mScheduleType == BackupPlan::USAGE) {
+		if(mPlan->mScheduleType == BackupPlan::USAGE && !lWasFolderBackup) {
 			//reset usage time after successful backup
 			mPlan->mAccumulatedUsageTime =0;
-			mPlan->save();
+			mUnsavedUsageTicks = 0;
+			mPlan->saveState();
 		}
 		mState = WAITING_FOR_BACKUP_AGAIN;
 		emit stateChanged();
@@ -334,7 +537,7 @@ void PlanExecutor::exitBackupRunningState(bool pWasSuccessful) {
 
 		// re-enter the main "available" state dispatcher
 		enterAvailableState();
-	} else {
+	} else if(mState != NOT_AVAILABLE) {
 		mState = WAITING_FOR_MANUAL_BACKUP;
 		emit stateChanged();
 	}
@@ -347,7 +550,11 @@ void PlanExecutor::updateAccumulatedUsageTime() {
 
 	if(mPlan->mScheduleType == BackupPlan::USAGE) {
 		mPlan->mAccumulatedUsageTime += KUP_USAGE_MONITOR_INTERVAL_S;
-		mPlan->save();
+		// the rest is saved when the daemon exits, only lost if it gets killed.
+		if(++mUnsavedUsageTicks >= KUP_USAGE_SAVE_TICKS) {
+			mUnsavedUsageTicks = 0;
+			mPlan->saveState();
+		}
 	}
 
 	// trigger refresh of backup status, potentially changed since some time has passed...
@@ -376,11 +583,50 @@ void PlanExecutor::showFilesClicked() {
 }
 
 BackupJob *PlanExecutor::createBackupJob() {
+	BackupJob *lJob = NULL;
 	if(mPlan->mBackupType == BackupPlan::BupType) {
-		return new BupJob(*mPlan, mDestinationPath, mLogFilePath);
+		BupJob *lBupJob = new BupJob(*mPlan, mDestinationPath, mLogFilePath, mLedgerFilePath);
+		if(!mFolderToBackup.isEmpty()) {
+			// changes elsewhere stay in the journal for the next complete backup.
+			lBupJob->setChangedPaths(QStringList() << mFolderToBackup);
+			lBupJob->setFolderBackup();
+			lBupJob->setUrgent();
+		} else {
+			mTakenJournalWasComplete = mChangeJournal->takeChangedPaths(mTakenChangedPaths);
+			if(mTakenJournalWasComplete) {
+				lBupJob->setChangedPaths(mTakenChangedPaths);
+			}
+			connect(lBupJob, SIGNAL(result(KJob*)), SLOT(returnChangedPaths(KJob*)));
+		}
+		lJob = lBupJob;
 	} else if(mPlan->mBackupType == BackupPlan::RsyncType) {
-		return new RsyncJob(*mPlan, mDestinationPath, mLogFilePath);
+		lJob = new RsyncJob(*mPlan, mDestinationPath, mLogFilePath);
+	} else {
+		qWarning("Invalid backup type in configuration!");
+		return NULL;
+	}
+	lJob->setExclusionStateFilePath(mExclusionsFilePath);
+	connect(lJob, SIGNAL(result(KJob*)), SLOT(recordMetrics(KJob*)));
+	mRunningJob = lJob;
+	mPauseAction->setEnabled(true);
+	return lJob;
+}
+
+void PlanExecutor::returnChangedPaths(KJob *pJob) {
+	if(pJob->error()) {
+		mChangeJournal->restoreChangedPaths(mTakenChangedPaths, mTakenJournalWasComplete);
+	} else if(mTakenJournalWasComplete) {
+		ExclusionEngine::recordChanges(mExclusionsFilePath, mPlan->mPathsIncluded, mTakenChangedPaths);
+	}
+	mTakenChangedPaths.clear();
+}
+
+void PlanExecutor::recordMetrics(KJob *pJob) {
+	BackupJob *lJob = qobject_cast<BackupJob *>(pJob);
+	if(lJob == NULL || lJob->metrics().mPhases.isEmpty()) {
+		return;
 	}
-	qWarning("Invalid backup type in configuration!");
-	return NULL;
+	BackupRunMetrics lRun = lJob->metrics();
+	lRun.mResult = lJob->error();
+	BackupMetrics(mMetricsFilePath).append(lRun);
 }
@@ -26,6 +26,11 @@
 
 #include <KProcess>
 
+class BupReplicator;
+class ChangeJournal;
+class JobScheduler;
+class SizeCalculator;
+
 class KRun;
 class KNotification;
 class KProcess;
@@ -38,6 +43,8 @@ class QTimer;
 // Consider user inactive after KUP_IDLE_TIMEOUT_S s of no keyboard or mouse activity.
 #define KUP_USAGE_MONITOR_INTERVAL_S 2*60
 #define KUP_IDLE_TIMEOUT_S 30
+// Save the accumulated usage time every KUP_USAGE_SAVE_TICKS intervals.
+#define KUP_USAGE_SAVE_TICKS 5
 
 class PlanExecutor : public QObject
 {
@@ -51,19 +58,30 @@ public:
 	}
 
 	bool busy() {
-		return mState == BACKUP_RUNNING || mState == INTEGRITY_TESTING || mState == REPAIRING;
+		return mState == BACKUP_RUNNING || mState == INTEGRITY_TESTING || mState == REPAIRING ||
+		      mState == BACKUP_QUEUED;
 	}
 
 	QString currentActivityTitle();
+	// Takes a backup where only pPath is indexed again, the rest of the sources
+	// are saved as they were last time. Goes ahead of other queued backups.
+	// A complete backup is taken instead if there is none yet or one is already
+	// waiting in the queue.
+	enum FolderBackupStart {FolderBackupRefused, FolderBackupStarted, CompleteBackupInstead};
+	FolderBackupStart startFolderBackup(const QString &pPath);
 
 	enum ExecutorState {NOT_AVAILABLE, WAITING_FOR_FIRST_BACKUP,
 		                 WAITING_FOR_BACKUP_AGAIN, BACKUP_RUNNING, WAITING_FOR_MANUAL_BACKUP,
-		                 INTEGRITY_TESTING, REPAIRING};
+		                 INTEGRITY_TESTING, REPAIRING, BACKUP_QUEUED};
 	ExecutorState mState;
 	QString mDestinationPath;
 	QString mLogFilePath;
+	QString mMetricsFilePath;
+	QString mLedgerFilePath; // packs already verified
+	QString mExclusionsFilePath;
 	BackupPlan *mPlan;
 	QMenu *mActionMenu;
+	JobScheduler *mScheduler;
 
 public slots:
 	virtual void checkStatus() = 0;
@@ -71,6 +89,8 @@ public slots:
 	void updateAccumulatedUsageTime();
 	void startIntegrityCheck();
 	void startRepairJob();
+	// called by the scheduler when it is this executor's turn to run a backup.
+	void startQueuedBackup();
 
 signals:
 	void stateChanged();
@@ -80,6 +100,8 @@ protected slots:
 	virtual void startBackup() = 0;
 
 	void enterBackupRunningState();
+	void startBackupManually();
+	void pauseBackup(bool pPaused);
 	void exitBackupRunningState(bool pWasSuccessful);
 	void enterAvailableState();
 	void enterNotAvailableState();
@@ -87,6 +109,9 @@ protected slots:
 	void askUser(const QString &pQuestion);
 	void discardUserQuestion();
 
+	void slotBackupDone(KJob *pJob);
+	void slotBackupSizeDone();
+	void slotReplicationDone();
 	void notifyBackupFailed(KJob *pFailedJob);
 	void discardFailNotification();
 
@@ -95,12 +120,18 @@ protected slots:
 	void discardIntegrityNotification();
 	void repairFinished(KJob *pJob);
 	void discardRepairNotification();
+	void recordMetrics(KJob *pJob);
+	void returnChangedPaths(KJob *pJob);
 
 protected:
 	BackupJob *createBackupJob();
+	void requestBackup(int pPriority);
+	// Ends a running backup job without telling the user about it as a failure.
+	void stopRunningBackup();
 
 	QAction *mShowFilesAction;
 	QAction *mRunBackupAction;
+	QAction *mPauseAction;
 	QAction *mShowLogFileAction;
 	KNotification *mQuestion;
 	QTimer *mSchedulingTimer;
@@ -108,6 +139,15 @@ protected:
 	KNotification *mIntegrityNotification;
 	KNotification *mRepairNotification;
 	ExecutorState mLastState;
+	ChangeJournal *mChangeJournal;
+	// what was handed to the running backup job, given back if it fails.
+	QStringList mTakenChangedPaths;
+	bool mTakenJournalWasComplete;
+	SizeCalculator *mSizeCalculator;
+	BupReplicator *mReplicator;
+	BackupJob *mRunningJob;
+	int mUnsavedUsageTicks;
+	QString mFolderToBackup;
 };
 
 #endif // PLANEXECUTOR_H
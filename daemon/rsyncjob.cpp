@@ -19,26 +19,29 @@
  ***************************************************************************/
 
 #include "rsyncjob.h"
+#include "toolcapabilities.h"
 
-#include <QTimer>
+#include <QRegularExpression>
 
 #include <KLocalizedString>
 
 RsyncJob::RsyncJob(const BackupPlan &pBackupPlan, const QString &pDestinationPath, const QString &pLogFilePath)
    :BackupJob(pBackupPlan, pDestinationPath, pLogFilePath)
 {
-	mRsyncProcess.setOutputChannelMode(KProcess::SeparateChannels);
+	// progress is printed on stdout, errors on stderr. Both end up in the log.
+	mRsyncProcess.setOutputChannelMode(KProcess::MergedChannels);
+	watchOutput(&mRsyncProcess);
 }
 
 void RsyncJob::start() {
-	QTimer::singleShot(0, this, SLOT(startRsync()));
+	connect(ToolCapabilities::instance(), SIGNAL(ready()), SLOT(startRsync()), Qt::UniqueConnection);
+	ToolCapabilities::instance()->probe();
 }
 
 void RsyncJob::startRsync() {
-	KProcess lVersionProcess;
-	lVersionProcess.setOutputChannelMode(KProcess::SeparateChannels);
-	lVersionProcess << QStringLiteral("rsync") << QStringLiteral("--version");
-	if(lVersionProcess.execute() < 0) {
+	ToolCapabilities *lTools = ToolCapabilities::instance();
+	disconnect(lTools, SIGNAL(ready()), this, SLOT(startRsync()));
+	if(lTools->rsyncVersion().isEmpty()) {
 		setError(ErrorWithoutLog);
 		setErrorText(xi18nc("@info notification",
 		                    "The <application>rsync</application> program is needed but could not be found, "
@@ -50,27 +53,41 @@ void RsyncJob::startRsync() {
 	mLogStream << QStringLiteral("Kup is starting rsync backup job at ")
 	           << QLocale().toString(QDateTime::currentDateTime())
 	           << endl;
+	startExclusionScan(NULL, SLOT(startRsyncProcess()));
+}
 
+void RsyncJob::startRsyncProcess() {
+	ToolCapabilities *lTools = ToolCapabilities::instance();
+	logExclusions();
 	mRsyncProcess << QStringLiteral("rsync") << QStringLiteral("-aR");
+	// --info was added in rsync 3.1.0
+	if(lTools->rsyncVersionAtLeast(3, 1)) {
+		mRsyncProcess << QStringLiteral("--info=progress2");
+	}
 	mRsyncProcess << QStringLiteral("--delete") << QStringLiteral("--delete-excluded");
+	// the summary tells how big the destination is afterwards, no need to walk it.
+	mRsyncProcess << QStringLiteral("--stats");
 	foreach(QString lExclude, mBackupPlan.mPathsExcluded) {
 		mRsyncProcess << QString(QStringLiteral("--exclude=%1")).arg(lExclude);
 	}
+	mRsyncProcess << mExclusionEngine->rsyncArguments();
 	mRsyncProcess << mBackupPlan.mPathsIncluded;
 	mRsyncProcess << mDestinationPath;
 
 	connect(&mRsyncProcess, SIGNAL(started()), SLOT(slotRsyncStarted()));
 	connect(&mRsyncProcess, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(slotRsyncFinished(int,QProcess::ExitStatus)));
 	mLogStream << quoteArgs(mRsyncProcess.program()) << endl;
+	startPhase(QStringLiteral("rsync"));
 	mRsyncProcess.start();
 }
 
 void RsyncJob::slotRsyncStarted() {
-	makeNice(mRsyncProcess.pid());
+	throttleProcess(mRsyncProcess.pid());
 }
 
 void RsyncJob::slotRsyncFinished(int pExitCode, QProcess::ExitStatus pExitStatus) {
-	mLogStream << QString::fromUtf8(mRsyncProcess.readAllStandardError());
+	flushOutput(&mRsyncProcess);
+	endPhase(pExitCode, pExitStatus);
 	if(pExitStatus != QProcess::NormalExit || pExitCode != 0) {
 		mLogStream << endl << QStringLiteral("Kup did not successfully complete the rsync backup job.") << endl;
 		setErrorText(xi18nc("@info notification", "Saving backup did not complete successfully. "
@@ -84,3 +101,51 @@ void RsyncJob::slotRsyncFinished(int pExitCode, QProcess::ExitStatus pExitStatus
 	emitResult();
 }
 
+bool RsyncJob::doKill() {
+	if(!BackupJob::doKill()) {
+		return false;
+	}
+	// rsync removes its partially written temporary file when terminated.
+	terminateProcesses(QList<KProcess *>() << &mRsyncProcess, QStringLiteral("Kup interrupted the rsync backup job."));
+	return false; // result is emitted when rsync has exited
+}
+
+void RsyncJob::parseProgress(const QString &pLine) {
+	// For example: "    123,456,789  45%   12.34MB/s    0:01:23 (xfr#12, to-chk=100/2000)"
+	static const QRegularExpression lProgressRegExp(
+	         QStringLiteral("^\\s*([\\d,]+)\\s+(\\d+)%\\s+([\\d.]+)([kMGT]?)B/s(?:.*xfr#(\\d+), \\w+-chk=(\\d+)/(\\d+))?"));
+	static const QRegularExpression lTotalSizeRegExp(QStringLiteral("^Total file size: ([\\d,]+) bytes"));
+
+	QRegularExpressionMatch lMatch = lTotalSizeRegExp.match(pLine);
+	if(lMatch.hasMatch()) {
+		mDestinationSizeInfo = SizeTotal;
+		mDestinationSize = lMatch.captured(1).remove(QLatin1Char(',')).toLongLong();
+		return;
+	}
+	lMatch = lProgressRegExp.match(pLine);
+	if(!lMatch.hasMatch()) {
+		return;
+	}
+	qulonglong lBytes = lMatch.captured(1).remove(QLatin1Char(',')).toULongLong();
+	int lPercent = lMatch.captured(2).toInt();
+	if(lPercent > 0) {
+		setTotalAmount(KJob::Bytes, lBytes * 100 / lPercent);
+	}
+	setProcessedAmount(KJob::Bytes, lBytes);
+	// rsync only tells how much it has transferred, that is both read and written.
+	currentPhase().mBytesRead = lBytes;
+	currentPhase().mBytesWritten = lBytes;
+	if(!lMatch.captured(5).isEmpty()) {
+		qulonglong lTotalFiles = lMatch.captured(7).toULongLong();
+		setTotalAmount(KJob::Files, lTotalFiles);
+		setProcessedAmount(KJob::Files, lTotalFiles - lMatch.captured(6).toULongLong());
+		currentPhase().mFilesScanned = processedAmount(KJob::Files);
+		currentPhase().mFilesChanged = lMatch.captured(5).toULongLong();
+	}
+	double lSpeed = lMatch.captured(3).toDouble();
+	int lPrefixIndex = lMatch.captured(4).isEmpty() ? -1 : QStringLiteral("kMGT").indexOf(lMatch.captured(4));
+	for(int i = 0; i <= lPrefixIndex; ++i) {
+		lSpeed *= 1024;
+	}
+	emitSpeed((unsigned long)lSpeed);
+}
@@ -38,10 +38,13 @@ public slots:
 	void startRsync();
 
 protected slots:
+	void startRsyncProcess();
 	void slotRsyncStarted();
 	void slotRsyncFinished(int pExitCode, QProcess::ExitStatus pExitStatus);
 
 protected:
+	virtual bool doKill();
+	virtual void parseProgress(const QString &pLine);
 	KProcess mRsyncProcess;
 };
 
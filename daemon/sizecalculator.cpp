@@ -0,0 +1,82 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "sizecalculator.h"
+
+#include <QFile>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+SizeCalculator::SizeCalculator(const QString &pPath, QObject *pParent)
+   : QThread(pParent), mPath(pPath), mSize(-1.0)
+{
+}
+
+SizeCalculator::~SizeCalculator() {
+	requestInterruption();
+	wait();
+}
+
+void SizeCalculator::run() {
+#ifdef Q_OS_LINUX
+	// idle I/O class for this thread only, see Documentation/block/ioprio.txt
+	syscall(SYS_ioprio_set, 1, syscall(SYS_gettid), 3 << 13 | 7);
+#endif
+	quint64 lTotal = 0;
+	QList<QByteArray> lFolders;
+	lFolders.append(QFile::encodeName(mPath));
+	while(!lFolders.isEmpty()) {
+		if(isInterruptionRequested()) {
+			return;
+		}
+		QByteArray lFolder = lFolders.takeLast();
+		DIR *lDir = opendir(lFolder.constData());
+		if(lDir == NULL) {
+			if(lFolders.isEmpty() && lTotal == 0) {
+				return; // destination itself not readable, maybe unmounted
+			}
+			continue;
+		}
+		struct dirent *lEntry;
+		while((lEntry = readdir(lDir)) != NULL) {
+			if(0 == strcmp(lEntry->d_name, ".") || 0 == strcmp(lEntry->d_name, "..")) {
+				continue;
+			}
+			struct stat lStat;
+			if(0 != fstatat(dirfd(lDir), lEntry->d_name, &lStat, AT_SYMLINK_NOFOLLOW)) {
+				continue;
+			}
+			if(S_ISDIR(lStat.st_mode)) {
+				lFolders.append(lFolder + '/' + lEntry->d_name);
+			} else {
+				lTotal += lStat.st_size;
+			}
+		}
+		closedir(lDir);
+	}
+	mSize = (double)lTotal;
+}
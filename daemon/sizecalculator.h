@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SIZECALCULATOR_H
+#define SIZECALCULATOR_H
+
+#include <QThread>
+
+// Adds up the size of all files below a folder, in a separate thread and with
+// idle I/O priority. Used for occasionally checking the real size of a backup
+// destination, normally it is only updated with what each backup added.
+class SizeCalculator : public QThread
+{
+	Q_OBJECT
+
+public:
+	SizeCalculator(const QString &pPath, QObject *pParent);
+	virtual ~SizeCalculator();
+	// valid after the finished() signal, negative if the walk did not complete.
+	double size() const {
+		return mSize;
+	}
+
+protected:
+	virtual void run();
+	QString mPath;
+	double mSize;
+};
+
+#endif // SIZECALCULATOR_H
@@ -0,0 +1,471 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "throttlecontroller.h"
+#include "blockdevice.h"
+#include "planexecutor.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+
+#include <KFormat>
+#include <KIdleTime>
+#include <Solid/PowerManagement>
+
+#include <signal.h>
+#include <unistd.h>
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+// Limits while the user is active, a quarter of one CPU and 20MiB/s per disk.
+static const char cThrottledCpuMax[] = "25000 100000";
+static const char cThrottledIoMax[] = "rbps=20971520 wbps=20971520";
+// Without cgroups the processes get stopped, they run this long out of each second.
+static const int cDutyCycleRunTime = 250;
+
+namespace {
+
+bool cgroupFileHasWords(const QString &pFilePath, const QList<QByteArray> &pWords) {
+	QFile lFile(pFilePath);
+	if(!lFile.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	QList<QByteArray> lWords = lFile.readAll().simplified().split(' ');
+	foreach(const QByteArray &lWord, pWords) {
+		if(!lWords.contains(lWord)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool writeFile(const QString &pFilePath, const QByteArray &pContent) {
+	QFile lFile(pFilePath);
+	if(!lFile.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+		return false;
+	}
+	return lFile.write(pContent) == pContent.size();
+}
+
+// The cgroup v2 group the daemon runs in, below /sys/fs/cgroup. Empty if not known.
+QString ownCgroup() {
+	QFile lOwnCgroup(QStringLiteral("/proc/self/cgroup"));
+	if(!lOwnCgroup.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		return QString();
+	}
+	forever {
+		QByteArray lLine = lOwnCgroup.readLine();
+		if(lLine.isEmpty()) {
+			return QString();
+		}
+		if(lLine.startsWith("0::")) { // the cgroup v2 hierarchy
+			return QFile::decodeName(lLine.mid(3).trimmed());
+		}
+	}
+}
+
+// State of the delegated cgroup, shared by all throttle controllers of the daemon.
+int sCgroupUsers = 0;
+bool sCgroupUnusable = false;
+QString sCgroupPath;
+QString sLeafPath; // only set if the daemon moved itself into it
+
+// Undoes the changes to the delegated cgroup when the last controller is done with
+// it, the daemon goes back to its own group and the leaf is removed.
+void releaseDelegatedCgroup() {
+	if(sCgroupUsers == 0 || --sCgroupUsers > 0) {
+		return;
+	}
+	if(!sLeafPath.isEmpty()) {
+		writeFile(sCgroupPath + QStringLiteral("/cgroup.subtree_control"), "-cpu -io");
+		if(!writeFile(sCgroupPath + QStringLiteral("/cgroup.procs"), QByteArray::number(getpid())) ||
+		   !QDir().rmdir(sLeafPath)) {
+			qWarning("Could not remove the leaf cgroup of the daemon.");
+		}
+		sLeafPath.clear();
+	}
+	sCgroupPath.clear();
+}
+
+// Finds the cgroup v2 group the daemon has been delegated and prepares it for
+// having sub-groups with the cpu and io controllers. Controllers can only be
+// enabled for sub-groups of a group without processes of its own, so the daemon
+// first moves itself into a leaf group "kup-daemon" below it. Backup processes
+// then get groups next to that leaf. Only done in a systemd scope or service
+// started for Kup, with no other processes in it. Returns an empty string if
+// not possible, then the throttling falls back to stopping the processes.
+QString acquireDelegatedCgroup() {
+	if(sCgroupUsers > 0) {
+		++sCgroupUsers;
+		return sCgroupPath;
+	}
+	if(sCgroupUnusable) {
+		return QString();
+	}
+	sCgroupUnusable = true; // until it has worked out
+	QString lCgroup = ownCgroup();
+	if(lCgroup.isEmpty()) {
+		qWarning("Not running in a cgroup v2 hierarchy, backups will be throttled by stopping them periodically.");
+		return QString();
+	}
+	QString lUnit = lCgroup.section(QLatin1Char('/'), -1);
+	if(!lUnit.contains(QStringLiteral("kup"), Qt::CaseInsensitive) ||
+	   !(lUnit.endsWith(QStringLiteral(".scope")) || lUnit.endsWith(QStringLiteral(".service")))) {
+		qWarning("The daemon does not run in a cgroup of its own, backups will be throttled by "
+		         "stopping them periodically.");
+		return QString();
+	}
+	QString lPath = QStringLiteral("/sys/fs/cgroup") + lCgroup;
+	// Moving processes between sub-groups needs write access to cgroup.procs of
+	// the group containing both, which is only given if the group is delegated.
+	if(0 != access(QFile::encodeName(lPath + QStringLiteral("/cgroup.procs")).constData(), W_OK) ||
+	   0 != access(QFile::encodeName(lPath + QStringLiteral("/cgroup.subtree_control")).constData(), W_OK)) {
+		qWarning("The cgroup of the daemon has not been delegated to it, backups will be throttled by "
+		         "stopping them periodically.");
+		return QString();
+	}
+	if(!cgroupFileHasWords(lPath + QStringLiteral("/cgroup.subtree_control"), QList<QByteArray>() << "cpu" << "io")) {
+		QByteArray lOwnPid = QByteArray::number(getpid());
+		QFile lProcs(lPath + QStringLiteral("/cgroup.procs"));
+		if(!lProcs.open(QIODevice::ReadOnly) || lProcs.readAll().simplified() != lOwnPid) {
+			qWarning("Other processes share the cgroup of the daemon, backups will be throttled by "
+			         "stopping them periodically.");
+			return QString();
+		}
+		QString lLeafPath = lPath + QStringLiteral("/kup-daemon");
+		if(!QDir().exists(lLeafPath) && !QDir().mkdir(lLeafPath)) {
+			qWarning("Could not create a leaf cgroup for the daemon, backups will be throttled by "
+			         "stopping them periodically.");
+			return QString();
+		}
+		if(!writeFile(lLeafPath + QStringLiteral("/cgroup.procs"), lOwnPid)) {
+			qWarning("Could not move the daemon into a leaf cgroup, backups will be throttled by "
+			         "stopping them periodically.");
+			QDir().rmdir(lLeafPath);
+			return QString();
+		}
+		sLeafPath = lLeafPath;
+		sCgroupPath = lPath;
+		if(!writeFile(lPath + QStringLiteral("/cgroup.subtree_control"), "+cpu +io") ||
+		   !cgroupFileHasWords(lPath + QStringLiteral("/cgroup.subtree_control"), QList<QByteArray>() << "cpu" << "io")) {
+			qWarning("Could not enable the cpu and io cgroup controllers, backups will be throttled by "
+			         "stopping them periodically.");
+			sCgroupUsers = 1;
+			releaseDelegatedCgroup();
+			sCgroupUnusable = true;
+			return QString();
+		}
+	}
+	sCgroupUnusable = false;
+	sCgroupPath = lPath;
+	sCgroupUsers = 1;
+	return sCgroupPath;
+}
+
+
+}
+
+ThrottleController::ThrottleController(KJob *pJob, const QStringList &pPaths)
+   : QObject(pJob), mStopped(false), mPauseReasons(0), mPauseOnBattery(false), mPauseWhileActive(false),
+     mKeepFullSpeed(false), mReleased(false), mUsesDelegatedCgroup(false), mLastProcessedBytes(0)
+{
+	mTime[FullSpeed] = mTime[Throttled] = 0;
+	mBytes[FullSpeed] = mBytes[Throttled] = 0;
+	mDutyCycleTimer = new QTimer(this);
+	mDutyCycleTimer->setSingleShot(true);
+	connect(mDutyCycleTimer, SIGNAL(timeout()), SLOT(toggleStopped()));
+	setupCgroup(pPaths);
+
+	mIdleTimeoutId = KIdleTime::instance()->addIdleTimeout(KUP_IDLE_TIMEOUT_S * 1000);
+	connect(KIdleTime::instance(), SIGNAL(timeoutReached(int)), SLOT(idleTimeoutReached(int)));
+	connect(KIdleTime::instance(), SIGNAL(resumingFromIdle()), SLOT(resumingFromIdle()));
+	connect(pJob, SIGNAL(processedAmount(KJob*,KJob::Unit,qulonglong)),
+	        SLOT(updateProcessedAmount(KJob*,KJob::Unit,qulonglong)));
+	if(KIdleTime::instance()->idleTime() >= KUP_IDLE_TIMEOUT_S * 1000) {
+		mMode = FullSpeed;
+		KIdleTime::instance()->catchNextResumeEvent();
+	} else {
+		mMode = Throttled;
+	}
+	mModeTimer.start();
+}
+
+ThrottleController::~ThrottleController() {
+	KIdleTime::instance()->removeIdleTimeout(mIdleTimeoutId);
+	releaseProcesses();
+	if(!mCgroupPath.isEmpty()) {
+		// only succeeds if all processes have exited, the cgroup is left behind otherwise.
+		QDir().rmdir(mCgroupPath);
+	}
+	if(mUsesDelegatedCgroup) {
+		releaseDelegatedCgroup();
+	}
+}
+
+void ThrottleController::setProcess(int pPid) {
+	mPids.clear();
+	mStopped = false;
+	addProcess(pPid);
+}
+
+void ThrottleController::addProcess(int pPid) {
+	mPids.append(pPid);
+	if(!mCgroupPath.isEmpty() && !writeCgroupFile(QStringLiteral("cgroup.procs"), QByteArray::number(pPid))) {
+		QDir().rmdir(mCgroupPath);
+		mCgroupPath.clear();
+	}
+	apply();
+	if(isPaused()) {
+		applyPause();
+	}
+}
+
+void ThrottleController::removeProcess(int pPid) {
+	mPids.removeAll(pPid);
+}
+
+QString ThrottleController::throughputSummary() {
+	accountTime();
+	QString lSummary;
+	KFormat lFormat;
+	const char *lModeNames[] = {"user away, running at full speed", "user active, throttled"};
+	for(int i = FullSpeed; i <= Throttled; ++i) {
+		if(mTime[i] < 1000) {
+			continue;
+		}
+		lSummary += QStringLiteral("Throughput while %1: %2/s during %3\n")
+		            .arg(QLatin1String(lModeNames[i]))
+		            .arg(lFormat.formatByteSize((double)mBytes[i] * 1000 / mTime[i]))
+		            .arg(lFormat.formatDuration(mTime[i]));
+	}
+	return lSummary;
+}
+
+void ThrottleController::setPaused(PauseReason pReason, bool pPaused) {
+	if(mReleased) {
+		return;
+	}
+	bool lWasPaused = isPaused();
+	if(pPaused) {
+		mPauseReasons |= pReason;
+	} else {
+		mPauseReasons &= ~pReason;
+	}
+	if(isPaused() == lWasPaused || mPids.isEmpty()) {
+		return;
+	}
+	applyPause();
+	if(!isPaused()) {
+		apply();
+	}
+}
+
+void ThrottleController::setPauseConditions(bool pOnBattery, bool pWhileActive) {
+	mPauseOnBattery = pOnBattery;
+	mPauseWhileActive = pWhileActive;
+	if(mPauseOnBattery) {
+		connect(Solid::PowerManagement::notifier(), SIGNAL(appShouldConserveResourcesChanged(bool)),
+		        SLOT(powerStateChanged(bool)), Qt::UniqueConnection);
+	}
+	setPaused(PausedOnBattery, mPauseOnBattery && Solid::PowerManagement::appShouldConserveResources());
+	setPaused(PausedWhileActive, mPauseWhileActive && mMode == Throttled);
+}
+
+void ThrottleController::releaseProcesses() {
+	mReleased = true;
+	mDutyCycleTimer->stop();
+	mPauseReasons = 0;
+	if(mPids.isEmpty()) {
+		return;
+	}
+	if(!mCgroupPath.isEmpty()) {
+		writeCgroupFile(QStringLiteral("cgroup.freeze"), "0");
+	}
+	// paused without cgroup.freeze or stopped by the duty cycle, continuing a
+	// running process does no harm.
+	signalProcesses(SIGCONT);
+	mStopped = false;
+}
+
+void ThrottleController::keepFullSpeed() {
+	setMode(FullSpeed);
+	mKeepFullSpeed = true;
+}
+
+void ThrottleController::idleTimeoutReached(int pIdentifier) {
+	if(pIdentifier != mIdleTimeoutId) {
+		return;
+	}
+	KIdleTime::instance()->catchNextResumeEvent();
+	setMode(FullSpeed);
+}
+
+void ThrottleController::resumingFromIdle() {
+	setMode(Throttled);
+}
+
+void ThrottleController::toggleStopped() {
+	if(mMode != Throttled || mPids.isEmpty() || isPaused() || mReleased) {
+		return;
+	}
+	if(mStopped) {
+		signalProcesses(SIGCONT);
+		mStopped = false;
+		mDutyCycleTimer->start(cDutyCycleRunTime);
+	} else {
+		signalProcesses(SIGSTOP);
+		mStopped = true;
+		mDutyCycleTimer->start(1000 - cDutyCycleRunTime);
+	}
+}
+
+void ThrottleController::updateProcessedAmount(KJob *pJob, KJob::Unit pUnit, qulonglong pAmount) {
+	Q_UNUSED(pJob)
+	if(pUnit != KJob::Bytes) {
+		return;
+	}
+	// the amount starts over from zero when the job goes to a new phase.
+	mBytes[mMode] += pAmount >= mLastProcessedBytes ? pAmount - mLastProcessedBytes : pAmount;
+	mLastProcessedBytes = pAmount;
+}
+
+void ThrottleController::powerStateChanged(bool pConserveResources) {
+	setPaused(PausedOnBattery, mPauseOnBattery && pConserveResources);
+}
+
+void ThrottleController::setMode(Mode pMode) {
+	if(pMode == mMode || mKeepFullSpeed) {
+		return;
+	}
+	accountTime();
+	mMode = pMode;
+	apply();
+	if(mPauseWhileActive) {
+		setPaused(PausedWhileActive, mMode == Throttled);
+	}
+}
+
+void ThrottleController::apply() {
+	if(mPids.isEmpty() || mReleased) {
+		return;
+	}
+#ifdef Q_OS_LINUX
+	// idle I/O class while throttled, lowest best-effort priority otherwise.
+	// See linux documentation Documentation/block/ioprio.txt for details of the syscall
+	int lIoPriority = mMode == Throttled ? 3 << 13 | 7 : 2 << 13 | 7;
+	foreach(int lPid, processTree()) {
+		syscall(SYS_ioprio_set, 1, lPid, lIoPriority);
+	}
+#endif
+	if(!mCgroupPath.isEmpty()) {
+		writeCgroupFile(QStringLiteral("cpu.max"), mMode == Throttled ? cThrottledCpuMax : "max 100000");
+		foreach(const QString &lDevice, mDiskDevices) {
+			writeCgroupFile(QStringLiteral("io.max"), lDevice.toLatin1() + ' ' +
+			                (mMode == Throttled ? cThrottledIoMax : "rbps=max wbps=max"));
+		}
+	} else if(isPaused()) {
+		// stopped until the pause ends, the duty cycle starts over after that.
+	} else if(mMode == Throttled) {
+		if(!mDutyCycleTimer->isActive()) {
+			mDutyCycleTimer->start(cDutyCycleRunTime);
+		}
+	} else {
+		mDutyCycleTimer->stop();
+		if(mStopped) {
+			signalProcesses(SIGCONT);
+			mStopped = false;
+		}
+	}
+}
+
+void ThrottleController::applyPause() {
+	// cgroup.freeze needs linux 5.2, the processes are stopped with signals without it.
+	if(!mCgroupPath.isEmpty() &&
+	   writeCgroupFile(QStringLiteral("cgroup.freeze"), isPaused() ? QByteArray("1") : QByteArray("0"))) {
+		return;
+	}
+	mDutyCycleTimer->stop();
+	signalProcesses(isPaused() ? SIGSTOP : SIGCONT);
+	mStopped = isPaused();
+}
+
+bool ThrottleController::setupCgroup(const QStringList &pPaths) {
+	QString lParentPath = acquireDelegatedCgroup();
+	if(lParentPath.isEmpty()) {
+		return false;
+	}
+	mUsesDelegatedCgroup = true;
+	static int sCgroupCounter = 0;
+	QString lCgroupPath = lParentPath + QStringLiteral("/kup-backup-%1-%2").arg(getpid()).arg(++sCgroupCounter);
+	if(!QDir().mkdir(lCgroupPath)) {
+		return false;
+	}
+	if(0 != access(QFile::encodeName(lCgroupPath + QStringLiteral("/cgroup.procs")).constData(), W_OK)) {
+		qWarning("Not allowed to move processes into a new cgroup, backups will be throttled by "
+		         "stopping them periodically.");
+		QDir().rmdir(lCgroupPath);
+		return false;
+	}
+	mCgroupPath = lCgroupPath;
+	foreach(const QString &lPath, pPaths) {
+		QString lDevice = diskDeviceNumber(lPath);
+		if(!lDevice.isEmpty() && !mDiskDevices.contains(lDevice)) {
+			mDiskDevices.append(lDevice);
+		}
+	}
+	return true;
+}
+
+bool ThrottleController::writeCgroupFile(const QString &pName, const QByteArray &pContent) {
+	return writeFile(mCgroupPath + QLatin1Char('/') + pName, pContent);
+}
+
+void ThrottleController::signalProcesses(int pSignal) {
+	foreach(int lPid, processTree()) {
+		kill(lPid, pSignal);
+	}
+}
+
+// The running processes and everything they have started, bup and rsync both
+// run some of their work in child processes.
+QList<int> ThrottleController::processTree() {
+	QList<int> lProcesses = mPids;
+	for(int i = 0; i < lProcesses.count(); ++i) {
+		QString lTaskPath = QStringLiteral("/proc/%1/task").arg(lProcesses.at(i));
+		foreach(const QString &lTask, QDir(lTaskPath).entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+			QFile lChildren(lTaskPath + QLatin1Char('/') + lTask + QStringLiteral("/children"));
+			if(!lChildren.open(QIODevice::ReadOnly)) {
+				continue;
+			}
+			foreach(const QByteArray &lChild, lChildren.readAll().simplified().split(' ')) {
+				if(!lChild.isEmpty()) {
+					lProcesses.append(lChild.toInt());
+				}
+			}
+		}
+	}
+	return lProcesses;
+}
+
+void ThrottleController::accountTime() {
+	mTime[mMode] += mModeTimer.restart();
+}
@@ -0,0 +1,102 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef THROTTLECONTROLLER_H
+#define THROTTLECONTROLLER_H
+
+#include <KJob>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QStringList>
+
+class QTimer;
+
+// Lets a backup job run at full speed while the user is away and holds it
+// back while the user is active. Uses cgroup v2 limits if the daemon has been
+// delegated a cgroup it can create sub-groups in, otherwise stops and continues
+// the processes periodically. Can also pause the processes completely, on request
+// of the job, while running on battery or while the user is active.
+class ThrottleController : public QObject
+{
+	Q_OBJECT
+
+public:
+	// pPaths are the sources and destination of the backup, their disks get I/O limits.
+	ThrottleController(KJob *pJob, const QStringList &pPaths);
+	virtual ~ThrottleController();
+	// The process currently running for the job, the previous one is assumed to have exited.
+	void setProcess(int pPid);
+	// For processes running alongside the one above, they must be removed again when they exit.
+	void addProcess(int pPid);
+	void removeProcess(int pPid);
+	QString throughputSummary();
+	// The processes stay stopped as long as there is any reason for it.
+	enum PauseReason {PausedByJob = 1, PausedOnBattery = 2, PausedWhileActive = 4};
+	void setPaused(PauseReason pReason, bool pPaused);
+	bool isPaused() {
+		return mPauseReasons != 0;
+	}
+	void setPauseConditions(bool pOnBattery, bool pWhileActive);
+	// Lets the processes run freely for good, whether they were paused or stopped
+	// by the duty cycle. Done before terminating them, a stopped process would
+	// not handle the signal.
+	void releaseProcesses();
+	// Not held back while the user is active, for backups the user is waiting for.
+	void keepFullSpeed();
+
+protected slots:
+	void idleTimeoutReached(int pIdentifier);
+	void resumingFromIdle();
+	void toggleStopped();
+	void updateProcessedAmount(KJob *pJob, KJob::Unit pUnit, qulonglong pAmount);
+	void powerStateChanged(bool pConserveResources);
+
+protected:
+	enum Mode {FullSpeed, Throttled};
+	void setMode(Mode pMode);
+	void apply();
+	void applyPause();
+	bool setupCgroup(const QStringList &pPaths);
+	bool writeCgroupFile(const QString &pName, const QByteArray &pContent);
+	void signalProcesses(int pSignal);
+	QList<int> processTree();
+	void accountTime();
+
+	QList<int> mPids;
+	Mode mMode;
+	int mIdleTimeoutId;
+	QString mCgroupPath;
+	QStringList mDiskDevices;
+	QTimer *mDutyCycleTimer;
+	bool mStopped;
+	int mPauseReasons;
+	bool mPauseOnBattery;
+	bool mPauseWhileActive;
+	bool mKeepFullSpeed;
+	bool mReleased;
+	bool mUsesDelegatedCgroup;
+	qulonglong mLastProcessedBytes;
+	QElapsedTimer mModeTimer;
+	qint64 mTime[2]; // milliseconds spent in each mode
+	qulonglong mBytes[2]; // bytes processed in each mode
+};
+
+#endif // THROTTLECONTROLLER_H
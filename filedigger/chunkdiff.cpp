@@ -0,0 +1,220 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "chunkdiff.h"
+#include "mergedvfs.h"
+#include "vfshelpers.h"
+
+#include <QSet>
+
+namespace {
+struct PendingEntry {
+	git_oid mOid;
+	bool mIsTree;
+	quint64 mOffset;
+	quint64 mEnd;
+};
+
+class ChunkTreeDiffer {
+public:
+	explicit ChunkTreeDiffer(git_repository *pRepository) : mRepository(pRepository) {}
+	bool compareTrees(const git_oid *pOldOid, const git_oid *pNewOid, quint64 pOffset, quint64 pEnd);
+	bool addPendingEntries(git_tree *pTree, quint64 pOffset, quint64 pEnd, git_tree *pOldTree);
+	bool addOldSubtree(const git_oid *pOid);
+	bool expandPending(ChunkDiff &pDiff);
+
+protected:
+	git_repository *mRepository;
+	QSet<git_oid> mOldOids;
+	QSet<git_oid> mCountedOids;
+	QList<PendingEntry> mPending;
+};
+
+// Walks both trees in parallel, entries with the same name cover the same byte
+// range. Identical entries are skipped, differing subtrees compared recursively.
+// Everything else is remembered: oids from the old tree in a set, entries from
+// the new tree as pending, since a chunk could have moved to a different offset.
+// Identical entries go in the set too, copies of them are not new data.
+bool ChunkTreeDiffer::compareTrees(const git_oid *pOldOid, const git_oid *pNewOid, quint64 pOffset, quint64 pEnd) {
+	git_tree *lOldTree, *lNewTree;
+	if(0 != git_tree_lookup(&lOldTree, mRepository, pOldOid)) {
+		return false;
+	}
+	if(0 != git_tree_lookup(&lNewTree, mRepository, pNewOid)) {
+		git_tree_free(lOldTree);
+		return false;
+	}
+	bool lOk = addPendingEntries(lNewTree, pOffset, pEnd, lOldTree);
+
+	uint lEntryCount = git_tree_entrycount(lOldTree);
+	for(uint i = 0; lOk && i < lEntryCount; ++i) {
+		const git_tree_entry *lOldEntry = git_tree_entry_byindex(lOldTree, i);
+		const git_tree_entry *lNewEntry = git_tree_entry_byname(lNewTree, git_tree_entry_name(lOldEntry));
+		bool lOldIsTree = S_ISDIR(git_tree_entry_filemode(lOldEntry));
+		if(lNewEntry != NULL && (*git_tree_entry_id(lOldEntry) == *git_tree_entry_id(lNewEntry) ||
+		                         (lOldIsTree && S_ISDIR(git_tree_entry_filemode(lNewEntry))))) {
+			continue; // identical, or already handled by the recursion
+		}
+		mOldOids.insert(*git_tree_entry_id(lOldEntry));
+		if(lOldIsTree) {
+			lOk = addOldSubtree(git_tree_entry_id(lOldEntry));
+		}
+	}
+	git_tree_free(lOldTree);
+	git_tree_free(lNewTree);
+	return lOk;
+}
+
+bool ChunkTreeDiffer::addPendingEntries(git_tree *pTree, quint64 pOffset, quint64 pEnd, git_tree *pOldTree) {
+	uint lEntryCount = git_tree_entrycount(pTree);
+	quint64 lNextOffset = 0;
+	for(uint i = 0; i < lEntryCount; ++i) {
+		const git_tree_entry *lEntry = git_tree_entry_byindex(pTree, i);
+		PendingEntry lPending;
+		if(i == 0) {
+			if(!offsetFromName(lEntry, lNextOffset)) {
+				return false;
+			}
+		}
+		lPending.mOffset = pOffset + lNextOffset;
+		if(i + 1 < lEntryCount) {
+			if(!offsetFromName(git_tree_entry_byindex(pTree, i + 1), lNextOffset)) {
+				return false;
+			}
+			lPending.mEnd = pOffset + lNextOffset;
+		} else {
+			lPending.mEnd = pEnd;
+		}
+		lPending.mOid = *git_tree_entry_id(lEntry);
+		lPending.mIsTree = S_ISDIR(git_tree_entry_filemode(lEntry));
+
+		const git_tree_entry *lOldEntry = NULL;
+		if(pOldTree != NULL) {
+			lOldEntry = git_tree_entry_byname(pOldTree, git_tree_entry_name(lEntry));
+		}
+		if(lOldEntry != NULL) {
+			if(*git_tree_entry_id(lOldEntry) == lPending.mOid) {
+				// unchanged, but the same data could also show up elsewhere in the new version
+				mOldOids.insert(lPending.mOid);
+				continue;
+			}
+			if(lPending.mIsTree && S_ISDIR(git_tree_entry_filemode(lOldEntry))) {
+				if(!compareTrees(git_tree_entry_id(lOldEntry), &lPending.mOid, lPending.mOffset, lPending.mEnd)) {
+					return false;
+				}
+				continue;
+			}
+		}
+		mPending.append(lPending);
+	}
+	return true;
+}
+
+bool ChunkTreeDiffer::addOldSubtree(const git_oid *pOid) {
+	git_tree *lTree;
+	if(0 != git_tree_lookup(&lTree, mRepository, pOid)) {
+		return false;
+	}
+	bool lOk = true;
+	uint lEntryCount = git_tree_entrycount(lTree);
+	for(uint i = 0; lOk && i < lEntryCount; ++i) {
+		const git_tree_entry *lEntry = git_tree_entry_byindex(lTree, i);
+		mOldOids.insert(*git_tree_entry_id(lEntry));
+		if(S_ISDIR(git_tree_entry_filemode(lEntry))) {
+			lOk = addOldSubtree(git_tree_entry_id(lEntry));
+		}
+	}
+	git_tree_free(lTree);
+	return lOk;
+}
+
+bool ChunkTreeDiffer::expandPending(ChunkDiff &pDiff) {
+	while(!mPending.isEmpty()) {
+		PendingEntry lPending = mPending.takeLast();
+		if(mOldOids.contains(lPending.mOid)) {
+			continue; // same data exists in old version, only at a different offset.
+		}
+		if(lPending.mIsTree) {
+			git_tree *lTree;
+			if(0 != git_tree_lookup(&lTree, mRepository, &lPending.mOid)) {
+				return false;
+			}
+			bool lOk = addPendingEntries(lTree, lPending.mOffset, lPending.mEnd, NULL);
+			git_tree_free(lTree);
+			if(!lOk) {
+				return false;
+			}
+			continue;
+		}
+		ChunkRange lRange;
+		lRange.mOffset = lPending.mOffset;
+		lRange.mSize = lPending.mEnd - lPending.mOffset;
+		pDiff.mChangedRanges.append(lRange);
+		if(!mCountedOids.contains(lPending.mOid)) {
+			mCountedOids.insert(lPending.mOid);
+			pDiff.mNewDataSize += objectSize(&lPending.mOid, mRepository);
+		}
+	}
+	return true;
+}
+
+bool rangeLessThan(const ChunkRange &pA, const ChunkRange &pB) {
+	return pA.mOffset < pB.mOffset;
+}
+}
+
+ChunkDiff diffVersions(git_repository *pRepository, VersionData *pOldVersion, VersionData *pNewVersion) {
+	ChunkDiff lDiff;
+	if(pOldVersion->mOid == pNewVersion->mOid) {
+		lDiff.mValid = true;
+		return lDiff;
+	}
+	if(!pOldVersion->mChunkedFile || !pNewVersion->mChunkedFile) {
+		// a single blob, either identical or not. No need for reading it to tell.
+		ChunkRange lRange;
+		lRange.mOffset = 0;
+		lRange.mSize = pNewVersion->size();
+		if(lRange.mSize > 0) {
+			lDiff.mChangedRanges.append(lRange);
+		}
+		lDiff.mNewDataSize = lRange.mSize;
+		lDiff.mValid = true;
+		return lDiff;
+	}
+
+	ChunkTreeDiffer lDiffer(pRepository);
+	if(!lDiffer.compareTrees(&pOldVersion->mOid, &pNewVersion->mOid, 0, pNewVersion->size()) ||
+	   !lDiffer.expandPending(lDiff)) {
+		return lDiff;
+	}
+
+	qSort(lDiff.mChangedRanges.begin(), lDiff.mChangedRanges.end(), rangeLessThan);
+	QList<ChunkRange> lMerged;
+	foreach(const ChunkRange &lRange, lDiff.mChangedRanges) {
+		if(!lMerged.isEmpty() && lMerged.last().mOffset + lMerged.last().mSize == lRange.mOffset) {
+			lMerged.last().mSize += lRange.mSize;
+		} else {
+			lMerged.append(lRange);
+		}
+	}
+	lDiff.mChangedRanges = lMerged;
+	lDiff.mValid = true;
+	return lDiff;
+}
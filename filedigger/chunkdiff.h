@@ -0,0 +1,46 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef CHUNKDIFF_H
+#define CHUNKDIFF_H
+
+#include <QList>
+
+#include <git2.h>
+
+struct VersionData;
+
+struct ChunkRange {
+	quint64 mOffset;
+	quint64 mSize;
+};
+
+struct ChunkDiff {
+	ChunkDiff() : mValid(false), mNewDataSize(0) {}
+	bool mValid;
+	quint64 mNewDataSize; // size of chunks not present at all in the old version
+	QList<ChunkRange> mChangedRanges; // sorted, adjacent ranges are merged
+};
+
+// Compares two versions of a file by their chunk trees only, subtrees with
+// identical oids are skipped and no blob is ever inflated.
+ChunkDiff diffVersions(git_repository *pRepository, VersionData *pOldVersion, VersionData *pNewVersion);
+
+#endif // CHUNKDIFF_H
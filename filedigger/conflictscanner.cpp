@@ -0,0 +1,128 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "conflictscanner.h"
+
+#include <QDir>
+#include <QFile>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace {
+class DirectoryCheck : public QRunnable
+{
+public:
+	DirectoryCheck(ConflictScanner *pScanner, const QString &pDestinationPath,
+	               const QString &pRelativeDir, const QSet<QString> &pFileNames)
+	   : mScanner(pScanner), mDestinationPath(pDestinationPath), mRelativeDir(pRelativeDir),
+	     mFileNames(pFileNames)
+	{}
+
+	void run() Q_DECL_OVERRIDE {
+		QStringList lConflicts;
+		quint64 lConflictSize = 0;
+		QString lDirPath = mDestinationPath;
+		if(!mRelativeDir.isEmpty()) {
+			lDirPath += QDir::separator() + mRelativeDir;
+		}
+		DIR *lDir = mScanner->isAborted() ? NULL : opendir(QFile::encodeName(lDirPath).constData());
+		if(lDir != NULL) {
+			struct dirent *lEntry;
+			while((lEntry = readdir(lDir)) != NULL) {
+				QString lName = QFile::decodeName(lEntry->d_name);
+				if(!mFileNames.contains(lName)) {
+					continue;
+				}
+				struct stat lStat;
+				if(0 == fstatat(dirfd(lDir), lEntry->d_name, &lStat, AT_SYMLINK_NOFOLLOW)) {
+					lConflictSize += lStat.st_size;
+				}
+				lConflicts.append(mRelativeDir.isEmpty() ? lName : mRelativeDir + QDir::separator() + lName);
+			}
+			closedir(lDir);
+		}
+		// directories missing in destination can't have any conflicts, still needs reporting.
+		mScanner->reportDirectory(lConflicts, lConflictSize);
+	}
+
+protected:
+	ConflictScanner *mScanner;
+	QString mDestinationPath;
+	QString mRelativeDir;
+	QSet<QString> mFileNames;
+};
+}
+
+ConflictScanner::ConflictScanner(const QString &pDestinationPath, QObject *pParent)
+   : QObject(pParent), mDestinationPath(pDestinationPath), mPendingDirectories(0), mAborted(0)
+{
+	qRegisterMetaType<quint64>("quint64");
+	mThreadPool = new QThreadPool(this);
+}
+
+ConflictScanner::~ConflictScanner() {
+	mAborted.store(1);
+	mThreadPool->clear();
+	mThreadPool->waitForDone();
+}
+
+void ConflictScanner::addSourceFile(const QString &pRelativePath) {
+	int lSlashIndex = pRelativePath.lastIndexOf(QDir::separator());
+	if(lSlashIndex < 0) {
+		mSourceDirectories[QString()].insert(pRelativePath);
+	} else {
+		mSourceDirectories[pRelativePath.left(lSlashIndex)].insert(pRelativePath.mid(lSlashIndex + 1));
+	}
+}
+
+void ConflictScanner::start() {
+	if(mSourceDirectories.isEmpty()) {
+		emit finished();
+		return;
+	}
+	mPendingDirectories.store(mSourceDirectories.count());
+	QHashIterator<QString, QSet<QString>> lIter(mSourceDirectories);
+	while(lIter.hasNext()) {
+		lIter.next();
+		mThreadPool->start(new DirectoryCheck(this, mDestinationPath, lIter.key(), lIter.value()));
+	}
+	mSourceDirectories.clear();
+}
+
+void ConflictScanner::reportDirectory(const QStringList &pConflicts, quint64 pConflictSize) {
+	// signals are emitted from worker threads, delivery is queued to the GUI thread.
+	if(isAborted()) {
+		return;
+	}
+	if(!pConflicts.isEmpty()) {
+		emit conflictsFound(pConflicts, pConflictSize);
+	}
+	if(!mPendingDirectories.deref()) {
+		emit finished();
+	}
+}
+
+bool ConflictScanner::isAborted() const {
+	return mAborted.load() != 0;
+}
@@ -0,0 +1,62 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef CONFLICTSCANNER_H
+#define CONFLICTSCANNER_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+class QThreadPool;
+
+// Finds which of the files about to be restored already exist in the destination.
+// Each destination directory is read once with readdir() in a thread pool,
+// instead of calling stat() on every single file from the GUI thread.
+class ConflictScanner : public QObject
+{
+	Q_OBJECT
+public:
+	explicit ConflictScanner(const QString &pDestinationPath, QObject *pParent = 0);
+	virtual ~ConflictScanner();
+
+	// pRelativePath is relative to the destination path, may contain slashes.
+	void addSourceFile(const QString &pRelativePath);
+	void start();
+
+	// called from worker threads
+	void reportDirectory(const QStringList &pConflicts, quint64 pConflictSize);
+	bool isAborted() const;
+
+signals:
+	void conflictsFound(const QStringList &pRelativePaths, quint64 pConflictSize);
+	void finished();
+
+protected:
+	QString mDestinationPath;
+	QHash<QString, QSet<QString>> mSourceDirectories; // relative dir path -> file names
+	QThreadPool *mThreadPool;
+	QAtomicInt mPendingDirectories;
+	QAtomicInt mAborted;
+};
+
+#endif // CONFLICTSCANNER_H
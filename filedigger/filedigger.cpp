@@ -19,17 +19,28 @@
  ***************************************************************************/
 
 #include "filedigger.h"
+#include "chunkdiff.h"
+#include "localfilehasher.h"
+#include "mergedvfs.h"
 #include "mergedvfsmodel.h"
+#include "previewpane.h"
 #include "restoredialog.h"
 #include "versionlistmodel.h"
 #include "versionlistdelegate.h"
 
+#include <KFormat>
+#include <KLocalizedString>
+#include <KMessageBox>
 #include <KRun>
 #include <KStandardAction>
 #include <KToolBar>
 
+#include <QAction>
+#include <QApplication>
 #include <QListView>
 #include <QSplitter>
+#include <QStatusBar>
+#include <QThread>
 #include <QTreeView>
 
 
@@ -39,6 +50,12 @@ FileDigger::FileDigger(MergedRepository *pRepository, QWidget *pParent)
 	setWindowIcon(QIcon::fromTheme(QStringLiteral("chronometer")));
 	KToolBar *lAppToolBar = toolBar();
 	lAppToolBar->addAction(KStandardAction::quit(this, SLOT(close()), this));
+	mChangesAction = new QAction(QIcon::fromTheme(QStringLiteral("document-compare")),
+	                             xi18nc("@action:button", "Changes Since Previous Version"), this);
+	mChangesAction->setEnabled(false);
+	connect(mChangesAction, SIGNAL(triggered()), SLOT(showChanges()));
+	lAppToolBar->addAction(mChangesAction);
+	mCurrentNode = NULL;
 	QSplitter *lSplitter = new QSplitter();
 	mMergedVfsModel = new MergedVfsModel(pRepository, this);
 	mMergedVfsView = new QTreeView();
@@ -58,8 +75,22 @@ FileDigger::FileDigger(MergedRepository *pRepository, QWidget *pParent)
 	lSplitter->addWidget(mVersionView);
 	connect(lVersionDelegate, SIGNAL(openRequested(QModelIndex)), SLOT(open(QModelIndex)));
 	connect(lVersionDelegate, SIGNAL(restoreRequested(QModelIndex)), SLOT(restore(QModelIndex)));
+	connect(mVersionView->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)),
+	        SLOT(updateChangesAction()));
+	mPreviewPane = new PreviewPane();
+	lSplitter->addWidget(mPreviewPane);
+	connect(mVersionView->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)),
+	        SLOT(updatePreview()));
 	mMergedVfsView->setFocus();
 
+	mWorkerThread = new QThread(this);
+	mLocalFileHasher = new LocalFileHasher;
+	mLocalFileHasher->moveToThread(mWorkerThread);
+	connect(mWorkerThread, SIGNAL(finished()), mLocalFileHasher, SLOT(deleteLater()));
+	connect(mLocalFileHasher, SIGNAL(fileHashed(QString,QByteArray,bool)),
+	        SLOT(localFileHashed(QString,QByteArray,bool)));
+	mWorkerThread->start();
+
 	//expand all levels from the top until the node has more than one child
 	QModelIndex lIndex;
 	forever {
@@ -72,11 +103,28 @@ FileDigger::FileDigger(MergedRepository *pRepository, QWidget *pParent)
 	}
 	mMergedVfsView->selectionModel()->setCurrentIndex(lIndex.child(0,0), QItemSelectionModel::Select);
 	setCentralWidget(lSplitter);
+
+	connect(pRepository, SIGNAL(versionsAdded(MergedNode*)), SLOT(versionsAdded(MergedNode*)));
+	connect(pRepository, SIGNAL(historyLoadingChanged(bool)), SLOT(showHistoryLoading(bool)));
+	pRepository->startWatching();
+	pRepository->loadRemainingHistory();
+}
+
+FileDigger::~FileDigger() {
+	mLocalFileHasher->requestHash(QString()); // makes it abort any ongoing hashing
+	mWorkerThread->quit();
+	mWorkerThread->wait();
 }
 
 void FileDigger::updateVersionModel(const QModelIndex &pCurrent, const QModelIndex &pPrevious) {
 	Q_UNUSED(pPrevious)
-	mVersionModel->setNode(mMergedVfsModel->node(pCurrent));
+	mCurrentNode = mMergedVfsModel->node(pCurrent);
+	mVersionModel->setNode(mCurrentNode);
+	mCurrentLocalPath.clear();
+	if(mCurrentNode != NULL && !mCurrentNode->isDirectory() && !mCurrentNode->versionList()->isEmpty()) {
+		mCurrentNode->getBupUrl(0, NULL, NULL, NULL, NULL, &mCurrentLocalPath);
+		mLocalFileHasher->requestHash(mCurrentLocalPath);
+	}
 	mVersionView->selectionModel()->setCurrentIndex(mVersionModel->index(0,0),
 	                                                QItemSelectionModel::Select);
 }
@@ -92,3 +140,89 @@ void FileDigger::restore(const QModelIndex &pIndex) {
 	lDialog->setAttribute(Qt::WA_DeleteOnClose);
 	lDialog->show();
 }
+
+void FileDigger::versionsAdded(MergedNode *pNode) {
+	if(pNode != mCurrentNode) {
+		return;
+	}
+	// Rows are merged into the model instead of resetting it, so the selected version,
+	// its preview and the hash of the local file all stay while history is loading.
+	mVersionModel->updateVersions();
+	if(!mVersionView->currentIndex().isValid()) {
+		mVersionView->selectionModel()->setCurrentIndex(mVersionModel->index(0, 0),
+		                                                QItemSelectionModel::Select);
+	}
+	if(mCurrentLocalPath.isEmpty() && !mCurrentNode->isDirectory() && !mCurrentNode->versionList()->isEmpty()) {
+		mCurrentNode->getBupUrl(0, NULL, NULL, NULL, NULL, &mCurrentLocalPath);
+		mLocalFileHasher->requestHash(mCurrentLocalPath);
+	}
+}
+
+void FileDigger::showHistoryLoading(bool pLoading) {
+	if(pLoading) {
+		statusBar()->showMessage(xi18nc("@info:status", "Loading older history..."));
+	} else {
+		statusBar()->clearMessage();
+	}
+}
+
+void FileDigger::localFileHashed(const QString &pPath, const QByteArray &pOid, bool pChunked) {
+	if(pPath == mCurrentLocalPath) {
+		mVersionModel->setLocalFileOid(pOid, pChunked);
+	}
+}
+
+void FileDigger::updatePreview() {
+	int lRow = mVersionView->currentIndex().row();
+	if(mCurrentNode == NULL || mCurrentNode->isDirectory() || lRow < 0 ||
+	   lRow >= mCurrentNode->versionList()->count()) {
+		mPreviewPane->clear();
+		return;
+	}
+	mPreviewPane->setVersion(MergedNode::repository(), mCurrentNode->versionList()->at(lRow),
+	                         mCurrentNode->objectName());
+}
+
+void FileDigger::updateChangesAction() {
+	int lRow = mVersionView->currentIndex().row();
+	mChangesAction->setEnabled(mCurrentNode != NULL && !mCurrentNode->isDirectory() && lRow >= 0 &&
+	                           lRow + 1 < mCurrentNode->versionList()->count());
+}
+
+void FileDigger::showChanges() {
+	int lRow = mVersionView->currentIndex().row();
+	if(mCurrentNode == NULL || lRow < 0 || lRow + 1 >= mCurrentNode->versionList()->count()) {
+		return;
+	}
+	// version list is sorted with newest first.
+	VersionData *lNewVersion = mCurrentNode->versionList()->at(lRow);
+	VersionData *lOldVersion = mCurrentNode->versionList()->at(lRow + 1);
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	ChunkDiff lDiff = diffVersions(MergedNode::repository(), lOldVersion, lNewVersion);
+	QApplication::restoreOverrideCursor();
+	if(!lDiff.mValid) {
+		KMessageBox::sorry(this, xi18nc("@info messagebox", "Could not compare the two versions, "
+		                                "the backup repository may be damaged."));
+		return;
+	}
+
+	KFormat lFormat;
+	quint64 lChangedSize = 0;
+	QStringList lRangeList;
+	foreach(const ChunkRange &lRange, lDiff.mChangedRanges) {
+		lChangedSize += lRange.mSize;
+		if(lRangeList.count() < 100) {
+			lRangeList.append(xi18nc("@item:inlistbox changed part of a file, %1 is offset, %2 is size",
+			                        "At %1: %2", lFormat.formatByteSize(lRange.mOffset),
+			                        lFormat.formatByteSize(lRange.mSize)));
+		}
+	}
+	QString lText = xi18ncp("@info messagebox", "%2 of %3 changed since the previous version, "
+	                        "in one region. %4 of new data was stored.",
+	                        "%2 of %3 changed since the previous version, in %1 regions. "
+	                        "%4 of new data was stored.",
+	                        lDiff.mChangedRanges.count(), lFormat.formatByteSize(lChangedSize),
+	                        lFormat.formatByteSize(lNewVersion->size()),
+	                        lFormat.formatByteSize(lDiff.mNewDataSize));
+	KMessageBox::informationList(this, lText, lRangeList, xi18nc("@title:window", "Changes"));
+}
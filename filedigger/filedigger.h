@@ -23,11 +23,16 @@
 
 #include <KMainWindow>
 
+class LocalFileHasher;
+class MergedNode;
 class MergedVfsModel;
+class PreviewPane;
 class MergedRepository;
 class VersionListModel;
+class QAction;
 class QListView;
 class QModelIndex;
+class QThread;
 class QTreeView;
 
 class FileDigger : public KMainWindow
@@ -35,11 +40,18 @@ class FileDigger : public KMainWindow
 	Q_OBJECT
 public:
 	explicit FileDigger(MergedRepository *pRepository, QWidget *pParent = 0);
+	virtual ~FileDigger();
 
 protected slots:
 	void updateVersionModel(const QModelIndex &pCurrent, const QModelIndex &pPrevious);
 	void open(const QModelIndex &pIndex);
 	void restore(const QModelIndex &pIndex);
+	void updateChangesAction();
+	void updatePreview();
+	void showChanges();
+	void versionsAdded(MergedNode *pNode);
+	void showHistoryLoading(bool pLoading);
+	void localFileHashed(const QString &pPath, const QByteArray &pOid, bool pChunked);
 
 protected:
 	MergedVfsModel *mMergedVfsModel;
@@ -47,6 +59,12 @@ protected:
 
 	VersionListModel *mVersionModel;
 	QListView *mVersionView;
+	QAction *mChangesAction;
+	PreviewPane *mPreviewPane;
+	const MergedNode *mCurrentNode;
+	QString mCurrentLocalPath;
+	LocalFileHasher *mLocalFileHasher;
+	QThread *mWorkerThread;
 };
 
 #endif // FILEDIGGER_H
@@ -0,0 +1,247 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "hashsplit.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QVector>
+
+#include <string.h>
+
+// These must match what bup uses, see bupsplit.c and hashsplit.py in bup.
+#define BUP_BLOBBITS 13
+#define BUP_BLOBSIZE (1 << BUP_BLOBBITS)
+#define BUP_WINDOWSIZE 64
+#define ROLLSUM_CHAR_OFFSET 31
+#define BLOB_MAX (BUP_BLOBSIZE * 4)
+#define FANBITS 4 // log2 of bup's fanout, 16
+#define MAX_PER_TREE 256
+#define GIT_MODE_FILE 0100644
+#define GIT_MODE_TREE 040000
+
+static const qint64 cReadSize = 1024 * 1024;
+
+namespace {
+class Rollsum {
+public:
+	Rollsum() { init(); }
+	void init() {
+		mS1 = BUP_WINDOWSIZE * ROLLSUM_CHAR_OFFSET;
+		mS2 = BUP_WINDOWSIZE * (BUP_WINDOWSIZE - 1) * ROLLSUM_CHAR_OFFSET;
+		mWindowOffset = 0;
+		memset(mWindow, 0, BUP_WINDOWSIZE);
+	}
+	void roll(quint8 pChar) {
+		quint8 lDrop = mWindow[mWindowOffset];
+		mS1 += pChar - lDrop;
+		mS2 += mS1 - (BUP_WINDOWSIZE * (lDrop + ROLLSUM_CHAR_OFFSET));
+		mWindow[mWindowOffset] = pChar;
+		mWindowOffset = (mWindowOffset + 1) % BUP_WINDOWSIZE;
+	}
+	bool atSplit() const {
+		return (mS2 & (BUP_BLOBSIZE - 1)) == (BUP_BLOBSIZE - 1);
+	}
+	int bits() const {
+		quint32 lDigest = (mS1 << 16) | (mS2 & 0xffff);
+		lDigest >>= BUP_BLOBBITS;
+		int lBits = BUP_BLOBBITS;
+		while((lDigest >>= 1) & 1) {
+			lBits++;
+		}
+		return lBits;
+	}
+
+protected:
+	quint32 mS1, mS2;
+	quint8 mWindow[BUP_WINDOWSIZE];
+	int mWindowOffset;
+};
+
+struct ShaEntry {
+	uint mMode;
+	git_oid mOid;
+	quint64 mSize;
+};
+typedef QList<ShaEntry> ShaList;
+
+// Same as _make_shalist() and tree_encode() in bup: entries are named by their
+// offset in hex, zero padded to the width of the total size.
+ShaEntry makeTree(const ShaList &pList) {
+	quint64 lTotal = 0;
+	foreach(const ShaEntry &lEntry, pList) {
+		lTotal += lEntry.mSize;
+	}
+	int lNameLength = QByteArray::number(lTotal, 16).length();
+	QByteArray lTreeData;
+	quint64 lOffset = 0;
+	foreach(const ShaEntry &lEntry, pList) {
+		lTreeData.append(QByteArray::number(lEntry.mMode, 8));
+		lTreeData.append(' ');
+		lTreeData.append(QByteArray::number(lOffset, 16).rightJustified(lNameLength, '0'));
+		lTreeData.append('\0');
+		lTreeData.append((const char *)lEntry.mOid.id, GIT_OID_RAWSZ);
+		lOffset += lEntry.mSize;
+	}
+	ShaEntry lTree;
+	lTree.mMode = GIT_MODE_TREE;
+	lTree.mSize = lTotal;
+	git_odb_hash(&lTree.mOid, lTreeData.constData(), lTreeData.size(), GIT_OBJ_TREE);
+	return lTree;
+}
+
+class TreeStacks {
+public:
+	TreeStacks() : mStacks(1) {}
+	void addBlob(const char *pData, int pSize, int pLevel) {
+		ShaEntry lEntry;
+		lEntry.mMode = GIT_MODE_FILE;
+		lEntry.mSize = pSize;
+		git_odb_hash(&lEntry.mOid, pData, pSize, GIT_OBJ_BLOB);
+		mStacks[0].append(lEntry);
+		squish(pLevel);
+	}
+	void finish(git_oid *pOid, bool *pChunked) {
+		squish(mStacks.count() - 1);
+		const ShaList &lTop = mStacks.last();
+		if(lTop.count() == 1) {
+			*pOid = lTop.first().mOid;
+			*pChunked = lTop.first().mMode == GIT_MODE_TREE;
+		} else if(lTop.isEmpty()) {
+			git_odb_hash(pOid, "", 0, GIT_OBJ_BLOB);
+			*pChunked = false;
+		} else {
+			*pOid = makeTree(lTop).mOid;
+			*pChunked = true;
+		}
+	}
+
+protected:
+	// _squish() from bup's hashsplit.py
+	void squish(int pLevel) {
+		int i = 0;
+		while(i < pLevel || mStacks[i].count() >= MAX_PER_TREE) {
+			while(mStacks.count() <= i + 1) {
+				mStacks.append(ShaList());
+			}
+			if(mStacks[i].count() == 1) {
+				mStacks[i + 1].append(mStacks[i].first());
+			} else if(!mStacks[i].isEmpty()) {
+				mStacks[i + 1].append(makeTree(mStacks[i]));
+			}
+			mStacks[i].clear();
+			++i;
+		}
+	}
+
+	QVector<ShaList> mStacks;
+};
+}
+
+// Finds the first split point in pData with a fresh rolling checksum, as
+// bupsplit_find_ofs() does. Returns the chunk size or 0 if there was no split.
+static int findSplit(const char *pData, int pSize, int *pBits) {
+	Rollsum lRollsum;
+	for(int i = 0; i < pSize; ++i) {
+		lRollsum.roll((quint8)pData[i]);
+		if(lRollsum.atSplit()) {
+			*pBits = lRollsum.bits();
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+bool hashsplitFile(const QString &pPath, git_oid *pOid, bool *pChunked, const QAtomicInt *pAbort) {
+	QFile lFile(pPath);
+	if(!lFile.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	TreeStacks lStacks;
+	// Same buffering as bup: data is read in blocks of 1MiB and appended to what
+	// is left unsplit from earlier blocks. This matters since bup cuts max sized
+	// chunks without restarting the rolling checksum when a block has no split.
+	QByteArray lBuffer;
+	while(true) {
+		if(pAbort != NULL && pAbort->load() != 0) {
+			return false;
+		}
+		int lLeftover = lBuffer.size();
+		lBuffer.resize(lLeftover + cReadSize);
+		qint64 lBytesRead = 0;
+		while(lBytesRead < cReadSize) {
+			qint64 lResult = lFile.read(lBuffer.data() + lLeftover + lBytesRead, cReadSize - lBytesRead);
+			if(lResult < 0) {
+				return false;
+			}
+			if(lResult == 0) {
+				break;
+			}
+			lBytesRead += lResult;
+		}
+		lBuffer.resize(lLeftover + lBytesRead);
+		if(lBytesRead == 0) {
+			break;
+		}
+
+		// _splitbuf() from bup's hashsplit.py
+		const char *lData = lBuffer.constData();
+		int lPosition = 0;
+		int lBits, lKnownBits = 0;
+		int lKnownSplit = 0; // end of the split found by the last full scan
+		while(true) {
+			int lOffset;
+			if(lKnownSplit - lPosition > BUP_WINDOWSIZE) {
+				// The checksum only depends on the last BUP_WINDOWSIZE bytes, so a new scan
+				// can only differ from the last one until its window has been filled.
+				lOffset = findSplit(lData + lPosition, BUP_WINDOWSIZE, &lBits);
+				if(lOffset == 0) {
+					lOffset = lKnownSplit - lPosition;
+					lBits = lKnownBits;
+				}
+			} else {
+				lOffset = findSplit(lData + lPosition, lBuffer.size() - lPosition, &lBits);
+				if(lOffset == 0) {
+					break;
+				}
+				lKnownSplit = lPosition + lOffset;
+				lKnownBits = lBits;
+			}
+			if(lOffset > BLOB_MAX) {
+				lStacks.addBlob(lData + lPosition, BLOB_MAX, 0);
+				lPosition += BLOB_MAX;
+			} else {
+				lStacks.addBlob(lData + lPosition, lOffset, (lBits - BUP_BLOBBITS) / FANBITS);
+				lPosition += lOffset;
+			}
+		}
+		while(lBuffer.size() - lPosition >= BLOB_MAX) {
+			lStacks.addBlob(lData + lPosition, BLOB_MAX, 0);
+			lPosition += BLOB_MAX;
+		}
+		lBuffer.remove(0, lPosition);
+	}
+	if(!lBuffer.isEmpty()) {
+		lStacks.addBlob(lBuffer.constData(), lBuffer.size(), 0);
+	}
+	lStacks.finish(pOid, pChunked);
+	return true;
+}
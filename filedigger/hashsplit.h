@@ -0,0 +1,36 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef HASHSPLIT_H
+#define HASHSPLIT_H
+
+#include <QAtomicInt>
+#include <QString>
+
+#include <git2.h>
+
+// Computes the object id that "bup save" would store for the content of a
+// local file, using the same rolling checksum, chunking and tree layout as bup.
+// Nothing is written anywhere, memory use is bounded regardless of file size.
+// pChunked is set to true if the result is a tree of chunks rather than a single
+// blob. Returns false if the file could not be read or if pAbort became non-zero.
+bool hashsplitFile(const QString &pPath, git_oid *pOid, bool *pChunked, const QAtomicInt *pAbort = NULL);
+
+#endif // HASHSPLIT_H
@@ -0,0 +1,65 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "localfilehasher.h"
+#include "hashsplit.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+
+LocalFileHasher::LocalFileHasher()
+   : QObject(), mLatestRequest(0), mAbort(0)
+{
+}
+
+void LocalFileHasher::requestHash(const QString &pPath) {
+	int lRequest = mLatestRequest.fetchAndAddOrdered(1) + 1;
+	mAbort.store(1); // stop hashing of any earlier file, it's no longer interesting.
+	QMetaObject::invokeMethod(this, "hashFile", Qt::QueuedConnection,
+	                          Q_ARG(QString, pPath), Q_ARG(int, lRequest));
+}
+
+void LocalFileHasher::hashFile(const QString &pPath, int pRequest) {
+	if(pRequest != mLatestRequest.load()) {
+		return;
+	}
+	mAbort.store(0);
+	if(pRequest != mLatestRequest.load()) { // a newer request arrived, abort flag may have been reset.
+		return;
+	}
+	QFileInfo lInfo(pPath);
+	if(!lInfo.isFile() || lInfo.isSymLink()) {
+		return;
+	}
+	qint64 lModifiedTime = lInfo.lastModified().toMSecsSinceEpoch();
+	QHash<QString, CachedHash>::const_iterator lIter = mCache.constFind(pPath);
+	if(lIter != mCache.constEnd() && lIter->mModifiedTime == lModifiedTime && lIter->mSize == lInfo.size()) {
+		emit fileHashed(pPath, QByteArray((const char *)lIter->mOid.id, GIT_OID_RAWSZ), lIter->mChunked);
+		return;
+	}
+	CachedHash lHash;
+	lHash.mModifiedTime = lModifiedTime;
+	lHash.mSize = lInfo.size();
+	if(!hashsplitFile(pPath, &lHash.mOid, &lHash.mChunked, &mAbort)) {
+		return;
+	}
+	mCache.insert(pPath, lHash);
+	emit fileHashed(pPath, QByteArray((const char *)lHash.mOid.id, GIT_OID_RAWSZ), lHash.mChunked);
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef LOCALFILEHASHER_H
+#define LOCALFILEHASHER_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+
+#include <git2.h>
+
+// Computes bup object ids of local files in a worker thread, so that the
+// versions in a backup can be compared with the file currently on disk.
+// Only the most recently requested file is hashed, earlier requests are dropped.
+class LocalFileHasher : public QObject
+{
+	Q_OBJECT
+public:
+	LocalFileHasher();
+	// may be called from any thread
+	void requestHash(const QString &pPath);
+
+signals:
+	void fileHashed(const QString &pPath, const QByteArray &pOid, bool pChunked);
+
+protected slots:
+	void hashFile(const QString &pPath, int pRequest);
+
+protected:
+	struct CachedHash {
+		qint64 mModifiedTime;
+		qint64 mSize;
+		git_oid mOid;
+		bool mChunked;
+	};
+	QHash<QString, CachedHash> mCache;
+	QAtomicInt mLatestRequest;
+	QAtomicInt mAbort;
+};
+
+#endif // LOCALFILEHASHER_H
@@ -79,9 +79,11 @@ int main(int pArgCount, char **pArgArray) {
 		return 1;
 	}
 	if(!lRepository->readBranch()) {
-		if(!lRepository->permissionsOk()) {
-			KMessageBox::sorry(NULL, xi18nc("@info messagebox",
-			                               "You do not have permission needed to read this backup archive."));
+		QString lUnreadablePath;
+		if(!lRepository->permissionsOk(&lUnreadablePath)) {
+			KMessageBox::sorry(NULL, xi18nc("@info messagebox, %1 is a file or folder path",
+			                               "You do not have permission needed to read this backup archive. "
+			                               "<filename>%1</filename> could not be read.", lUnreadablePath));
 			return 2;
 		} else {
 			lRepository->askForIntegrityCheck();
@@ -24,18 +24,27 @@
 
 #include <QDebug>
 #include <QDir>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QTimer>
 #include <KLocalizedString>
 #include <KMessageBox>
 #include <QDBusInterface>
 
 #include <git2/branch.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 typedef QMap<QString, MergedNode *> NameMap;
 typedef QMapIterator<QString, MergedNode *> NameMapIterator;
 
 git_repository *MergedNode::mRepository = NULL;
 
+// number of commits read at a time from the branch history
+static const int cCommitsPerPage = 200;
+
 bool mergedNodeLessThan(const MergedNode *a, const MergedNode *b) {
 	if(a->isDirectory() != b->isDirectory()) {
 		return a->isDirectory();
@@ -118,8 +127,20 @@ void MergedNode::askForIntegrityCheck() {
 }
 
 void MergedNode::generateSubNodes() {
+	mergeVersions(mVersionList, false);
+}
+
+// Adds the content of the given versions of this directory to the subnodes. With
+// pNotify set, the subnodes are already known to the model and any new node
+// is inserted at its sorted position with the repository emitting signals
+// around it. Expanded subnodes get their new versions merged recursively.
+void MergedNode::mergeVersions(const VersionList &pVersions, bool pNotify) {
 	NameMap lSubNodeMap;
-	foreach(VersionData *lCurrentVersion, mVersionList) {
+	foreach(MergedNode *lSubNode, *mSubNodes) {
+		lSubNodeMap.insert(lSubNode->objectName(), lSubNode);
+	}
+	QHash<MergedNode *, VersionList> lAddedVersions; // new or moved to a newer commit
+	foreach(VersionData *lCurrentVersion, pVersions) {
 		git_tree *lTree;
 		if(0 != git_tree_lookup(&lTree, mRepository, &lCurrentVersion->mOid)) {
 			askForIntegrityCheck();
@@ -150,7 +171,7 @@ void MergedNode::generateSubNodes() {
 			if(lSubNode == NULL) {
 				lSubNode = new MergedNode(this, lName, lMode);
 				lSubNodeMap.insert(lName, lSubNode);
-				mSubNodes->append(lSubNode);
+				insertSubNode(lSubNode, pNotify);
 			} else if((S_IFMT & lMode) != (S_IFMT & lSubNode->mMode)) {
 				if(S_ISDIR(lMode)) {
 					lName.append(xi18nc("added after folder name in some cases", " (folder)"));
@@ -163,34 +184,38 @@ void MergedNode::generateSubNodes() {
 				if(lSubNode == NULL) {
 					lSubNode = new MergedNode(this, lName, lMode);
 					lSubNodeMap.insert(lName, lSubNode);
-					mSubNodes->append(lSubNode);
+					insertSubNode(lSubNode, pNotify);
 				}
 			}
-			bool lAlreadySeen = false;
+			VersionData *lSeenVersion = NULL;
 			foreach(VersionData *lVersion, lSubNode->mVersionList) {
 				if(lVersion->mOid == *lOid) {
-					lAlreadySeen = true;
+					lSeenVersion = lVersion;
 					break;
 				}
 			}
-			if(S_ISDIR(lMode)) {
-				if(!lAlreadySeen) {
-					lSubNode->mVersionList.append(new VersionData(lOid, lCurrentVersion->mCommitTime,
-					                                              lCurrentVersion->mModifiedDate, 0));
-				}
-			} else {
-				quint64 lModifiedDate;
+			quint64 lModifiedDate = lCurrentVersion->mModifiedDate;
+			if(!S_ISDIR(lMode)) {
 				Metadata lMetadata;
 				if(lMetadataStream != NULL && 0 == readMetadata(*lMetadataStream, lMetadata)) {
 					lModifiedDate = lMetadata.mMtime;
-				} else {
-					lModifiedDate = lCurrentVersion->mModifiedDate;
 				}
-				if(!lAlreadySeen) {
-					lSubNode->mVersionList.append(new VersionData(lChunked, lOid,
-					                                              lCurrentVersion->mCommitTime,
-					                                              lModifiedDate));
+			}
+			if(lSeenVersion == NULL) {
+				VersionData *lVersion;
+				if(S_ISDIR(lMode)) {
+					lVersion = new VersionData(lOid, lCurrentVersion->mCommitTime, lModifiedDate, 0);
+				} else {
+					lVersion = new VersionData(lChunked, lOid, lCurrentVersion->mCommitTime, lModifiedDate);
 				}
+				lSubNode->mVersionList.append(lVersion);
+				lAddedVersions[lSubNode].append(lVersion);
+			} else if(lCurrentVersion->mCommitTime > lSeenVersion->mCommitTime) {
+				// Same content in a newer commit, as when refresh() finds a new backup. Point
+				// to the newest commit, like a fresh load of the history does.
+				lSeenVersion->mCommitTime = lCurrentVersion->mCommitTime;
+				lSeenVersion->mModifiedDate = lModifiedDate;
+				lAddedVersions[lSubNode].append(lSeenVersion);
 			}
 		}
 		if(lMetadataStream != NULL) {
@@ -199,21 +224,70 @@ void MergedNode::generateSubNodes() {
 		}
 		git_tree_free(lTree);
 	}
-	qSort(mSubNodes->begin(), mSubNodes->end(), mergedNodeLessThan);
-	foreach(MergedNode *lNode, *mSubNodes) {
+	if(!pNotify) {
+		qSort(mSubNodes->begin(), mSubNodes->end(), mergedNodeLessThan);
+		foreach(MergedNode *lNode, *mSubNodes) {
+			qSort(lNode->mVersionList.begin(), lNode->mVersionList.end(), versionGreaterThan);
+		}
+		return;
+	}
+	MergedRepository *lRepository = mergedRepository();
+	QHashIterator<MergedNode *, VersionList> lIter(lAddedVersions);
+	while(lIter.hasNext()) {
+		lIter.next();
+		MergedNode *lNode = lIter.key();
 		qSort(lNode->mVersionList.begin(), lNode->mVersionList.end(), versionGreaterThan);
+		if(lNode->isDirectory() && lNode->mSubNodes != NULL) {
+			lNode->mergeVersions(lIter.value(), true);
+		}
+		if(lRepository != NULL) {
+			emit lRepository->versionsAdded(lNode);
+		}
+	}
+}
+
+void MergedNode::insertSubNode(MergedNode *pNode, bool pNotify) {
+	if(!pNotify) {
+		mSubNodes->append(pNode); // sorted when all are added
+		return;
+	}
+	int lRow = qLowerBound(mSubNodes->begin(), mSubNodes->end(), pNode, mergedNodeLessThan) - mSubNodes->begin();
+	MergedRepository *lRepository = mergedRepository();
+	if(lRepository != NULL) {
+		emit lRepository->nodeAboutToBeInserted(this, lRow);
+	}
+	mSubNodes->insert(lRow, pNode);
+	if(lRepository != NULL) {
+		emit lRepository->nodeInserted();
 	}
 }
 
+MergedRepository *MergedNode::mergedRepository() {
+	MergedNode *lNode = this;
+	while(qobject_cast<MergedNode *>(lNode->parent()) != NULL) {
+		lNode = qobject_cast<MergedNode *>(lNode->parent());
+	}
+	return qobject_cast<MergedRepository *>(lNode);
+}
+
+
+
 MergedRepository::MergedRepository(QObject *pParent, const QString &pRepositoryPath, const QString &pBranchName)
    : MergedNode(pParent, pRepositoryPath, DEFAULT_MODE_DIRECTORY), mBranchName(pBranchName)
 {
+	mHeadOidValid = false;
+	mHistoryWalker = NULL;
+	mWatcher = NULL;
+	mRefreshTimer = NULL;
 	if(!objectName().endsWith(QLatin1Char('/'))) {
 		setObjectName(objectName() + QLatin1Char('/'));
 	}
 }
 
 MergedRepository::~MergedRepository() {
+	if(mHistoryWalker != NULL) {
+		git_revwalk_free(mHistoryWalker);
+	}
 	if(mRepository != NULL) {
 		git_repository_free(mRepository);
 	}
@@ -232,20 +306,135 @@ bool MergedRepository::readBranch() {
 	if(mRepository == NULL) {
 		return false;
 	}
-	git_revwalk *lRevisionWalker;
-	if(0 != git_revwalk_new(&lRevisionWalker, mRepository)) {
+	if(0 != git_revwalk_new(&mHistoryWalker, mRepository)) {
 		qWarning() << "could not create a revision walker in repository " << objectName();
+		mHistoryWalker = NULL;
 		return false;
 	}
 
-	QString lCompleteBranchName = QStringLiteral("refs/heads/");
-	lCompleteBranchName.append(mBranchName);
-	if(0 != git_revwalk_push_ref(lRevisionWalker, lCompleteBranchName.toLocal8Bit())) {
+	mHeadOidValid = 0 == git_reference_name_to_id(&mHeadOid, mRepository, branchRefName());
+	if(0 != git_revwalk_push_ref(mHistoryWalker, branchRefName())) {
 		qWarning() << "Unable to read branch " << mBranchName << " in repository " << objectName();
-		git_revwalk_free(lRevisionWalker);
+		git_revwalk_free(mHistoryWalker);
+		mHistoryWalker = NULL;
+		return false;
+	}
+	// only the newest commits now, so the window can be shown right away. Rest is read by
+	// loadRemainingHistory() later.
+	readHistoryPage(false);
+	return !mVersionList.isEmpty();
+}
+
+void MergedRepository::loadRemainingHistory() {
+	if(mHistoryWalker == NULL) {
+		return;
+	}
+	emit historyLoadingChanged(true);
+	QTimer::singleShot(0, this, SLOT(readNextHistoryPage()));
+}
+
+void MergedRepository::readNextHistoryPage() {
+	if(readHistoryPage(true)) {
+		QTimer::singleShot(0, this, SLOT(readNextHistoryPage()));
+	} else {
+		emit historyLoadingChanged(false);
+	}
+}
+
+// Returns true if there may be more history to read.
+bool MergedRepository::readHistoryPage(bool pNotify) {
+	if(mHistoryWalker == NULL) {
 		return false;
 	}
-	bool lEmptyList = true;
+	VersionList lVersions;
+	git_oid lOid;
+	bool lMoreAvailable = true;
+	while(lVersions.count() < cCommitsPerPage) {
+		if(0 != git_revwalk_next(&lOid, mHistoryWalker)) {
+			lMoreAvailable = false;
+			break;
+		}
+		git_commit *lCommit;
+		if(0 != git_commit_lookup(&lCommit, mRepository, &lOid)) {
+			continue;
+		}
+		git_time_t lTime = git_commit_time(lCommit);
+		lVersions.append(new VersionData(git_commit_tree_id(lCommit), lTime, lTime, 0));
+		git_commit_free(lCommit);
+	}
+	if(!lMoreAvailable) {
+		git_revwalk_free(mHistoryWalker);
+		mHistoryWalker = NULL;
+	}
+	mVersionList.append(lVersions);
+	if(pNotify && !lVersions.isEmpty()) {
+		qSort(mVersionList.begin(), mVersionList.end(), versionGreaterThan);
+		if(mSubNodes != NULL) {
+			mergeVersions(lVersions, true);
+		}
+		emit versionsAdded(this);
+	}
+	return lMoreAvailable;
+}
+
+QByteArray MergedRepository::branchRefName() const {
+	return QByteArray("refs/heads/") + mBranchName.toLocal8Bit();
+}
+
+void MergedRepository::startWatching() {
+	if(mWatcher != NULL) {
+		return;
+	}
+	mRefreshTimer = new QTimer(this);
+	mRefreshTimer->setSingleShot(true);
+	mRefreshTimer->setInterval(1000); // bup writes several files when finishing, wait for it to settle.
+	connect(mRefreshTimer, SIGNAL(timeout()), SLOT(refresh()));
+	mWatcher = new QFileSystemWatcher(this);
+	// refs are replaced by renaming, watch directories too since file watches are lost then.
+	QStringList lPaths;
+	lPaths << objectName() << objectName() + QStringLiteral("refs/heads");
+	lPaths << objectName() + QString::fromLocal8Bit(branchRefName()) << objectName() + QStringLiteral("packed-refs");
+	foreach(const QString &lPath, lPaths) {
+		if(QFile::exists(lPath)) {
+			mWatcher->addPath(lPath);
+		}
+	}
+	connect(mWatcher, SIGNAL(fileChanged(QString)), mRefreshTimer, SLOT(start()));
+	connect(mWatcher, SIGNAL(directoryChanged(QString)), mRefreshTimer, SLOT(start()));
+}
+
+void MergedRepository::refresh() {
+	// re-add file watches, they are lost if the file was replaced.
+	QString lRefPath = objectName() + QString::fromLocal8Bit(branchRefName());
+	QString lPackedRefsPath = objectName() + QStringLiteral("packed-refs");
+	foreach(const QString &lPath, QStringList() << lRefPath << lPackedRefsPath) {
+		if(!mWatcher->files().contains(lPath) && QFile::exists(lPath)) {
+			mWatcher->addPath(lPath);
+		}
+	}
+
+	git_oid lNewHead;
+	if(0 != git_reference_name_to_id(&lNewHead, mRepository, branchRefName())) {
+		return;
+	}
+	if(mHeadOidValid && lNewHead == mHeadOid) {
+		return;
+	}
+	// make libgit2 notice packfiles written since it scanned the objects folder.
+	git_odb *lOdb;
+	if(0 == git_repository_odb(&lOdb, mRepository)) {
+		git_odb_refresh(lOdb);
+		git_odb_free(lOdb);
+	}
+	git_revwalk *lRevisionWalker;
+	if(0 != git_revwalk_new(&lRevisionWalker, mRepository)) {
+		return;
+	}
+	git_revwalk_push(lRevisionWalker, &lNewHead);
+	if(mHeadOidValid) {
+		git_revwalk_hide(lRevisionWalker, &mHeadOid);
+	}
+	VersionList lNewVersions;
 	git_oid lOid;
 	while(0 == git_revwalk_next(&lOid, lRevisionWalker)) {
 		git_commit *lCommit;
@@ -253,36 +442,115 @@ bool MergedRepository::readBranch() {
 			continue;
 		}
 		git_time_t lTime = git_commit_time(lCommit);
-		mVersionList.append(new VersionData(git_commit_tree_id(lCommit), lTime, lTime, 0));
-		lEmptyList = false;
+		lNewVersions.append(new VersionData(git_commit_tree_id(lCommit), lTime, lTime, 0));
 		git_commit_free(lCommit);
 	}
 	git_revwalk_free(lRevisionWalker);
-	return !lEmptyList;
+	mHeadOid = lNewHead;
+	mHeadOidValid = true;
+	if(lNewVersions.isEmpty()) {
+		return;
+	}
+	mVersionList.append(lNewVersions);
+	qSort(mVersionList.begin(), mVersionList.end(), versionGreaterThan);
+	if(mSubNodes != NULL) {
+		mergeVersions(lNewVersions, true);
+	}
+	emit versionsAdded(this);
 }
 
-bool MergedRepository::permissionsOk() {
+// Checks readability of entries in one directory with a single readdir() pass.
+// Only files ending with one of pSuffixes are checked, all if the list is empty.
+// Subdirectories are checked recursively if pRecursive is set.
+static bool checkDirectory(const QByteArray &pPath, const QList<QByteArray> &pSuffixes, bool pRecursive,
+                           QString *pUnreadablePath) {
+	DIR *lDir = opendir(pPath.constData());
+	if(lDir == NULL) {
+		if(pUnreadablePath != NULL) {
+			*pUnreadablePath = QString::fromLocal8Bit(pPath);
+		}
+		return false;
+	}
+	bool lOk = true;
+	QList<QByteArray> lSubDirectories;
+	struct dirent *lEntry;
+	while(lOk && (lEntry = readdir(lDir)) != NULL) {
+		QByteArray lName(lEntry->d_name);
+		if(lName == "." || lName == "..") {
+			continue;
+		}
+		bool lIsDir = lEntry->d_type == DT_DIR;
+		if(lEntry->d_type == DT_UNKNOWN) {
+			struct stat lStat;
+			lIsDir = 0 == fstatat(dirfd(lDir), lEntry->d_name, &lStat, 0) && S_ISDIR(lStat.st_mode);
+		}
+		if(lIsDir) {
+			if(pRecursive) {
+				lSubDirectories.append(pPath + '/' + lName);
+			}
+			continue;
+		}
+		bool lInteresting = pSuffixes.isEmpty();
+		foreach(const QByteArray &lSuffix, pSuffixes) {
+			if(lName.endsWith(lSuffix)) {
+				lInteresting = true;
+				break;
+			}
+		}
+		if(lInteresting && 0 != faccessat(dirfd(lDir), lEntry->d_name, R_OK, 0)) {
+			if(pUnreadablePath != NULL) {
+				*pUnreadablePath = QString::fromLocal8Bit(pPath + '/' + lName);
+			}
+			lOk = false;
+		}
+	}
+	closedir(lDir);
+	foreach(const QByteArray &lSubDirectory, lSubDirectories) {
+		if(!lOk) {
+			break;
+		}
+		lOk = checkDirectory(lSubDirectory, pSuffixes, pRecursive, pUnreadablePath);
+	}
+	return lOk;
+}
+
+// Only checks the files that are needed for reading a branch, walking the whole
+// repository can take very long on a big archive on a slow disk.
+bool MergedRepository::permissionsOk(QString *pUnreadablePath) {
 	if(mRepository == NULL) {
 		return false;
 	}
-	QDir lRepoDir(objectName());
-	if(!lRepoDir.exists()) {
+	QByteArray lRepoPath = QFile::encodeName(objectName());
+	if(lRepoPath.endsWith('/')) {
+		lRepoPath.chop(1);
+	}
+	int lRepoFd = open(lRepoPath.constData(), O_RDONLY | O_DIRECTORY);
+	if(lRepoFd < 0) {
+		if(pUnreadablePath != NULL) {
+			*pUnreadablePath = objectName();
+		}
 		return false;
 	}
-	QList<QDir> lDirectories;
-	lDirectories << lRepoDir;
-	while(!lDirectories.isEmpty()) {
-		QDir lDir = lDirectories.takeFirst();
-		foreach(QFileInfo lFileInfo, lDir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot)) {
-			if(!lFileInfo.isReadable()) {
-				return false;
-			}
-			if(lFileInfo.isDir()) {
-				lDirectories << QDir(lFileInfo.absoluteFilePath());
+	bool lOk = true;
+	const char *lFiles[] = {"HEAD", "packed-refs"};
+	for(uint i = 0; lOk && i < sizeof(lFiles) / sizeof(lFiles[0]); ++i) {
+		// packed-refs is optional, only check it if it's there.
+		if(0 == faccessat(lRepoFd, lFiles[i], F_OK, 0) && 0 != faccessat(lRepoFd, lFiles[i], R_OK, 0)) {
+			if(pUnreadablePath != NULL) {
+				*pUnreadablePath = QString::fromLocal8Bit(lRepoPath + '/' + lFiles[i]);
 			}
+			lOk = false;
 		}
 	}
-	return true;
+	close(lRepoFd);
+	if(lOk) {
+		lOk = checkDirectory(lRepoPath + "/refs", QList<QByteArray>(), true, pUnreadablePath);
+	}
+	if(lOk) {
+		lOk = checkDirectory(lRepoPath + "/objects/pack", QList<QByteArray>() << ".idx" << ".pack", false,
+		                     pUnreadablePath);
+	}
+	return lOk;
 }
 
 uint qHash(git_oid pOid) {
@@ -304,13 +572,7 @@ quint64 VersionData::size() {
 	if(mChunkedFile) {
 		mSize = calculateChunkFileSize(&mOid, MergedNode::mRepository);
 	} else {
-		git_blob *lBlob;
-		if(0 == git_blob_lookup(&lBlob, MergedNode::mRepository, &mOid)) {
-			mSize = git_blob_rawsize(lBlob);
-			git_blob_free(lBlob);
-		} else {
-			mSize = 0;
-		}
+		mSize = objectSize(&mOid, MergedNode::mRepository);
 	}
 	mSizeIsValid = true;
 	return mSize;
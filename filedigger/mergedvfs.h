@@ -39,7 +39,7 @@ struct VersionData {
 	}
 
 	VersionData(const git_oid *pOid, quint64 pCommitTime, quint64 pModifiedDate, quint64 pSize)
-	   :mOid(*pOid), mCommitTime(pCommitTime), mModifiedDate(pModifiedDate), mSize(pSize)
+	   :mChunkedFile(false), mOid(*pOid), mCommitTime(pCommitTime), mModifiedDate(pModifiedDate), mSize(pSize)
 	{
 		mSizeIsValid = true;
 	}
@@ -56,6 +56,9 @@ protected:
 };
 
 class MergedNode;
+class MergedRepository;
+class QFileSystemWatcher;
+class QTimer;
 typedef QList<MergedNode*> MergedNodeList;
 typedef QListIterator<MergedNode*> MergedNodeListIterator;
 typedef QList<VersionData *> VersionList;
@@ -78,9 +81,13 @@ public:
 	const VersionList *versionList() const { return &mVersionList; }
 	uint mode() const { return mMode; }
 	static void askForIntegrityCheck();
+	static git_repository *repository() { return mRepository; }
 
 protected:
 	virtual void generateSubNodes();
+	void mergeVersions(const VersionList &pVersions, bool pNotify);
+	void insertSubNode(MergedNode *pNode, bool pNotify);
+	MergedRepository *mergedRepository();
 
 	static git_repository *mRepository;
 	uint mMode;
@@ -96,9 +103,31 @@ public:
 
 	bool open();
 	bool readBranch();
-	bool permissionsOk();
+	void loadRemainingHistory();
+	bool permissionsOk(QString *pUnreadablePath = NULL);
+	// watch the branch for new backups, they will be merged into the existing nodes.
+	void startWatching();
 
 	QString mBranchName;
+
+signals:
+	void nodeAboutToBeInserted(MergedNode *pParent, int pRow);
+	void nodeInserted();
+	void versionsAdded(MergedNode *pNode);
+	void historyLoadingChanged(bool pLoading);
+
+protected slots:
+	void refresh();
+	void readNextHistoryPage();
+
+protected:
+	QByteArray branchRefName() const;
+	bool readHistoryPage(bool pNotify);
+	git_revwalk *mHistoryWalker;
+	git_oid mHeadOid;
+	bool mHeadOidValid;
+	QFileSystemWatcher *mWatcher;
+	QTimer *mRefreshTimer;
 };
 
 #endif // MERGEDVFS_H
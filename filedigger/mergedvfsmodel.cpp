@@ -29,6 +29,8 @@
 MergedVfsModel::MergedVfsModel(MergedRepository *pRoot, QObject *pParent) :
    QAbstractItemModel(pParent), mRoot(pRoot)
 {
+	connect(mRoot, SIGNAL(nodeAboutToBeInserted(MergedNode*,int)), SLOT(beginInsertNode(MergedNode*,int)));
+	connect(mRoot, SIGNAL(nodeInserted()), SLOT(endInsertNode()));
 }
 
 int MergedVfsModel::columnCount(const QModelIndex &pParent) const {
@@ -106,3 +108,18 @@ const MergedNode *MergedVfsModel::node(const QModelIndex &pIndex) {
 	return static_cast<MergedNode *>(pIndex.internalPointer());
 }
 
+void MergedVfsModel::beginInsertNode(MergedNode *pParent, int pRow) {
+	beginInsertRows(indexOf(pParent), pRow, pRow);
+}
+
+void MergedVfsModel::endInsertNode() {
+	endInsertRows();
+}
+
+QModelIndex MergedVfsModel::indexOf(MergedNode *pNode) const {
+	if(pNode == mRoot) {
+		return QModelIndex();
+	}
+	MergedNode *lParent = qobject_cast<MergedNode *>(pNode->parent());
+	return createIndex(lParent->subNodes().indexOf(pNode), 0, pNode);
+}
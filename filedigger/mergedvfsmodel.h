@@ -39,7 +39,12 @@ public:
 	const VersionList *versionList(const QModelIndex &pIndex);
 	const MergedNode *node(const QModelIndex &pIndex);
 
+protected slots:
+	void beginInsertNode(MergedNode *pParent, int pRow);
+	void endInsertNode();
+
 protected:
+	QModelIndex indexOf(MergedNode *pNode) const;
 	MergedRepository *mRoot;
 
 };
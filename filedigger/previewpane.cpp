@@ -0,0 +1,205 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "previewpane.h"
+#include "versionreader.h"
+#include "mergedvfs.h"
+
+#include <KLocalizedString>
+
+#include <QFontDatabase>
+#include <QImage>
+#include <QLabel>
+#include <QMimeDatabase>
+#include <QPainter>
+#include <QPlainTextEdit>
+#include <QScrollArea>
+#include <QScrollBar>
+#include <QStackedWidget>
+#include <QTimer>
+#include <QVBoxLayout>
+
+#include <climits>
+
+static const int cBytesPerRow = 16;
+static const int cMaxTextPreviewSize = 256 * 1024;
+static const quint64 cMaxImagePreviewSize = 4 * 1024 * 1024;
+static const int cImageReadStep = 4 * VersionReader::cPageSize;
+
+HexView::HexView(QWidget *pParent)
+   : QAbstractScrollArea(pParent), mReader(NULL), mRowCount(0), mRowsPerStep(1)
+{
+	setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+}
+
+void HexView::setReader(VersionReader *pReader) {
+	mReader = pReader;
+	mRowCount = mReader == NULL ? 0 : (mReader->size() + cBytesPerRow - 1) / cBytesPerRow;
+	verticalScrollBar()->setValue(0);
+	updateScrollBar();
+	viewport()->update();
+}
+
+int HexView::visibleRows() const {
+	return qMax(1, viewport()->height() / fontMetrics().height());
+}
+
+void HexView::updateScrollBar() {
+	mRowsPerStep = mRowCount / INT_MAX + 1;
+	quint64 lSteps = mRowCount / mRowsPerStep;
+	int lPageStep = qMax<int>(1, visibleRows() / mRowsPerStep);
+	verticalScrollBar()->setRange(0, lSteps > (quint64)lPageStep ? lSteps - lPageStep : 0);
+	verticalScrollBar()->setPageStep(lPageStep);
+}
+
+void HexView::resizeEvent(QResizeEvent *pEvent) {
+	QAbstractScrollArea::resizeEvent(pEvent);
+	updateScrollBar();
+}
+
+void HexView::paintEvent(QPaintEvent *pEvent) {
+	Q_UNUSED(pEvent)
+	if(mReader == NULL) {
+		return;
+	}
+	QPainter lPainter(viewport());
+	lPainter.setPen(palette().color(QPalette::Text));
+	int lRowHeight = fontMetrics().height();
+	int lRows = visibleRows() + 1;
+	quint64 lFirstRow = (quint64)verticalScrollBar()->value() * mRowsPerStep;
+	QByteArray lData = mReader->read(lFirstRow * cBytesPerRow, lRows * cBytesPerRow);
+	for(int lRow = 0; lRow * cBytesPerRow < lData.size(); ++lRow) {
+		QString lLine = QString::number((lFirstRow + lRow) * cBytesPerRow, 16).rightJustified(10, QLatin1Char('0'));
+		lLine.append(QStringLiteral("  "));
+		QString lAscii;
+		for(int i = 0; i < cBytesPerRow; ++i) {
+			int lIndex = lRow * cBytesPerRow + i;
+			if(lIndex < lData.size()) {
+				uchar lByte = lData.at(lIndex);
+				lLine.append(QString::number(lByte, 16).rightJustified(2, QLatin1Char('0')));
+				lAscii.append(lByte >= 32 && lByte < 127 ? QLatin1Char(lByte) : QLatin1Char('.'));
+			} else {
+				lLine.append(QStringLiteral("  "));
+			}
+			lLine.append(i == cBytesPerRow / 2 - 1 ? QStringLiteral("  ") : QStringLiteral(" "));
+		}
+		lLine.append(QLatin1Char(' '));
+		lLine.append(lAscii);
+		lPainter.drawText(4, lRow * lRowHeight + fontMetrics().ascent(), lLine);
+	}
+}
+
+PreviewPane::PreviewPane(QWidget *pParent)
+   : QWidget(pParent), mReader(NULL)
+{
+	mStack = new QStackedWidget();
+	mMessageLabel = new QLabel();
+	mMessageLabel->setAlignment(Qt::AlignCenter);
+	mMessageLabel->setWordWrap(true);
+	mStack->addWidget(mMessageLabel);
+	mTextView = new QPlainTextEdit();
+	mTextView->setReadOnly(true);
+	mTextView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+	mStack->addWidget(mTextView);
+	mImageLabel = new QLabel();
+	mImageLabel->setAlignment(Qt::AlignCenter);
+	mImageArea = new QScrollArea();
+	mImageArea->setWidget(mImageLabel);
+	mImageArea->setWidgetResizable(true);
+	mStack->addWidget(mImageArea);
+	mHexView = new HexView();
+	mStack->addWidget(mHexView);
+	mImageReadTimer = new QTimer(this);
+	mImageReadTimer->setInterval(0);
+	connect(mImageReadTimer, SIGNAL(timeout()), SLOT(readImageStep()));
+
+	QVBoxLayout *lLayout = new QVBoxLayout;
+	lLayout->setContentsMargins(0, 0, 0, 0);
+	lLayout->addWidget(mStack);
+	setLayout(lLayout);
+	clear();
+}
+
+PreviewPane::~PreviewPane() {
+	delete mReader;
+}
+
+void PreviewPane::clear() {
+	mImageReadTimer->stop();
+	mImageData.clear();
+	mHexView->setReader(NULL);
+	delete mReader;
+	mReader = NULL;
+	mTextView->clear();
+	mImageLabel->clear();
+	mMessageLabel->setText(xi18nc("@info", "No preview available."));
+	mStack->setCurrentWidget(mMessageLabel);
+}
+
+void PreviewPane::setVersion(git_repository *pRepository, VersionData *pVersion, const QString &pFileName) {
+	clear();
+	if(pRepository == NULL || pVersion == NULL) {
+		return;
+	}
+	mReader = new VersionReader(pRepository, pVersion);
+	QByteArray lStart = mReader->read(0, VersionReader::cPageSize);
+	QMimeType lMimeType = QMimeDatabase().mimeTypeForFileNameAndData(pFileName, lStart);
+
+	if(lMimeType.name().startsWith(QStringLiteral("image/")) && mReader->size() <= cMaxImagePreviewSize) {
+		mImageData.reserve(mReader->size());
+		mMessageLabel->setText(xi18nc("@info", "Loading preview..."));
+		mImageReadTimer->start();
+		return;
+	}
+	if(lMimeType.inherits(QStringLiteral("text/plain"))) {
+		QString lText = QString::fromUtf8(mReader->read(0, cMaxTextPreviewSize));
+		if(mReader->size() > (quint64)cMaxTextPreviewSize) {
+			lText.append(QLatin1Char('\n'));
+			lText.append(xi18nc("@info shown at end of truncated text preview",
+			                    "[Only the beginning of the file is shown]"));
+		}
+		mTextView->setPlainText(lText);
+		mStack->setCurrentWidget(mTextView);
+		return;
+	}
+	showHexView();
+}
+
+void PreviewPane::readImageStep() {
+	QByteArray lStep = mReader->read(mImageData.size(), cImageReadStep, false);
+	mImageData.append(lStep);
+	if(!lStep.isEmpty() && (quint64)mImageData.size() < mReader->size()) {
+		return; // more to read on the next timeout
+	}
+	mImageReadTimer->stop();
+	QImage lImage;
+	if((quint64)mImageData.size() == mReader->size() && lImage.loadFromData(mImageData)) {
+		mImageLabel->setPixmap(QPixmap::fromImage(lImage));
+		mStack->setCurrentWidget(mImageArea);
+	} else {
+		showHexView();
+	}
+	mImageData.clear();
+}
+
+void PreviewPane::showHexView() {
+	mHexView->setReader(mReader);
+	mStack->setCurrentWidget(mHexView);
+}
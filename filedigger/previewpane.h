@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef PREVIEWPANE_H
+#define PREVIEWPANE_H
+
+#include <QAbstractScrollArea>
+#include <QWidget>
+
+#include <git2.h>
+
+struct VersionData;
+class VersionReader;
+class QLabel;
+class QPlainTextEdit;
+class QScrollArea;
+class QStackedWidget;
+class QTimer;
+
+// Shows the bytes of a file as hex and ascii, reading only the rows visible.
+class HexView : public QAbstractScrollArea
+{
+	Q_OBJECT
+public:
+	explicit HexView(QWidget *pParent = 0);
+	void setReader(VersionReader *pReader);
+
+protected:
+	void paintEvent(QPaintEvent *pEvent) Q_DECL_OVERRIDE;
+	void resizeEvent(QResizeEvent *pEvent) Q_DECL_OVERRIDE;
+	void updateScrollBar();
+	int visibleRows() const;
+
+	VersionReader *mReader;
+	quint64 mRowCount;
+	quint64 mRowsPerStep; // more than one for files with more rows than a scrollbar can hold
+};
+
+class PreviewPane : public QWidget
+{
+	Q_OBJECT
+public:
+	explicit PreviewPane(QWidget *pParent = 0);
+	virtual ~PreviewPane();
+	void setVersion(git_repository *pRepository, VersionData *pVersion, const QString &pFileName);
+	void clear();
+
+protected slots:
+	void readImageStep();
+
+protected:
+	void showHexView();
+
+	QStackedWidget *mStack;
+	QLabel *mMessageLabel;
+	QPlainTextEdit *mTextView;
+	QScrollArea *mImageArea;
+	QLabel *mImageLabel;
+	HexView *mHexView;
+	VersionReader *mReader;
+	// images are read a step at a time from the event loop, to keep the window responsive
+	QTimer *mImageReadTimer;
+	QByteArray mImageData;
+};
+
+#endif // PREVIEWPANE_H
@@ -21,6 +21,8 @@
 #include "restoredialog.h"
 #include "ui_restoredialog.h"
 #include "restorejob.h"
+#include "conflictscanner.h"
+#include "vfshelpers.h"
 #include "../kcm/dirselector.h"
 
 #include <KIO/CopyJob>
@@ -51,6 +53,7 @@ RestoreDialog::RestoreDialog(const BupSourceInfo &pPathInfo, QWidget *parent)
 	mFileWidget = NULL;
 	mDirSelector = NULL;
 	mJobTracker = NULL;
+	mConflictScanner = NULL;
 
 	mUI->mRestoreOriginalButton->setMinimumHeight(mUI->mRestoreOriginalButton->sizeHint().height() * 2);
 	mUI->mRestoreCustomButton->setMinimumHeight(mUI->mRestoreCustomButton->sizeHint().height() * 2);
@@ -167,13 +170,15 @@ void RestoreDialog::checkDestinationSelection2() {
 void RestoreDialog::startPrechecks() {
 	mUI->mFileConflictList->clear();
 	mSourceSize = 0;
+	mDestinationSize = 0;
 	mFileSizes.clear();
+	delete mConflictScanner; // left from an earlier attempt if user clicked "back".
+	mConflictScanner = NULL;
 
 	if(mSourceInfo.mIsDirectory) {
 		mDirectoriesCount = 1; // the folder being restored, rest will be added during listing.
 		mRestorationPath = mDestination.absoluteFilePath();
 		mFolderToCreate = QFileInfo(mDestination.absoluteFilePath() + QDir::separator() + mSourceFileName);
-		mSavedWorkingDirectory.clear();
 		if(mFolderToCreate.exists()) {
 			if(mFolderToCreate.isDir()) {
 				// destination dir exists, first restore to a subfolder, then move files up.
@@ -187,9 +192,11 @@ void RestoreDialog::startPrechecks() {
 				// make bup not restore the source folder itself but instead it's contents
 				mSourceInfo.mPathInRepo.append(QDir::separator());
 				// folder already exists, need to check for files about to be overwritten.
-				// will create QFileInfos with relative paths during listing and compare with listed source entries.
-				mSavedWorkingDirectory = QDir::currentPath();
-				QDir::setCurrent(mFolderToCreate.absoluteFilePath());
+				// source entries are collected during listing and compared with destination afterwards.
+				mConflictScanner = new ConflictScanner(mFolderToCreate.absoluteFilePath(), this);
+				connect(mConflictScanner, SIGNAL(conflictsFound(QStringList,quint64)),
+				        SLOT(addConflicts(QStringList,quint64)));
+				connect(mConflictScanner, SIGNAL(finished()), SLOT(conflictScanCompleted()));
 			} else {
 				mUI->mFileConflictList->addItem(mFolderToCreate.absoluteFilePath());
 				mRestorationPath.append(QDir::separator());
@@ -230,34 +237,58 @@ void RestoreDialog::collectSourceListing(KIO::Job *pJob, const KIO::UDSEntryList
 		} else {
 			if(!it->isLink()) {
 				quint64 lEntrySize = it->numberValue(KIO::UDSEntry::UDS_SIZE);
+				// bup restore recreates hardlinks when the first link is also being
+				// restored, no data will be written for this one then.
+				if(isHardlinkWithinSource(it->stringValue(KUP_UDS_HARDLINK_TARGET))) {
+					lEntrySize = 0;
+				}
 				mSourceSize += lEntrySize;
 				mFileSizes.insert(mSourceFileName + QDir::separator() + lEntryName, lEntrySize);
 			}
-			if(!mSavedWorkingDirectory.isEmpty()) {
-				QFileInfo lFileInfo(lEntryName);
-				if(lFileInfo.exists()) {
-					mUI->mFileConflictList->addItem(lEntryName);
-				}
+			if(mConflictScanner != NULL) {
+				mConflictScanner->addSourceFile(lEntryName);
 			}
 		}
 	}
 }
 
-void RestoreDialog::sourceListingCompleted(KJob *pJob) {
-	if(!mSavedWorkingDirectory.isEmpty()) {
-		QDir::setCurrent(mSavedWorkingDirectory);
+bool RestoreDialog::isHardlinkWithinSource(const QString &pHardlinkTarget) {
+	if(pHardlinkTarget.isEmpty()) {
+		return false;
 	}
+	QString lSourcePath = mSourceInfo.mPathInRepo;
+	if(!lSourcePath.endsWith(QDir::separator())) {
+		lSourcePath.append(QDir::separator());
+	}
+	return pHardlinkTarget.startsWith(lSourcePath);
+}
+
+void RestoreDialog::sourceListingCompleted(KJob *pJob) {
 	if(pJob->error() != 0) {
 		mMessageWidget->setText(xi18nc("@info message bar appearing on top",
 		                              "There was a problem while getting a list of all files to restore: %1",
 		                              pJob->errorString()));
 		mMessageWidget->setMessageType(KMessageWidget::Error);
 		mMessageWidget->animatedShow();
+	} else if(mConflictScanner != NULL) {
+		mConflictScanner->start(); // continues in conflictScanCompleted()
 	} else {
 		completePrechecks();
 	}
 }
 
+void RestoreDialog::addConflicts(const QStringList &pRelativePaths, quint64 pConflictSize) {
+	mUI->mFileConflictList->addItems(pRelativePaths);
+	mDestinationSize += pConflictSize;
+}
+
+void RestoreDialog::conflictScanCompleted() {
+	mConflictScanner->deleteLater();
+	mConflictScanner = NULL;
+	mUI->mFileConflictList->sortItems();
+	completePrechecks();
+}
+
 void RestoreDialog::completePrechecks() {
 	KDiskFreeSpaceInfo lSpaceInfo = KDiskFreeSpaceInfo::freeSpaceInfo(mDestination.absolutePath());
 	if(lSpaceInfo.isValid() && lSpaceInfo.available() < mSourceSize) {
@@ -274,6 +305,10 @@ void RestoreDialog::completePrechecks() {
 			                                 xi18nc("added to the suggested filename when restoring, %1 is the time when backup was taken",
 			                                       " - saved at %1", lDateString));
 			mUI->mConflictTitleLabel->setText(xi18nc("@info", "Folder already exists, please choose a solution"));
+			mUI->mFileConflictList->setToolTip(xi18ncp("@info:tooltip", "%1 existing file, %2 in total, would be overwritten",
+			                                           "%1 existing files, %2 in total, would be overwritten",
+			                                           mUI->mFileConflictList->count(),
+			                                           KIO::convertSize(mDestinationSize)));
 		} else {
 			mUI->mOverwriteRadioButton->setChecked(true);
 			mUI->mOverwriteRadioButton->hide();
@@ -31,6 +31,7 @@ namespace Ui {
 class RestoreDialog;
 }
 
+class ConflictScanner;
 class DirSelector;
 class KFileWidget;
 class KMessageWidget;
@@ -57,6 +58,8 @@ protected slots:
 	void startPrechecks();
 	void collectSourceListing(KIO::Job *pJob, const KIO::UDSEntryList &pEntryList);
 	void sourceListingCompleted(KJob *pJob);
+	void addConflicts(const QStringList &pRelativePaths, quint64 pConflictSize);
+	void conflictScanCompleted();
 	void completePrechecks();
 	void fileOverwriteConfirmed();
 	void startRestoring();
@@ -68,6 +71,7 @@ protected slots:
 
 private:
 	void checkForExistingFiles(const KIO::UDSEntryList &pEntryList);
+	bool isHardlinkWithinSource(const QString &pHardlinkTarget);
 	void moveFolder();
 	Ui::RestoreDialog *mUI;
 	KFileWidget *mFileWidget;
@@ -80,7 +84,7 @@ private:
 	quint64 mSourceSize; //size of files about to be read
 	KMessageWidget *mMessageWidget;
 	QSignalMapper *mSignalMapper;
-	QString mSavedWorkingDirectory;
+	ConflictScanner *mConflictScanner;
 	QString mSourceFileName;
 	QHash<QString, quint64> mFileSizes;
 	int mDirectoriesCount;
@@ -207,8 +207,15 @@ void VersionListDelegate::paint(QPainter *pPainter, const QStyleOptionViewItem &
 		QString lSizeText = KFormat().formatByteSize((double)pIndex.data(VersionSizeRole).toULongLong());
 		pPainter->drawText(lMarginRect, Qt::AlignRight | Qt::AlignTop, lSizeText, &lSizeDisplayBounds);
 	}
-	QString lDateText = pOption.fontMetrics.elidedText(pIndex.data().toString(), Qt::ElideRight,
-	                                                   lMarginRect.width() - lSizeDisplayBounds.width());
+	QFontMetrics lFontMetrics = pOption.fontMetrics;
+	if(pIndex.data(VersionMatchesLocalFileRole).toBool()) {
+		QFont lBoldFont = pPainter->font();
+		lBoldFont.setBold(true);
+		pPainter->setFont(lBoldFont);
+		lFontMetrics = QFontMetrics(lBoldFont);
+	}
+	QString lDateText = lFontMetrics.elidedText(pIndex.data().toString(), Qt::ElideRight,
+	                                            lMarginRect.width() - lSizeDisplayBounds.width());
 	pPainter->drawText(lMarginRect, Qt::AlignLeft | Qt::AlignTop, lDateText);
 	pPainter->restore();
 
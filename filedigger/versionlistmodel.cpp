@@ -32,31 +32,55 @@
 VersionListModel::VersionListModel(QObject *parent) :
    QAbstractListModel(parent)
 {
-	mVersionList = NULL;
+	mNode = NULL;
+	mLocalFileChunked = false;
 }
 
 void VersionListModel::setNode(const MergedNode *pNode) {
 	beginResetModel();
 	mNode = pNode;
-	mVersionList = mNode->versionList();
+	mVersions = *mNode->versionList();
+	mLocalFileOid.clear();
 	endResetModel();
 }
 
+void VersionListModel::updateVersions() {
+	if(mNode == NULL) {
+		return;
+	}
+	emit layoutAboutToBeChanged();
+	const VersionList *lNewVersions = mNode->versionList();
+	QModelIndexList lOldIndexes = persistentIndexList();
+	QModelIndexList lNewIndexes;
+	foreach(const QModelIndex &lIndex, lOldIndexes) {
+		int lRow = lNewVersions->indexOf(mVersions.at(lIndex.row()));
+		lNewIndexes.append(lRow >= 0 ? createIndex(lRow, 0) : QModelIndex());
+	}
+	changePersistentIndexList(lOldIndexes, lNewIndexes);
+	mVersions = *lNewVersions;
+	emit layoutChanged();
+}
+
+void VersionListModel::setLocalFileOid(const QByteArray &pOid, bool pChunked) {
+	mLocalFileOid = pOid;
+	mLocalFileChunked = pChunked;
+	if(rowCount(QModelIndex()) > 0) {
+		emit dataChanged(index(0), index(rowCount(QModelIndex()) - 1));
+	}
+}
+
 int VersionListModel::rowCount(const QModelIndex &pParent) const {
 	Q_UNUSED(pParent)
-	if(mVersionList != NULL) {
-		return mVersionList->count();
-	}
-	return 0;
+	return mVersions.count();
 }
 
 QVariant VersionListModel::data(const QModelIndex &pIndex, int pRole) const {
-	if(!pIndex.isValid() || mVersionList == NULL) {
+	if(!pIndex.isValid() || mNode == NULL) {
 		return QVariant();
 	}
 	QMimeDatabase db;
 	KFormat lFormat;
-	VersionData *lData = mVersionList->at(pIndex.row());
+	VersionData *lData = mVersions.at(pIndex.row());
 	switch (pRole) {
 	case Qt::DisplayRole:
 		return lFormat.formatRelativeDateTime(QDateTime::fromTime_t(lData->mModifiedDate), QLocale::ShortFormat);
@@ -82,6 +106,14 @@ QVariant VersionListModel::data(const QModelIndex &pIndex, int pRole) const {
 	}
 	case VersionIsDirectoryRole:
 		return mNode->isDirectory();
+	case VersionMatchesLocalFileRole:
+		return !mLocalFileOid.isEmpty() && lData->mChunkedFile == mLocalFileChunked &&
+		       mLocalFileOid == QByteArray::fromRawData((const char *)lData->mOid.id, GIT_OID_RAWSZ);
+	case Qt::ToolTipRole:
+		if(data(pIndex, VersionMatchesLocalFileRole).toBool()) {
+			return xi18nc("@info:tooltip", "This version is identical to the file currently on disk.");
+		}
+		return QVariant();
 	default:
 		return QVariant();
 	}
@@ -42,12 +42,18 @@ class VersionListModel : public QAbstractListModel
 public:
 	explicit VersionListModel(QObject *parent = 0);
 	void setNode(const MergedNode *pNode);
+	// Picks up versions added to the node since setNode(). Selection and current
+	// row stay on the same versions.
+	void updateVersions();
+	void setLocalFileOid(const QByteArray &pOid, bool pChunked);
 	int rowCount(const QModelIndex &pParent) const;
 	QVariant data(const QModelIndex &pIndex, int pRole) const;
 
 protected:
-	const VersionList *mVersionList;
+	VersionList mVersions; // as shown, the node's list may have changed since
 	const MergedNode *mNode;
+	QByteArray mLocalFileOid; // empty if unknown
+	bool mLocalFileChunked;
 };
 
 enum VersionDataRole {
@@ -55,7 +61,8 @@ enum VersionDataRole {
 	VersionMimeTypeRole, // QString
 	VersionSizeRole, // quint64
 	VersionSourceInfoRole, // PathInfo
-	VersionIsDirectoryRole // bool
+	VersionIsDirectoryRole, // bool
+	VersionMatchesLocalFileRole // bool
 };
 
 #endif // VERSIONLISTMODEL_H
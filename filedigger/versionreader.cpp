@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "versionreader.h"
+#include "mergedvfs.h"
+#include "vfshelpers.h"
+
+// cost is counted in bytes
+QCache<QByteArray, QByteArray> VersionReader::mPageCache(8 * 1024 * 1024);
+
+VersionReader::VersionReader(git_repository *pRepository, VersionData *pVersion)
+   : mRepository(pRepository), mOid(pVersion->mOid), mChunked(pVersion->mChunkedFile),
+     mSize(pVersion->size())
+{
+}
+
+QByteArray VersionReader::read(quint64 pOffset, int pSize, bool pCache) {
+	QByteArray lResult;
+	if(pOffset >= mSize || pSize <= 0) {
+		return lResult;
+	}
+	quint64 lEnd = qMin(mSize, pOffset + pSize);
+	lResult.reserve(lEnd - pOffset);
+	for(quint64 lPageIndex = pOffset / cPageSize; lPageIndex * cPageSize < lEnd; ++lPageIndex) {
+		QByteArray lPage;
+		if(!readPage(lPageIndex, lPage, pCache)) {
+			break;
+		}
+		quint64 lPageStart = lPageIndex * cPageSize;
+		int lFrom = pOffset > lPageStart ? pOffset - lPageStart : 0;
+		int lTo = qMin<quint64>(lPage.size(), lEnd - lPageStart);
+		lResult.append(lPage.constData() + lFrom, lTo - lFrom);
+	}
+	return lResult;
+}
+
+bool VersionReader::readPage(quint64 pPageIndex, QByteArray &pPage, bool pCache) {
+	QByteArray lKey((const char *)mOid.id, GIT_OID_RAWSZ);
+	lKey.append((const char *)&pPageIndex, sizeof(pPageIndex));
+	QByteArray *lCachedPage = mPageCache.object(lKey);
+	if(lCachedPage != NULL) {
+		pPage = *lCachedPage;
+		return true;
+	}
+
+	quint64 lStart = pPageIndex * cPageSize;
+	quint64 lEnd = qMin<quint64>(mSize, lStart + cPageSize);
+	pPage.clear();
+	if(mChunked) {
+		pPage.reserve(lEnd - lStart);
+		if(!readTreeRange(&mOid, 0, lStart, lEnd, pPage)) {
+			return false;
+		}
+	} else {
+		git_blob *lBlob;
+		if(0 != git_blob_lookup(&lBlob, mRepository, &mOid)) {
+			return false;
+		}
+		quint64 lBlobSize = git_blob_rawsize(lBlob);
+		if(lStart < lBlobSize) {
+			pPage = QByteArray((const char *)git_blob_rawcontent(lBlob) + lStart, qMin(lEnd, lBlobSize) - lStart);
+		}
+		git_blob_free(lBlob);
+	}
+	if(pCache) {
+		mPageCache.insert(lKey, new QByteArray(pPage), pPage.size());
+	}
+	return true;
+}
+
+// Appends the bytes in [pStart, pEnd) to pResult. Offsets are absolute in the file,
+// pTreeOffset is where the given tree starts. Entries are named by their offset
+// within the tree so the first one needed can be found with a binary search.
+bool VersionReader::readTreeRange(const git_oid *pTreeOid, quint64 pTreeOffset, quint64 pStart, quint64 pEnd,
+                                  QByteArray &pResult) {
+	git_tree *lTree;
+	if(0 != git_tree_lookup(&lTree, mRepository, pTreeOid)) {
+		return false;
+	}
+	uint lEntryCount = git_tree_entrycount(lTree);
+	uint lLower = 0, lUpper = lEntryCount;
+	while(lUpper - lLower > 1) {
+		uint lToCheck = lLower + (lUpper - lLower) / 2;
+		quint64 lCheckOffset;
+		if(!offsetFromName(git_tree_entry_byindex(lTree, lToCheck), lCheckOffset)) {
+			git_tree_free(lTree);
+			return false;
+		}
+		if(pTreeOffset + lCheckOffset > pStart) {
+			lUpper = lToCheck;
+		} else {
+			lLower = lToCheck;
+		}
+	}
+
+	bool lOk = true;
+	for(uint i = lLower; lOk && i < lEntryCount; ++i) {
+		const git_tree_entry *lEntry = git_tree_entry_byindex(lTree, i);
+		quint64 lEntryOffset;
+		if(!offsetFromName(lEntry, lEntryOffset)) {
+			lOk = false;
+			break;
+		}
+		lEntryOffset += pTreeOffset;
+		if(lEntryOffset >= pEnd) {
+			break;
+		}
+		if(S_ISDIR(git_tree_entry_filemode(lEntry))) {
+			lOk = readTreeRange(git_tree_entry_id(lEntry), lEntryOffset, qMax(pStart, lEntryOffset), pEnd, pResult);
+		} else {
+			git_blob *lBlob;
+			if(0 != git_blob_lookup(&lBlob, mRepository, git_tree_entry_id(lEntry))) {
+				lOk = false;
+				break;
+			}
+			quint64 lBlobEnd = lEntryOffset + git_blob_rawsize(lBlob);
+			if(lBlobEnd > pStart) {
+				quint64 lFrom = qMax(pStart, lEntryOffset);
+				quint64 lTo = qMin(pEnd, lBlobEnd);
+				pResult.append((const char *)git_blob_rawcontent(lBlob) + (lFrom - lEntryOffset), lTo - lFrom);
+			}
+			git_blob_free(lBlob);
+		}
+	}
+	git_tree_free(lTree);
+	return lOk;
+}
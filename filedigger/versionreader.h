@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef VERSIONREADER_H
+#define VERSIONREADER_H
+
+#include <QByteArray>
+#include <QCache>
+
+#include <git2.h>
+
+struct VersionData;
+
+// Random access reads from one version of a file in the repository. Only the
+// chunks covering the requested range are fetched. Data is read in pages which
+// are kept in a small cache shared by all readers, so going back to a
+// recently viewed part of a file, or of another version, is instant.
+class VersionReader
+{
+public:
+	VersionReader(git_repository *pRepository, VersionData *pVersion);
+	quint64 size() const { return mSize; }
+	// returns less than pSize bytes only at end of file or on errors. Reads of
+	// whole files should not fill the page cache, pass false for pCache then.
+	QByteArray read(quint64 pOffset, int pSize, bool pCache = true);
+
+	static const int cPageSize = 64 * 1024;
+
+protected:
+	bool readPage(quint64 pPageIndex, QByteArray &pPage, bool pCache);
+	bool readTreeRange(const git_oid *pTreeOid, quint64 pTreeOffset, quint64 pStart, quint64 pEnd,
+	                   QByteArray &pResult);
+
+	git_repository *mRepository;
+	git_oid mOid;
+	bool mChunked;
+	quint64 mSize;
+
+	static QCache<QByteArray, QByteArray> mPageCache;
+};
+
+#endif // VERSIONREADER_H
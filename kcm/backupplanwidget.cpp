@@ -43,6 +43,7 @@
 #include <KComboBox>
 #include <KConfigDialogManager>
 #include <KConfigGroup>
+#include <KEditListWidget>
 #include <KLineEdit>
 #include <KLocalizedString>
 #include <KMessageWidget>
@@ -819,6 +820,45 @@ KPageWidgetItem *BackupPlanWidget::createAdvancedPage(bool pPar2Available) {
 	lShowHiddenLayout->setColumnMinimumWidth(0, lIndentation);
 	lShowHiddenLayout->addWidget(lShowHiddenLabel, 0, 1);
 
+	QCheckBox *lCacheFoldersCheckBox = new QCheckBox(xi18nc("@option:check", "Exclude cache folders"));
+	lCacheFoldersCheckBox->setObjectName(QStringLiteral("kcfg_Exclude cache folders"));
+	QLabel *lCacheFoldersLabel = new QLabel(xi18nc("@info",
+	                                               "Leaves out folders which applications have marked as "
+	                                               "caches with a <filename>CACHEDIR.TAG</filename> file. "
+	                                               "Their content can be recreated and would only make "
+	                                               "your backups bigger."));
+	lCacheFoldersLabel->setWordWrap(true);
+	QGridLayout *lCacheFoldersLayout = new QGridLayout;
+	lCacheFoldersLayout->setContentsMargins(0, 0, 0, 0);
+	lCacheFoldersLayout->setColumnMinimumWidth(0, lIndentation);
+	lCacheFoldersLayout->addWidget(lCacheFoldersLabel, 0, 1);
+
+	QLabel *lExcludePatternsLabel = new QLabel(xi18nc("@label", "Exclude files and folders matching these patterns:"));
+	KEditListWidget *lExcludePatternsEdit = new KEditListWidget;
+	lExcludePatternsEdit->setObjectName(QStringLiteral("kcfg_Exclude patterns"));
+	lExcludePatternsLabel->setBuddy(lExcludePatternsEdit);
+	QLabel *lExcludePatternsInfo = new QLabel(xi18nc("@info",
+	                                                 "Patterns use the same syntax as in <application>rsync</application>, "
+	                                                 "for example <icode>*.iso</icode> or <icode>node_modules/</icode>. "
+	                                                 "A pattern starting with <icode>re:</icode> is a regular expression "
+	                                                 "matched against the full path. Synchronized backups ignore regular "
+	                                                 "expressions, <application>rsync</application> does not support them."));
+	lExcludePatternsInfo->setWordWrap(true);
+
+	QCheckBox *lPauseOnBatteryCheckBox = new QCheckBox(xi18nc("@option:check", "Pause backups while running on battery"));
+	lPauseOnBatteryCheckBox->setObjectName(QStringLiteral("kcfg_Pause on battery"));
+	QCheckBox *lPauseWhileActiveCheckBox = new QCheckBox(xi18nc("@option:check", "Pause backups while you are using the computer"));
+	lPauseWhileActiveCheckBox->setObjectName(QStringLiteral("kcfg_Pause while active"));
+	QLabel *lPauseLabel = new QLabel(xi18nc("@info",
+	                                        "Normally a backup only slows down while you are using the computer. "
+	                                        "A paused backup continues where it was as soon as the situation "
+	                                        "changes."));
+	lPauseLabel->setWordWrap(true);
+	QGridLayout *lPauseLayout = new QGridLayout;
+	lPauseLayout->setContentsMargins(0, 0, 0, 0);
+	lPauseLayout->setColumnMinimumWidth(0, lIndentation);
+	lPauseLayout->addWidget(lPauseLabel, 0, 1);
+
 	QWidget *lRecoveryWidget = new QWidget;
 	QCheckBox *lRecoveryCheckBox = new QCheckBox;
 	lRecoveryCheckBox->setObjectName(QStringLiteral("kcfg_Generate recovery info"));
@@ -851,25 +891,73 @@ KPageWidgetItem *BackupPlanWidget::createAdvancedPage(bool pPar2Available) {
 	lVerificationCheckBox->setObjectName(QStringLiteral("kcfg_Check backups"));
 
 	QLabel *lVerificationLabel = new QLabel(xi18nc("@info",
-	                                               "Checks the whole backup archive for corruption "
-	                                               "every time you save new data. Saving backups will take a "
-	                                               "little bit longer time but it allows you to catch corruption "
-	                                               "problems sooner than at the time you need to use a backup, "
-	                                               "at that time it could be too late."));
+	                                               "Checks new data in the backup archive for corruption "
+	                                               "every time you save new data, and the whole archive now and "
+	                                               "then. Saving backups will take a little bit longer time but "
+	                                               "it allows you to catch corruption problems sooner than at the "
+	                                               "time you need to use a backup, at that time it could be too late."));
 	lVerificationLabel->setWordWrap(true);
+	QHBoxLayout *lFullVerificationLayout = new QHBoxLayout;
+	lFullVerificationLayout->setContentsMargins(0, 0, 0, 0);
+	QSpinBox *lFullVerificationSpinBox = new QSpinBox;
+	lFullVerificationSpinBox->setObjectName(QStringLiteral("kcfg_Full verification interval"));
+	lFullVerificationSpinBox->setMinimum(1);
+	lFullVerificationSpinBox->setMaximum(365);
+	lFullVerificationSpinBox->setEnabled(false);
+	QLabel *lFullVerificationLabel = new QLabel(xi18nc("@label:spinbox", "Check the whole archive every"));
+	lFullVerificationLabel->setBuddy(lFullVerificationSpinBox);
+	lFullVerificationLayout->addWidget(lFullVerificationLabel);
+	lFullVerificationLayout->addWidget(lFullVerificationSpinBox);
+	lFullVerificationLayout->addWidget(new QLabel(xi18nc("@item:inlistbox", "Days")));
+	lFullVerificationLayout->addStretch();
+	connect(lVerificationCheckBox, SIGNAL(toggled(bool)), lFullVerificationSpinBox, SLOT(setEnabled(bool)));
 	QGridLayout *lVerificationLayout = new QGridLayout;
 	lVerificationLayout->setContentsMargins(0, 0, 0, 0);
 	lVerificationLayout->setSpacing(0);
 	lVerificationLayout->setColumnMinimumWidth(0, lIndentation);
 	lVerificationLayout->addWidget(lVerificationCheckBox,0, 0, 1, 2);
 	lVerificationLayout->addWidget(lVerificationLabel, 1, 1);
+	lVerificationLayout->addLayout(lFullVerificationLayout, 2, 1);
 	lVerificationWidget->setLayout(lVerificationLayout);
 	connect(mVersionedRadio, SIGNAL(toggled(bool)), lVerificationWidget, SLOT(setVisible(bool)));
 
+	QWidget *lReplicaWidget = new QWidget;
+	QCheckBox *lReplicaCheckBox = new QCheckBox(xi18nc("@option:check", "Keep a copy of the backup archive in a second location"));
+	lReplicaCheckBox->setObjectName(QStringLiteral("kcfg_Replicate"));
+	QLabel *lReplicaLabel = new QLabel(xi18nc("@info",
+	                                          "After each backup, the data which was added to the archive "
+	                                          "gets copied to this folder, for example on another external "
+	                                          "drive. If the folder is not available at that time it will be "
+	                                          "brought up to date after a later backup."));
+	lReplicaLabel->setWordWrap(true);
+	KUrlRequester *lReplicaUrlEdit = new KUrlRequester;
+	lReplicaUrlEdit->setMode(KFile::Directory | KFile::LocalOnly);
+	lReplicaUrlEdit->setObjectName(QStringLiteral("kcfg_Replica destination path"));
+	lReplicaUrlEdit->setEnabled(false);
+	connect(lReplicaCheckBox, SIGNAL(toggled(bool)), lReplicaUrlEdit, SLOT(setEnabled(bool)));
+	QGridLayout *lReplicaLayout = new QGridLayout;
+	lReplicaLayout->setContentsMargins(0, 0, 0, 0);
+	lReplicaLayout->setSpacing(0);
+	lReplicaLayout->setColumnMinimumWidth(0, lIndentation);
+	lReplicaLayout->addWidget(lReplicaCheckBox, 0, 0, 1, 2);
+	lReplicaLayout->addWidget(lReplicaLabel, 1, 1);
+	lReplicaLayout->addWidget(lReplicaUrlEdit, 2, 1);
+	lReplicaWidget->setLayout(lReplicaLayout);
+	connect(mVersionedRadio, SIGNAL(toggled(bool)), lReplicaWidget, SLOT(setVisible(bool)));
+
 	lAdvancedLayout->addWidget(lShowHiddenCheckBox);
 	lAdvancedLayout->addLayout(lShowHiddenLayout);
+	lAdvancedLayout->addWidget(lCacheFoldersCheckBox);
+	lAdvancedLayout->addLayout(lCacheFoldersLayout);
+	lAdvancedLayout->addWidget(lExcludePatternsLabel);
+	lAdvancedLayout->addWidget(lExcludePatternsEdit);
+	lAdvancedLayout->addWidget(lExcludePatternsInfo);
+	lAdvancedLayout->addWidget(lPauseOnBatteryCheckBox);
+	lAdvancedLayout->addWidget(lPauseWhileActiveCheckBox);
+	lAdvancedLayout->addLayout(lPauseLayout);
 	lAdvancedLayout->addWidget(lVerificationWidget);
 	lAdvancedLayout->addWidget(lRecoveryWidget);
+	lAdvancedLayout->addWidget(lReplicaWidget);
 	lAdvancedLayout->addStretch();
 	lAdvancedWidget->setLayout(lAdvancedLayout);
 	KPageWidgetItem *lPage = new KPageWidgetItem(lAdvancedWidget);
@@ -35,26 +35,6 @@
 
 #include <KLocalizedString>
 
-namespace {
-
-// we need the trailing slash to be able to use the startsWith() function to check for parent dirs.
-QString ensureTrailingSlash(const QString &pPath) {
-	return pPath.endsWith(QDir::separator()) ? pPath : pPath + QDir::separator();
-}
-
-bool setContainsSubdir(QSet<QString> pSet, const QString &pParentDir) {
-	const QString lPathWithSlash = ensureTrailingSlash(pParentDir);
-	foreach(QString lTestedPath, pSet) {
-		if(lTestedPath.startsWith(lPathWithSlash)) {
-			return true;
-		}
-	}
-	return false;
-}
-
-}
-
-
 FolderSelectionModel::FolderSelectionModel(bool pHiddenFoldersVisible, QObject *pParent)
    : QFileSystemModel(pParent)
 {
@@ -78,7 +58,7 @@ QVariant FolderSelectionModel::data(const QModelIndex& pIndex, int pRole) const
 		switch(lState) {
 		case StateIncluded:
 		case StateIncludeInherited:
-			if(setContainsSubdir(mExcludedPaths, lPath)) {
+			if(hasExcludedSubdir(lPath)) {
 				return Qt::PartiallyChecked;
 			}
 			return Qt::Checked;
@@ -94,7 +74,7 @@ QVariant FolderSelectionModel::data(const QModelIndex& pIndex, int pRole) const
 		case StateIncludeInherited:
 			return QVariant::fromValue(QPalette().brush(QPalette::Active, QPalette::Text));
 		default:
-			if(setContainsSubdir(mIncludedPaths, lPath)) {
+			if(hasIncludedSubdir(lPath)) {
 				return QVariant::fromValue(QPalette().brush( QPalette::Active, QPalette::Text));
 			}
 			return QVariant::fromValue(QPalette().brush( QPalette::Disabled, QPalette::Text));
@@ -104,7 +84,7 @@ QVariant FolderSelectionModel::data(const QModelIndex& pIndex, int pRole) const
 		switch(lState) {
 		case StateIncluded:
 		case StateIncludeInherited:
-			if(setContainsSubdir(mExcludedPaths, lPath)) {
+			if(hasExcludedSubdir(lPath)) {
 				return xi18nc("@info:tooltip %1 is the path of the folder in a listview",
 				             "<filename>%1</filename><nl/>will be included in the backup, except "
 				             "for unchecked subfolders", filePath(pIndex));
@@ -112,7 +92,7 @@ QVariant FolderSelectionModel::data(const QModelIndex& pIndex, int pRole) const
 			return xi18nc("@info:tooltip %1 is the path of the folder in a listview",
 			             "<filename>%1</filename><nl/>will be included in the backup", filePath(pIndex));
 		default:
-			if(setContainsSubdir(mIncludedPaths, lPath)) {
+			if(hasIncludedSubdir(lPath)) {
 				return xi18nc("@info:tooltip %1 is the path of the folder in a listview",
 				             "<filename>%1</filename><nl/> will <emphasis>not</emphasis> be included "
 				             "in the backup but contains folders that will", filePath(pIndex));
@@ -165,6 +145,7 @@ void FolderSelectionModel::includePath(const QString &pPath) {
 	removeSubDirs(pPath);
 	if(lState == StateNone || lState == StateExcludeInherited) {
 		mIncludedPaths.insert(pPath);
+		setPathState(pPath, StateIncluded);
 		emit includedPathAdded(pPath);
 	}
 	emit dataChanged(index(pPath), findLastLeaf(index(pPath)));
@@ -178,6 +159,7 @@ void FolderSelectionModel::excludePath(const QString& pPath) {
 	removeSubDirs(pPath);
 	if(lState == StateIncludeInherited) {
 		mExcludedPaths.insert(pPath);
+		setPathState(pPath, StateExcluded);
 		emit excludedPathAdded(pPath);
 	}
 	emit dataChanged(index(pPath), findLastLeaf(index(pPath)));
@@ -188,6 +170,7 @@ void FolderSelectionModel::setIncludedPaths(QSet<QString> pIncludedPaths) {
 	QSet<QString> lRemoved = mIncludedPaths - pIncludedPaths;
 	QSet<QString> lAdded = pIncludedPaths - mIncludedPaths;
 	mIncludedPaths = pIncludedPaths;
+	rebuildPathTree();
 
 	foreach(const QString &lRemovedPath, lRemoved) {
 		emit includedPathRemoved(lRemovedPath);
@@ -203,6 +186,7 @@ void FolderSelectionModel::setExcludedPaths(QSet<QString> pExcludedPaths) {
 	QSet<QString> lRemoved = mExcludedPaths - pExcludedPaths;
 	QSet<QString> lAdded = pExcludedPaths - mExcludedPaths;
 	mExcludedPaths = pExcludedPaths;
+	rebuildPathTree();
 
 	foreach(const QString &lRemovedPath, lRemoved) {
 		emit excludedPathRemoved(lRemovedPath);
@@ -226,28 +210,82 @@ FolderSelectionModel::InclusionState FolderSelectionModel::inclusionState(const
 }
 
 FolderSelectionModel::InclusionState FolderSelectionModel::inclusionState(const QString& pPath) const {
-	if(mIncludedPaths.contains(pPath)) {
-		return StateIncluded;
+	const QStringList lNames = pPath.split(QDir::separator(), QString::SkipEmptyParts);
+	const PathNode *lNode = &mPathTree;
+	InclusionState lNearest = StateNone; // state of the closest marked parent
+	for(int i = 0; lNode != NULL; ++i) {
+		if(i == lNames.count()) {
+			if(lNode->mState != StateNone) {
+				return lNode->mState;
+			}
+			break;
+		}
+		if(lNode->mState != StateNone) {
+			lNearest = lNode->mState;
+		}
+		lNode = lNode->mChildren.value(lNames.at(i));
 	}
-	else if(mExcludedPaths.contains(pPath)) {
-		return StateExcluded;
+	if(lNearest == StateIncluded) {
+		return StateIncludeInherited;
+	} else if(lNearest == StateExcluded) {
+		return StateExcludeInherited;
 	}
-	else {
-		QString lParent = pPath.section(QDir::separator(), 0, -2, QString::SectionSkipEmpty|QString::SectionIncludeLeadingSep);
-		if(lParent.isEmpty()) {
-			return StateNone;
+	return StateNone;
+}
+
+const FolderSelectionModel::PathNode *FolderSelectionModel::findNode(const QString &pPath) const {
+	const PathNode *lNode = &mPathTree;
+	foreach(const QString &lName, pPath.split(QDir::separator(), QString::SkipEmptyParts)) {
+		lNode = lNode->mChildren.value(lName);
+		if(lNode == NULL) {
+			break;
 		}
-		else {
-			InclusionState state = inclusionState(lParent);
-			if(state == StateNone) {
-				return StateNone;
-			} else if(state == StateIncluded || state == StateIncludeInherited) {
-				return StateIncludeInherited;
-			} else {
-				return StateExcludeInherited;
-			}
+	}
+	return lNode;
+}
+
+void FolderSelectionModel::setPathState(const QString &pPath, InclusionState pState) {
+	QList<PathNode *> lNodes;
+	lNodes.append(&mPathTree);
+	foreach(const QString &lName, pPath.split(QDir::separator(), QString::SkipEmptyParts)) {
+		PathNode *&lChild = lNodes.last()->mChildren[lName];
+		if(lChild == NULL) {
+			lChild = new PathNode;
 		}
+		lNodes.append(lChild);
+	}
+	PathNode *lNode = lNodes.last();
+	int lIncludedChange = (pState == StateIncluded) - (lNode->mState == StateIncluded);
+	int lExcludedChange = (pState == StateExcluded) - (lNode->mState == StateExcluded);
+	foreach(PathNode *lParent, lNodes) {
+		lParent->mIncludedCount += lIncludedChange;
+		lParent->mExcludedCount += lExcludedChange;
 	}
+	lNode->mState = pState;
+	lNode->mPath = pPath;
+}
+
+void FolderSelectionModel::rebuildPathTree() {
+	qDeleteAll(mPathTree.mChildren);
+	mPathTree.mChildren.clear();
+	mPathTree.mState = StateNone;
+	mPathTree.mIncludedCount = mPathTree.mExcludedCount = 0;
+	foreach(const QString &lPath, mIncludedPaths) {
+		setPathState(lPath, StateIncluded);
+	}
+	foreach(const QString &lPath, mExcludedPaths) {
+		setPathState(lPath, StateExcluded);
+	}
+}
+
+bool FolderSelectionModel::hasIncludedSubdir(const QString &pPath) const {
+	const PathNode *lNode = findNode(pPath);
+	return lNode != NULL && lNode->mIncludedCount > (lNode->mState == StateIncluded ? 1 : 0);
+}
+
+bool FolderSelectionModel::hasExcludedSubdir(const QString &pPath) const {
+	const PathNode *lNode = findNode(pPath);
+	return lNode != NULL && lNode->mExcludedCount > (lNode->mState == StateExcluded ? 1 : 0);
 }
 
 bool FolderSelectionModel::hiddenFoldersVisible() const {
@@ -275,24 +313,45 @@ QModelIndex FolderSelectionModel::findLastLeaf(const QModelIndex &pIndex) {
 }
 
 void FolderSelectionModel::removeSubDirs(const QString& pPath) {
-	QSet<QString>::iterator it = mExcludedPaths.begin();
-	QString lPath = pPath + QStringLiteral("/");
-	while(it != mExcludedPaths.end()) {
-		if(*it == pPath || it->startsWith(lPath)) {
-			emit excludedPathRemoved(*it);
-			it = mExcludedPaths.erase(it);
-		} else {
-			++it;
+	QList<PathNode *> lNodes;
+	lNodes.append(&mPathTree);
+	foreach(const QString &lName, pPath.split(QDir::separator(), QString::SkipEmptyParts)) {
+		PathNode *lChild = lNodes.last()->mChildren.value(lName);
+		if(lChild == NULL) {
+			return; // nothing marked at or below this path
 		}
+		lNodes.append(lChild);
 	}
-	it = mIncludedPaths.begin();
-	while(it != mIncludedPaths.end()) {
-		if(*it == pPath || it->startsWith(lPath)) {
-			emit includedPathRemoved(*it);
-			it = mIncludedPaths.erase(it);
-		} else {
-			++it;
+	PathNode *lNode = lNodes.last();
+	QStringList lExcluded, lIncluded;
+	QList<PathNode *> lStack;
+	lStack.append(lNode);
+	while(!lStack.isEmpty()) {
+		PathNode *lSubNode = lStack.takeLast();
+		if(lSubNode->mState == StateExcluded) {
+			lExcluded.append(lSubNode->mPath);
+		} else if(lSubNode->mState == StateIncluded) {
+			lIncluded.append(lSubNode->mPath);
 		}
+		lStack.append(lSubNode->mChildren.values());
+	}
+	const int lIncludedCount = lNode->mIncludedCount;
+	const int lExcludedCount = lNode->mExcludedCount;
+	foreach(PathNode *lParent, lNodes) {
+		lParent->mIncludedCount -= lIncludedCount;
+		lParent->mExcludedCount -= lExcludedCount;
+	}
+	qDeleteAll(lNode->mChildren);
+	lNode->mChildren.clear();
+	lNode->mState = StateNone;
+
+	foreach(const QString &lPath, lExcluded) {
+		mExcludedPaths.remove(lPath);
+		emit excludedPathRemoved(lPath);
+	}
+	foreach(const QString &lPath, lIncluded) {
+		mIncludedPaths.remove(lPath);
+		emit includedPathRemoved(lPath);
 	}
 }
 
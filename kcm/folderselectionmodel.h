@@ -28,6 +28,7 @@
 #define _FOLDER_SELECTION_MODEL_H_
 
 #include <QFileSystemModel>
+#include <QHash>
 #include <QSet>
 
 
@@ -86,11 +87,33 @@ signals:
 	void excludedPathRemoved(const QString &pPath);
 
 private:
+	// The included and excluded paths are also kept as a tree of path components.
+	// Every node counts the marked paths below it, so the state of a folder and
+	// whether it has marked subfolders is found by walking down from the root,
+	// instead of comparing with every path. Updated when the paths change.
+	struct PathNode {
+		PathNode() : mState(StateNone), mIncludedCount(0), mExcludedCount(0) {}
+		~PathNode() {
+			qDeleteAll(mChildren);
+		}
+		InclusionState mState; // StateIncluded, StateExcluded or StateNone
+		QString mPath; // as it is in the sets, if marked
+		int mIncludedCount; // marked paths in this subtree, this node included
+		int mExcludedCount;
+		QHash<QString, PathNode *> mChildren;
+	};
+	const PathNode *findNode(const QString &pPath) const;
+	void setPathState(const QString &pPath, InclusionState pState);
+	void rebuildPathTree();
+	bool hasIncludedSubdir(const QString &pPath) const;
+	bool hasExcludedSubdir(const QString &pPath) const;
+
 	QModelIndex findLastLeaf(const QModelIndex& index);
 	void removeSubDirs(const QString& path);
 
 	QSet<QString> mIncludedPaths;
 	QSet<QString> mExcludedPaths;
+	PathNode mPathTree;
 };
 
 #endif
@@ -24,9 +24,11 @@
 #include "kupkcm.h"
 #include "kupsettings.h"
 #include "planstatuswidget.h"
+#include "toolcapabilities.h"
 
 #include <QCheckBox>
 #include <QDBusInterface>
+#include <QEventLoop>
 #include <QLabel>
 #include <QMessageBox>
 #include <QPushButton>
@@ -57,26 +59,17 @@ KupKcm::KupKcm(QWidget *pParent, const QVariantList &pArgs)
 	setObjectName(QStringLiteral("kcm_kup")); //needed for the kconfigdialogmanager magic
 	setButtons((Apply | buttons()) & ~Default);
 
-	KProcess lBupProcess;
-	lBupProcess << QStringLiteral("bup") << QStringLiteral("version");
-	lBupProcess.setOutputChannelMode(KProcess::MergedChannels);
-	int lExitCode = lBupProcess.execute();
-	if(lExitCode >= 0) {
-		mBupVersion = QString::fromUtf8(lBupProcess.readAllStandardOutput());
-		KProcess lPar2Process;
-		lPar2Process << QStringLiteral("bup") << QStringLiteral("fsck") << QStringLiteral("--par2-ok");
-		mPar2Available = lPar2Process.execute() == 0;
-	} else {
-		mPar2Available = false;
-	}
-
-	KProcess lRsyncProcess;
-	lRsyncProcess << QStringLiteral("rsync") << QStringLiteral("--version");
-	lRsyncProcess.setOutputChannelMode(KProcess::MergedChannels);
-	lExitCode = lRsyncProcess.execute();
-	if(lExitCode >= 0) {
-		mRsyncVersion = QString::fromLocal8Bit(lRsyncProcess.readLine()).split(QLatin1Char(' '), QString::SkipEmptyParts).at(2);
+	// Only waits for the programs to run the first time or after they have been updated.
+	ToolCapabilities *lTools = ToolCapabilities::instance();
+	if(!lTools->isCurrent()) {
+		QEventLoop lLoop;
+		connect(lTools, SIGNAL(ready()), &lLoop, SLOT(quit()));
+		lTools->probe();
+		lLoop.exec(QEventLoop::ExcludeUserInputEvents);
 	}
+	mBupVersion = lTools->bupVersion();
+	mPar2Available = lTools->par2Available();
+	mRsyncVersion = lTools->rsyncVersion();
 
 	if(mBupVersion.isEmpty() && mRsyncVersion.isEmpty()) {
 		QLabel *lSorryIcon = new QLabel;
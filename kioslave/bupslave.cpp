@@ -102,7 +102,7 @@ void BupSlave::get(const QUrl &pUrl) {
 
 	QByteArray lResultArray;
 	int lRetVal;
-	while(0 == (lRetVal = lFile->read(lResultArray))) {
+	while(0 == (lRetVal = lFile->readSequential(lResultArray))) {
 		emit data(lResultArray);
 		lProcessedSize += lResultArray.length();
 		emit processedSize(lProcessedSize);
@@ -349,6 +349,9 @@ void BupSlave::createUDSEntry(Node *pNode, UDSEntry &pUDSEntry, int pDetails) {
 		pUDSEntry.insert(KIO::UDSEntry::UDS_MODIFICATION_TIME, pNode->mMtime);
 		pUDSEntry.insert(KIO::UDSEntry::UDS_USER, getUserName(pNode->mUid));
 		pUDSEntry.insert(KIO::UDSEntry::UDS_GROUP, getGroupName(pNode->mGid));
+		if(!pNode->mHardlinkTarget.isEmpty()) {
+			pUDSEntry.insert(KUP_UDS_HARDLINK_TARGET, pNode->mHardlinkTarget);
+		}
 	}
 }
 
@@ -6,10 +6,17 @@
 #include <sys/stat.h>
 
 #include <QDebug>
+#include <QMap>
+#include <QVector>
 #include <QMimeDatabase>
 
 git_revwalk *Node::mRevisionWalker = NULL;
 git_repository *Node::mRepository = NULL;
+PackIndex *Node::mPackIndex = NULL;
+
+// Max number of chunks fetched at once by ChunkFile::readSequential(). Chunks are
+// at most 32KiB in bup, so this caps memory use at 16MiB.
+static const int cReadWindowChunks = 512;
 
 Node::Node(QObject *pParent, const QString &pName, quint64 pMode)
    :QObject(pParent), Metadata(pMode)
@@ -186,10 +193,11 @@ int ChunkFile::seek(quint64 pOffset) {
 	if(pOffset >= size()) {
 		return KIO::ERR_COULD_NOT_SEEK;
 	}
-	if(mOffset == pOffset && mValidSeekPosition) {
+	if(mOffset == pOffset && mValidSeekPosition && mReadWindow.isEmpty()) {
 		return 0; // nothing to do, success
 	}
 
+	clearReadWindow();
 	mOffset = pOffset;
 	mValidSeekPosition = false;
 
@@ -254,6 +262,12 @@ int ChunkFile::read(QByteArray &pChunk, int pReadSize) {
 	if(mOffset >= size()) {
 		return KIO::ERR_NO_CONTENT;
 	}
+	if(!mReadWindow.isEmpty()) {
+		int lRetVal = seek(mOffset);
+		if(lRetVal != 0) {
+			return lRetVal;
+		}
+	}
 	if(!mValidSeekPosition) {
 		return KIO::ERR_COULD_NOT_READ;
 	}
@@ -288,36 +302,122 @@ int ChunkFile::read(QByteArray &pChunk, int pReadSize) {
 
 	// check if it's time to find next blob.
 	if(lCurrentPos->mSkipSize == lTotalSize) {
-		lCurrentPos->mSkipSize = 0;
-		lCurrentPos->mIndex++;
-		while(true) {
-			if(lCurrentPos->mIndex < git_tree_entrycount(lCurrentPos->mTree)) {
-				const git_tree_entry *lTreeEntry = git_tree_entry_byindex(lCurrentPos->mTree, lCurrentPos->mIndex);
-				if(S_ISDIR(git_tree_entry_filemode(lTreeEntry))) {
-					git_tree *lTree;
-					if(0 != git_tree_lookup(&lTree, mRepository, git_tree_entry_id(lTreeEntry))) {
-						return KIO::ERR_COULD_NOT_READ;
-					}
-					lCurrentPos = new TreePosition(lTree); // will have index and skipsize initialized to zero.
-					mPositionStack.append(lCurrentPos);
-				} else {
-					// it's a blob
-					break;
+		return nextBlobPosition();
+	}
+	return 0; // success.
+}
+
+int ChunkFile::readSequential(QByteArray &pChunk) {
+	if(mOffset >= size()) {
+		return KIO::ERR_NO_CONTENT;
+	}
+	if(mReadWindow.isEmpty()) {
+		int lRetVal = fillReadWindow();
+		if(lRetVal != 0) {
+			return lRetVal;
+		}
+	}
+	pChunk = mReadWindow.takeFirst();
+	mOffset += pChunk.size();
+	return 0; // success.
+}
+
+// Advance the position stack to the start of the next blob, descending into
+// and climbing out of subtrees as needed.
+int ChunkFile::nextBlobPosition() {
+	TreePosition *lCurrentPos = mPositionStack.last();
+	lCurrentPos->mSkipSize = 0;
+	lCurrentPos->mIndex++;
+	while(true) {
+		if(lCurrentPos->mIndex < git_tree_entrycount(lCurrentPos->mTree)) {
+			const git_tree_entry *lTreeEntry = git_tree_entry_byindex(lCurrentPos->mTree, lCurrentPos->mIndex);
+			if(S_ISDIR(git_tree_entry_filemode(lTreeEntry))) {
+				git_tree *lTree;
+				if(0 != git_tree_lookup(&lTree, mRepository, git_tree_entry_id(lTreeEntry))) {
+					return KIO::ERR_COULD_NOT_READ;
 				}
+				lCurrentPos = new TreePosition(lTree); // will have index and skipsize initialized to zero.
+				mPositionStack.append(lCurrentPos);
 			} else {
-				delete mPositionStack.takeLast();
-				if(mPositionStack.isEmpty()) {
-					Q_ASSERT(mOffset == size());
-					break;
-				}
-				lCurrentPos = mPositionStack.last();
-				lCurrentPos->mIndex++;
+				// it's a blob
+				break;
 			}
+		} else {
+			delete mPositionStack.takeLast();
+			if(mPositionStack.isEmpty()) {
+				break;
+			}
+			lCurrentPos = mPositionStack.last();
+			lCurrentPos->mIndex++;
+		}
+	}
+	return 0; // success.
+}
+
+// Collect the next batch of chunks and fetch them sorted by where they are
+// stored in the packfiles instead of in file order. Chunks of a file which has
+// been backed up many times are spread out over many packs, reading them in
+// file order causes lots of random access on the storage medium.
+int ChunkFile::fillReadWindow() {
+	if(!mValidSeekPosition) {
+		return KIO::ERR_COULD_NOT_READ;
+	}
+	if(mCurrentBlob != NULL) {
+		git_blob_free(mCurrentBlob);
+		mCurrentBlob = NULL;
+	}
+
+	QList<git_oid> lOids;
+	QList<int> lSkipSizes;
+	while(!mPositionStack.isEmpty() && lOids.count() < cReadWindowChunks) {
+		TreePosition *lCurrentPos = mPositionStack.last();
+		const git_tree_entry *lTreeEntry = git_tree_entry_byindex(lCurrentPos->mTree, lCurrentPos->mIndex);
+		lOids.append(*git_tree_entry_id(lTreeEntry));
+		lSkipSizes.append(lCurrentPos->mSkipSize);
+		if(0 != nextBlobPosition()) {
+			mValidSeekPosition = false;
+			return KIO::ERR_COULD_NOT_READ;
+		}
+	}
+	if(lOids.isEmpty()) {
+		return KIO::ERR_NO_CONTENT;
+	}
+
+	QMultiMap<PackLocation, int> lReadOrder;
+	for(int i = 0; i < lOids.count(); ++i) {
+		lReadOrder.insert(mPackIndex != NULL ? mPackIndex->locate(&lOids.at(i)) : PackLocation(), i);
+	}
+
+	QVector<QByteArray> lChunks(lOids.count());
+	foreach(int lIndex, lReadOrder) {
+		git_blob *lBlob;
+		if(0 != git_blob_lookup(&lBlob, mRepository, &lOids.at(lIndex))) {
+			mValidSeekPosition = false;
+			return KIO::ERR_COULD_NOT_READ;
+		}
+		int lSkipSize = lSkipSizes.at(lIndex);
+		int lTotalSize = git_blob_rawsize(lBlob);
+		if(lSkipSize > lTotalSize) { // this must mean a corrupt bup tree somehow
+			git_blob_free(lBlob);
+			mValidSeekPosition = false;
+			return KIO::ERR_COULD_NOT_READ;
 		}
+		// need a deep copy since the blob is freed right away.
+		lChunks[lIndex] = QByteArray(((const char *)git_blob_rawcontent(lBlob)) + lSkipSize, lTotalSize - lSkipSize);
+		git_blob_free(lBlob);
 	}
+	mReadWindow = lChunks.toList();
 	return 0; // success.
 }
 
+void ChunkFile::clearReadWindow() {
+	if(!mReadWindow.isEmpty()) {
+		mReadWindow.clear();
+		// position stack has been moved ahead of mOffset, needs a new seek.
+		mValidSeekPosition = false;
+	}
+}
+
 quint64 ChunkFile::calculateSize() {
 	return calculateChunkFileSize(&mOid, mRepository);
 }
@@ -443,6 +543,7 @@ Repository::Repository(QObject *pParent, const QString &pRepositoryPath)
 		mRepository = NULL;
 		return;
 	}
+	mPackIndex = new PackIndex(objectName() + QStringLiteral("objects/pack"));
 	git_strarray lBranchNames;
 	git_reference_list(&lBranchNames, mRepository);
 	for(uint i = 0; i < lBranchNames.count; ++i) {
@@ -476,6 +577,8 @@ Repository::~Repository() {
 	if(mRevisionWalker != NULL) {
 		git_revwalk_free(mRevisionWalker);
 	}
+	delete mPackIndex;
+	mPackIndex = NULL;
 }
 
 void Repository::generateSubNodes() {
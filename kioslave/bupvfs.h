@@ -6,6 +6,7 @@
 #include <kio/global.h>
 #include <sys/types.h>
 
+#include "packindex.h"
 #include "vfshelpers.h"
 
 class Node: public QObject, public Metadata {
@@ -24,6 +25,7 @@ public:
 protected:
 	static git_revwalk *mRevisionWalker;
 	static git_repository *mRepository;
+	static PackIndex *mPackIndex;
 };
 
 typedef QHash<QString, Node*> NodeMap;
@@ -69,6 +71,11 @@ public:
 		return 0; // success
 	}
 	virtual int read(QByteArray &pChunk, int pReadSize = -1) = 0;
+	// For reading the whole file from the current position to the end. May use more
+	// memory than read() in order to fetch the data in a more efficient order.
+	virtual int readSequential(QByteArray &pChunk) {
+		return read(pChunk);
+	}
 	virtual int readMetadata(VintStream &pMetadataStream);
 
 protected:
@@ -112,9 +119,13 @@ public:
 	virtual ~ChunkFile();
 	virtual int seek(quint64 pOffset);
 	virtual int read(QByteArray &pChunk, int pReadSize = -1);
+	virtual int readSequential(QByteArray &pChunk);
 
 protected:
 	virtual quint64 calculateSize();
+	int nextBlobPosition();
+	int fillReadWindow();
+	void clearReadWindow();
 
 	git_oid mOid;
 	git_blob *mCurrentBlob;
@@ -128,6 +139,9 @@ protected:
 
 	QList<TreePosition *> mPositionStack;
 	bool mValidSeekPosition;
+	// chunks already fetched by readSequential(), in file order. The position stack
+	// points past the end of these while the list is not empty.
+	QList<QByteArray> mReadWindow;
 };
 
 class ArchivedDirectory: public Directory {
@@ -0,0 +1,145 @@
+#include "packindex.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <string.h>
+
+static const quint32 cIndexV2Magic = 0xff744f63; // "\377tOc"
+static const int cFanoutSize = 256 * 4;
+
+PackIndex::PackIndex(const QString &pPackDirPath)
+   : mPackDirPath(pPackDirPath), mLastHit(0)
+{
+	load();
+}
+
+PackIndex::~PackIndex() {
+	unload();
+}
+
+PackLocation PackIndex::locate(const git_oid *pOid) {
+	PackLocation lLocation;
+	// consecutive chunks of a file were most likely written to the same pack, try that one first.
+	for(int lAttempt = 0; lAttempt < 2; ++lAttempt) {
+		if(mLastHit < mIndexFiles.count() && lookup(mIndexFiles.at(mLastHit), pOid, lLocation.mOffset)) {
+			lLocation.mPack = mLastHit;
+			return lLocation;
+		}
+		for(int i = 0; i < mIndexFiles.count(); ++i) {
+			if(i != mLastHit && lookup(mIndexFiles.at(i), pOid, lLocation.mOffset)) {
+				mLastHit = i;
+				lLocation.mPack = i;
+				return lLocation;
+			}
+		}
+		// not found, if a backup has added packs since we loaded, reload and try once more.
+		if(QFileInfo(mPackDirPath).lastModified() == mLoadedDirTime) {
+			break;
+		}
+		unload();
+		load();
+	}
+	return lLocation;
+}
+
+void PackIndex::load() {
+	QDir lPackDir(mPackDirPath);
+	mLoadedDirTime = QFileInfo(mPackDirPath).lastModified();
+	QStringList lIndexNames = lPackDir.entryList(QStringList() << QStringLiteral("pack-*.idx"),
+	                                             QDir::Files, QDir::Name);
+	foreach(const QString &lIndexName, lIndexNames) {
+		IndexFile lIndexFile;
+		lIndexFile.mFile = new QFile(lPackDir.absoluteFilePath(lIndexName));
+		lIndexFile.mSize = lIndexFile.mFile->size();
+		lIndexFile.mData = NULL;
+		if(lIndexFile.mSize >= 8 + cFanoutSize && lIndexFile.mFile->open(QIODevice::ReadOnly)) {
+			lIndexFile.mData = lIndexFile.mFile->map(0, lIndexFile.mSize);
+		}
+		if(lIndexFile.mData == NULL) {
+			delete lIndexFile.mFile;
+			continue;
+		}
+
+		qint64 lRequiredSize;
+		if(qFromBigEndian<quint32>(lIndexFile.mData) == cIndexV2Magic) {
+			lIndexFile.mVersion = qFromBigEndian<quint32>(lIndexFile.mData + 4);
+			lIndexFile.mObjectCount = qFromBigEndian<quint32>(lIndexFile.mData + 8 + cFanoutSize - 4);
+			lRequiredSize = 8 + cFanoutSize + lIndexFile.mObjectCount * qint64(20 + 4 + 4);
+		} else {
+			lIndexFile.mVersion = 1;
+			lIndexFile.mObjectCount = qFromBigEndian<quint32>(lIndexFile.mData + cFanoutSize - 4);
+			lRequiredSize = cFanoutSize + lIndexFile.mObjectCount * qint64(4 + 20);
+		}
+		if((lIndexFile.mVersion != 1 && lIndexFile.mVersion != 2) || lIndexFile.mSize < lRequiredSize) {
+			lIndexFile.mFile->unmap(const_cast<uchar *>(lIndexFile.mData));
+			delete lIndexFile.mFile;
+			continue;
+		}
+		mIndexFiles.append(lIndexFile);
+	}
+	mLastHit = 0;
+}
+
+void PackIndex::unload() {
+	foreach(const IndexFile &lIndexFile, mIndexFiles) {
+		lIndexFile.mFile->unmap(const_cast<uchar *>(lIndexFile.mData));
+		delete lIndexFile.mFile;
+	}
+	mIndexFiles.clear();
+}
+
+bool PackIndex::lookup(const IndexFile &pIndexFile, const git_oid *pOid, quint64 &pOffset) {
+	const uchar *lFanout = pIndexFile.mData;
+	const uchar *lEntries;
+	int lEntrySize, lShaOffset;
+	if(pIndexFile.mVersion == 2) {
+		lFanout += 8;
+		lEntries = lFanout + cFanoutSize;
+		lEntrySize = 20;
+		lShaOffset = 0;
+	} else {
+		lEntries = lFanout + cFanoutSize;
+		lEntrySize = 24;
+		lShaOffset = 4;
+	}
+
+	const uchar lFirstByte = pOid->id[0];
+	quint32 lLower = lFirstByte == 0 ? 0 : qFromBigEndian<quint32>(lFanout + (lFirstByte - 1) * 4);
+	quint32 lUpper = qFromBigEndian<quint32>(lFanout + lFirstByte * 4);
+	if(lUpper > pIndexFile.mObjectCount || lLower > lUpper) {
+		return false; // corrupt fanout table
+	}
+	while(lLower < lUpper) {
+		quint32 lMiddle = lLower + (lUpper - lLower) / 2;
+		const uchar *lEntry = lEntries + qint64(lMiddle) * lEntrySize;
+		int lCompare = memcmp(pOid->id, lEntry + lShaOffset, GIT_OID_RAWSZ);
+		if(lCompare < 0) {
+			lUpper = lMiddle;
+		} else if(lCompare > 0) {
+			lLower = lMiddle + 1;
+		} else if(pIndexFile.mVersion == 1) {
+			pOffset = qFromBigEndian<quint32>(lEntry);
+			return true;
+		} else {
+			const quint32 lCount = pIndexFile.mObjectCount;
+			const uchar *lOffsets = lEntries + qint64(lCount) * (20 + 4);
+			quint32 lOffset = qFromBigEndian<quint32>(lOffsets + qint64(lMiddle) * 4);
+			if((lOffset & 0x80000000) == 0) {
+				pOffset = lOffset;
+				return true;
+			}
+			// packs larger than 2GiB store the real offset in a table of 64bit values.
+			qint64 lLargePos = qint64(lOffsets - pIndexFile.mData) + qint64(lCount) * 4
+			                   + qint64(lOffset & 0x7fffffff) * 8;
+			if(lLargePos + 8 > pIndexFile.mSize) {
+				return false;
+			}
+			pOffset = qFromBigEndian<quint64>(pIndexFile.mData + lLargePos);
+			return true;
+		}
+	}
+	return false;
+}
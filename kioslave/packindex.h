@@ -0,0 +1,55 @@
+#ifndef PACKINDEX_H
+#define PACKINDEX_H
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+
+#include <git2.h>
+
+class QFile;
+
+// Position of an object inside the packfiles of a repository. Objects which
+// could not be found in any pack index (loose or missing) get mPack == -1 and
+// will be sorted before everything else.
+struct PackLocation {
+	PackLocation() : mPack(-1), mOffset(0) {}
+	int mPack;
+	quint64 mOffset;
+};
+
+inline bool operator <(const PackLocation &pA, const PackLocation &pB) {
+	if(pA.mPack != pB.mPack) {
+		return pA.mPack < pB.mPack;
+	}
+	return pA.mOffset < pB.mOffset;
+}
+
+// Read-only view of all the *.idx files in objects/pack of a repository.
+// Used for finding out where in the packfiles an object is stored, so that
+// objects needed together can be read in the order they are stored on disk.
+class PackIndex {
+public:
+	explicit PackIndex(const QString &pPackDirPath);
+	~PackIndex();
+	PackLocation locate(const git_oid *pOid);
+
+protected:
+	struct IndexFile {
+		QFile *mFile;
+		const uchar *mData;
+		qint64 mSize;
+		int mVersion;
+		quint32 mObjectCount;
+	};
+	void load();
+	void unload();
+	bool lookup(const IndexFile &pIndexFile, const git_oid *pOid, quint64 &pOffset);
+
+	QString mPackDirPath;
+	QDateTime mLoadedDirTime;
+	QList<IndexFile> mIndexFiles;
+	int mLastHit;
+};
+
+#endif // PACKINDEX_H
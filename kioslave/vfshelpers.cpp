@@ -135,6 +135,10 @@ int readMetadata(VintStream &pMetadataStream, Metadata &pMetadata) {
 				pMetadataStream >> pMetadata.mSymlinkTarget;
 				break;
 			}
+			case RECORD_HARDLINK_TARGET: {
+				pMetadataStream >> pMetadata.mHardlinkTarget;
+				break;
+			}
 			default: {
 				if(lTag != RECORD_END) {
 					QByteArray lNotUsed;
@@ -172,13 +176,23 @@ quint64 calculateChunkFileSize(const git_oid *pOid, git_repository *pRepository)
 		git_tree_free(lTree);
 	} while(S_ISDIR(lMode));
 
-	git_blob *lBlob;
-	if(0 != git_blob_lookup(&lBlob, pRepository, pOid)) {
+	lLastChunkSize = objectSize(pOid, pRepository);
+	return lLastChunkOffset + lLastChunkSize;
+}
+
+quint64 objectSize(const git_oid *pOid, git_repository *pRepository) {
+	// only reads the object header, avoids inflating the whole blob.
+	git_odb *lOdb;
+	if(0 != git_repository_odb(&lOdb, pRepository)) {
 		return 0;
 	}
-	lLastChunkSize = git_blob_rawsize(lBlob);
-	git_blob_free(lBlob);
-	return lLastChunkOffset + lLastChunkSize;
+	size_t lSize = 0;
+	git_otype lType;
+	if(0 != git_odb_read_header(&lSize, &lType, lOdb, pOid)) {
+		lSize = 0;
+	}
+	git_odb_free(lOdb);
+	return lSize;
 }
 
 bool offsetFromName(const git_tree_entry *pEntry, quint64 &pUint) {
@@ -10,6 +10,10 @@ class QBuffer;
 #define DEFAULT_MODE_DIRECTORY 0040755
 #define DEFAULT_MODE_FILE 0100644
 
+// Extra UDS field published by kio_bup, the original path of the file which a
+// hardlink shares its data with. Only present on the second and later links.
+#define KUP_UDS_HARDLINK_TARGET (KIO::UDSEntry::UDS_EXTRA + 1)
+
 class VintStream: public QObject {
 	Q_OBJECT
 
@@ -35,6 +39,7 @@ struct Metadata {
 	qint64 mAtime;
 	qint64 mMtime;
 	QString mSymlinkTarget;
+	QString mHardlinkTarget;
 
 	static quint64 mDefaultUid;
 	static quint64 mDefaultGid;
@@ -43,6 +48,7 @@ struct Metadata {
 
 int readMetadata(VintStream &pMetadataStream, Metadata &pMetadata);
 quint64 calculateChunkFileSize(const git_oid *pOid, git_repository *pRepository);
+quint64 objectSize(const git_oid *pOid, git_repository *pRepository);
 bool offsetFromName(const git_tree_entry *pEntry, quint64 &pUint);
 void getEntryAttributes(const git_tree_entry *pTreeEntry, uint &pMode, bool &pChunked, const git_oid *&pOid, QString &pName);
 QString vfsTimeToString(git_time_t pTime);
@@ -19,11 +19,13 @@
  ***************************************************************************/
 
 #include "backupplan.h"
+#include "planstatestore.h"
 
 #include <QDir>
 #include <QStandardPaths>
 #include <QString>
 
+#include <KConfigGroup>
 #include <KLocalizedString>
 
 BackupPlan::BackupPlan(int pPlanNumber, KSharedConfigPtr pConfig, QObject *pParent)
@@ -52,6 +54,8 @@ BackupPlan::BackupPlan(int pPlanNumber, KSharedConfigPtr pConfig, QObject *pPare
 	}
 
 	addItemStringList(QStringLiteral("Paths excluded"), mPathsExcluded, lDefaultExcludeList);
+	addItemBool(QStringLiteral("Exclude cache folders"), mExcludeCacheFolders, true);
+	addItemStringList(QStringLiteral("Exclude patterns"), mExcludePatterns);
 	addItemInt(QStringLiteral("Backup type"), mBackupType);
 
 	addItemInt(QStringLiteral("Schedule type"), mScheduleType, 2);
@@ -74,13 +78,14 @@ BackupPlan::BackupPlan(int pPlanNumber, KSharedConfigPtr pConfig, QObject *pPare
 	addItemInt(QStringLiteral("External partitions count"), mExternalPartitionsOnDrive);
 
 	addItemBool(QStringLiteral("Show hidden folders"), mShowHiddenFolders);
+	addItemBool(QStringLiteral("Pause on battery"), mPauseOnBattery);
+	addItemBool(QStringLiteral("Pause while active"), mPauseWhileActive);
 	addItemBool(QStringLiteral("Generate recovery info"), mGenerateRecoveryInfo);
 	addItemBool(QStringLiteral("Check backups"), mCheckBackups);
-
-	addItemDateTime(QStringLiteral("Last complete backup"), mLastCompleteBackup);
-	addItemDouble(QStringLiteral("Last backup size"), mLastBackupSize);
-	addItemDouble(QStringLiteral("Last available space"), mLastAvailableSpace);
-	addItemUInt(QStringLiteral("Accumulated usage time"), mAccumulatedUsageTime);
+	addItemInt(QStringLiteral("Full verification interval"), mFullVerificationInterval, 30);
+	addItemBool(QStringLiteral("Replicate"), mReplicate);
+	addItem(new KCoreConfigSkeleton::ItemUrl(currentGroup(), QStringLiteral("Replica destination path"),
+	                                         mReplicaDestinationPath));
 	load();
 }
 
@@ -90,10 +95,63 @@ void BackupPlan::setPlanNumber(int pPlanNumber) {
 	foreach(KConfigSkeletonItem *lItem, items()) {
 		lItem->setGroup(lGroupName);
 	}
+	// the state of the old number is removed together with its configuration.
+	saveState();
 }
 
 void BackupPlan::removePlanFromConfig() {
 	config()->deleteGroup(QString(QStringLiteral("Plan/%1")).arg(mPlanNumber));
+	PlanStateStore::instance()->removePlan(mPlanNumber);
+}
+
+void BackupPlan::saveState() {
+	QMap<QString, QString> lValues;
+	lValues.insert(QStringLiteral("Last complete backup"), mLastCompleteBackup.toString(Qt::ISODate));
+	lValues.insert(QStringLiteral("Last backup size"), QString::number(mLastBackupSize, 'f', 0));
+	lValues.insert(QStringLiteral("Last full size check"), mLastFullSizeCheck.toString(Qt::ISODate));
+	lValues.insert(QStringLiteral("Last available space"), QString::number(mLastAvailableSpace, 'f', 0));
+	lValues.insert(QStringLiteral("Accumulated usage time"), QString::number(mAccumulatedUsageTime));
+	PlanStateStore::instance()->setValues(mPlanNumber, lValues);
+}
+
+void BackupPlan::loadState() {
+	PlanStateStore *lStore = PlanStateStore::instance();
+	lStore->refresh();
+	if(!lStore->contains(mPlanNumber)) {
+		migrateState();
+		return;
+	}
+	mLastCompleteBackup = QDateTime::fromString(lStore->value(mPlanNumber, QStringLiteral("Last complete backup")),
+	                                            Qt::ISODate);
+	mLastBackupSize = lStore->value(mPlanNumber, QStringLiteral("Last backup size")).toDouble();
+	mLastFullSizeCheck = QDateTime::fromString(lStore->value(mPlanNumber, QStringLiteral("Last full size check")),
+	                                           Qt::ISODate);
+	mLastAvailableSpace = lStore->value(mPlanNumber, QStringLiteral("Last available space")).toDouble();
+	mAccumulatedUsageTime = lStore->value(mPlanNumber, QStringLiteral("Accumulated usage time")).toUInt();
+}
+
+// Earlier versions kept the state in kuprc, move it over to the state file.
+void BackupPlan::migrateState() {
+	KConfigGroup lGroup(config(), QString(QStringLiteral("Plan/%1")).arg(mPlanNumber));
+	const QStringList lKeys = QStringList() << QStringLiteral("Last complete backup") << QStringLiteral("Last backup size")
+	                                        << QStringLiteral("Last full size check") << QStringLiteral("Last available space")
+	                                        << QStringLiteral("Accumulated usage time");
+	mLastCompleteBackup = lGroup.readEntry(lKeys.at(0), QDateTime());
+	mLastBackupSize = lGroup.readEntry(lKeys.at(1), 0.0);
+	mLastFullSizeCheck = lGroup.readEntry(lKeys.at(2), QDateTime());
+	mLastAvailableSpace = lGroup.readEntry(lKeys.at(3), 0.0);
+	mAccumulatedUsageTime = lGroup.readEntry(lKeys.at(4), 0u);
+	bool lHadState = false;
+	foreach(const QString &lKey, lKeys) {
+		if(lGroup.hasKey(lKey)) {
+			lGroup.deleteEntry(lKey);
+			lHadState = true;
+		}
+	}
+	if(lHadState) {
+		saveState();
+		config()->sync();
+	}
 }
 
 QDateTime BackupPlan::nextScheduledTime() {
@@ -164,7 +222,9 @@ QString BackupPlan::iconName(Status pStatus) {
 }
 
 void BackupPlan::usrReadConfig() {
+	loadState();
 	//correct the time spec after default read routines.
 	mLastCompleteBackup.setTimeSpec(Qt::UTC);
+	mLastFullSizeCheck.setTimeSpec(Qt::UTC);
 }
 
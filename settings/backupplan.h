@@ -34,10 +34,17 @@ public:
 	virtual void setPlanNumber(int pPlanNumber);
 
 	void removePlanFromConfig();
+	// The fields from mLastCompleteBackup and on change while backups are taken, they
+	// are saved with this to a separate state file instead of with the configuration.
+	void saveState();
 
 	QString mDescription;
 	QStringList mPathsIncluded;
 	QStringList mPathsExcluded;
+	// Leave out folders tagged with CACHEDIR.TAG.
+	bool mExcludeCacheFolders;
+	// Globs like rsync uses them, regular expressions if prefixed with "re:".
+	QStringList mExcludePatterns;
 	enum BackupType {BupType = 0, RsyncType};
 	qint32 mBackupType;
 
@@ -59,12 +66,23 @@ public:
 	qulonglong mExternalVolumeCapacity;
 
 	bool mShowHiddenFolders;
+	// Stop a running backup completely in these situations, instead of only slowing it down.
+	bool mPauseOnBattery;
+	bool mPauseWhileActive;
 	bool mGenerateRecoveryInfo;
 	bool mCheckBackups;
+	// Packs are only verified once, except every this many days when all of them are checked again.
+	qint32 mFullVerificationInterval;
+	// Copy new packs and refs of a bup archive to a second location after each backup.
+	bool mReplicate;
+	QUrl mReplicaDestinationPath;
 
 	QDateTime mLastCompleteBackup;
 	// Size of the last backup in bytes.
 	double mLastBackupSize;
+	// When the size above was last calculated by walking the whole destination,
+	// in between it is only updated with what each backup added.
+	QDateTime mLastFullSizeCheck;
 	// Last known available space on destination
 	double mLastAvailableSpace;
 	// How long has Kup been running since last backup (s)
@@ -79,6 +97,8 @@ public:
 
 protected:
 	virtual void usrReadConfig();
+	void loadState();
+	void migrateState();
 	int mPlanNumber;
 };
 
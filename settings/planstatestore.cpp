@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "planstatestore.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+// The file is rewritten with only the current values when it has this many lines.
+static const int cCompactionLineCount = 1000;
+
+PlanStateStore *PlanStateStore::instance() {
+	static PlanStateStore sInstance;
+	return &sInstance;
+}
+
+PlanStateStore::PlanStateStore()
+   : mLineCount(0), mFileSize(-1)
+{
+	QString lDataPath = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+	lDataPath.append(QStringLiteral("/kup"));
+	QDir().mkpath(lDataPath);
+	mFilePath = lDataPath + QStringLiteral("/planstate");
+}
+
+void PlanStateStore::refresh() {
+	QFileInfo lInfo(mFilePath);
+	qint64 lSize = lInfo.exists() ? lInfo.size() : 0;
+	if(lSize == mFileSize && lInfo.lastModified() == mFileModified) {
+		return;
+	}
+	mValues.clear();
+	mLineCount = 0;
+	QFile lFile(mFilePath);
+	if(lFile.open(QIODevice::ReadOnly)) {
+		// one line per change, "<plan number>\t<key>\t<value>" or "<plan number>\t-" for a removed plan.
+		while(!lFile.atEnd()) {
+			QByteArray lLine = lFile.readLine();
+			if(!lLine.endsWith('\n')) {
+				break; // not completely written, maybe the writer was killed
+			}
+			++mLineCount;
+			QList<QByteArray> lFields = lLine.left(lLine.length() - 1).split('\t');
+			int lPlanNumber = lFields.at(0).toInt();
+			if(lFields.count() == 2 && lFields.at(1) == "-") {
+				mValues.remove(lPlanNumber);
+			} else if(lFields.count() == 3) {
+				mValues[lPlanNumber].insert(QString::fromUtf8(lFields.at(1)), QString::fromUtf8(lFields.at(2)));
+			}
+		}
+	}
+	rememberFileState();
+}
+
+void PlanStateStore::setValues(int pPlanNumber, const QMap<QString, QString> &pValues) {
+	refresh();
+	QMap<QString, QString> &lStored = mValues[pPlanNumber];
+	QByteArray lLines;
+	int lLineCount = 0;
+	QMapIterator<QString, QString> i(pValues);
+	while(i.hasNext()) {
+		i.next();
+		if(lStored.contains(i.key()) && lStored.value(i.key()) == i.value()) {
+			continue;
+		}
+		lStored.insert(i.key(), i.value());
+		lLines += QByteArray::number(pPlanNumber) + '\t' + i.key().toUtf8() + '\t' + i.value().toUtf8() + '\n';
+		++lLineCount;
+	}
+	if(lLineCount > 0) {
+		append(lLines, lLineCount);
+	}
+}
+
+void PlanStateStore::removePlan(int pPlanNumber) {
+	refresh();
+	if(mValues.remove(pPlanNumber) > 0) {
+		append(QByteArray::number(pPlanNumber) + "\t-\n", 1);
+	}
+}
+
+void PlanStateStore::append(const QByteArray &pLines, int pLineCount) {
+	if(mLineCount + pLineCount > cCompactionLineCount) {
+		compact(); // writes the new values too, they are already in mValues.
+		return;
+	}
+	QFile lFile(mFilePath);
+	if(!lFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		return;
+	}
+	lFile.write(pLines);
+	lFile.close();
+	mLineCount += pLineCount;
+	rememberFileState();
+}
+
+void PlanStateStore::compact() {
+	QSaveFile lFile(mFilePath);
+	if(!lFile.open(QIODevice::WriteOnly)) {
+		return;
+	}
+	int lLineCount = 0;
+	QHashIterator<int, QMap<QString, QString> > lPlans(mValues);
+	while(lPlans.hasNext()) {
+		lPlans.next();
+		QMapIterator<QString, QString> lValues(lPlans.value());
+		while(lValues.hasNext()) {
+			lValues.next();
+			lFile.write(QByteArray::number(lPlans.key()) + '\t' + lValues.key().toUtf8() + '\t' +
+			            lValues.value().toUtf8() + '\n');
+			++lLineCount;
+		}
+	}
+	if(lFile.commit()) {
+		mLineCount = lLineCount;
+		rememberFileState();
+	}
+}
+
+void PlanStateStore::rememberFileState() {
+	QFileInfo lInfo(mFilePath);
+	mFileSize = lInfo.exists() ? lInfo.size() : 0;
+	mFileModified = lInfo.lastModified();
+}
@@ -0,0 +1,63 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef PLANSTATESTORE_H
+#define PLANSTATESTORE_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QString>
+
+// Runtime state of the backup plans, like when the last backup was taken and
+// how much time the user has spent since then. Kept out of kuprc so that
+// updating it does not rewrite the configuration. Changed values are appended
+// to a small file, later lines override earlier ones, and the file is compacted
+// to one line per value once it has grown.
+class PlanStateStore
+{
+public:
+	static PlanStateStore *instance();
+	// Picks up what another process has written since last time.
+	void refresh();
+	bool contains(int pPlanNumber) const {
+		return mValues.contains(pPlanNumber);
+	}
+	QString value(int pPlanNumber, const QString &pKey) const {
+		return mValues.value(pPlanNumber).value(pKey);
+	}
+	// Only the values which differ from what is stored get written.
+	void setValues(int pPlanNumber, const QMap<QString, QString> &pValues);
+	void removePlan(int pPlanNumber);
+
+protected:
+	PlanStateStore();
+	void append(const QByteArray &pLines, int pLineCount);
+	void compact();
+	void rememberFileState();
+
+	QString mFilePath;
+	QHash<int, QMap<QString, QString> > mValues;
+	int mLineCount;
+	qint64 mFileSize;
+	QDateTime mFileModified;
+};
+
+#endif // PLANSTATESTORE_H
@@ -0,0 +1,195 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include "toolcapabilities.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QTimer>
+
+#include <KConfig>
+#include <KConfigGroup>
+#include <KProcess>
+
+ToolCapabilities *ToolCapabilities::instance() {
+	static ToolCapabilities *sInstance = NULL;
+	if(sInstance == NULL) {
+		sInstance = new ToolCapabilities();
+	}
+	return sInstance;
+}
+
+ToolCapabilities::ToolCapabilities()
+   : QObject(QCoreApplication::instance()), mPar2Available(false), mProbesRunning(0)
+{
+	QString lCachePath = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+	lCachePath.append(QStringLiteral("/kup"));
+	QDir().mkpath(lCachePath);
+	mCache = new KConfig(lCachePath + QStringLiteral("/capabilities"), KConfig::SimpleConfig);
+
+	KConfigGroup lBupGroup(mCache, "bup");
+	mBup.mPath = lBupGroup.readEntry("Path", QString());
+	mBup.mModified = lBupGroup.readEntry("Modified", qint64(0));
+	mPar2.mPath = lBupGroup.readEntry("Par2 path", QString());
+	mPar2.mModified = lBupGroup.readEntry("Par2 modified", qint64(0));
+	mBupVersion = lBupGroup.readEntry("Version", QString());
+	mPar2Available = lBupGroup.readEntry("Par2 available", false);
+	KConfigGroup lRsyncGroup(mCache, "rsync");
+	mRsync.mPath = lRsyncGroup.readEntry("Path", QString());
+	mRsync.mModified = lRsyncGroup.readEntry("Modified", qint64(0));
+	mRsyncVersion = lRsyncGroup.readEntry("Version", QString());
+}
+
+ToolCapabilities::~ToolCapabilities() {
+	delete mCache;
+}
+
+ToolCapabilities::Binary ToolCapabilities::findBinary(const QString &pName) {
+	Binary lBinary;
+	lBinary.mPath = QStandardPaths::findExecutable(pName);
+	if(!lBinary.mPath.isEmpty()) {
+		lBinary.mModified = QFileInfo(lBinary.mPath).lastModified().toMSecsSinceEpoch();
+	}
+	return lBinary;
+}
+
+bool ToolCapabilities::isCurrent() {
+	// An empty path in the cache means the program has never been probed.
+	return mProbesRunning == 0 && mCache->hasGroup("bup") && mCache->hasGroup("rsync") &&
+	      findBinary(QStringLiteral("bup")) == mBup && findBinary(QStringLiteral("par2")) == mPar2 &&
+	      findBinary(QStringLiteral("rsync")) == mRsync;
+}
+
+void ToolCapabilities::probe() {
+	if(mProbesRunning > 0) {
+		return; // ready() will be emitted when the running probes are done
+	}
+	if(isCurrent()) {
+		QTimer::singleShot(0, this, SIGNAL(ready()));
+		return;
+	}
+	mNewBup = findBinary(QStringLiteral("bup"));
+	mNewPar2 = findBinary(QStringLiteral("par2"));
+	mNewRsync = findBinary(QStringLiteral("rsync"));
+	mBupVersion.clear();
+	mPar2Available = false;
+	mRsyncVersion.clear();
+	if(!mNewBup.mPath.isEmpty()) {
+		startProbe(mNewBup.mPath, QStringList() << QStringLiteral("version"),
+		           SLOT(bupVersionProbed(int,QProcess::ExitStatus)));
+	}
+	if(!mNewRsync.mPath.isEmpty()) {
+		startProbe(mNewRsync.mPath, QStringList() << QStringLiteral("--version"),
+		           SLOT(rsyncVersionProbed(int,QProcess::ExitStatus)));
+	}
+	if(mProbesRunning == 0) {
+		probeDone();
+	}
+}
+
+bool ToolCapabilities::rsyncVersionAtLeast(int pMajor, int pMinor) const {
+	QRegularExpressionMatch lMatch = QRegularExpression(QStringLiteral("^(\\d+)\\.(\\d+)")).match(mRsyncVersion);
+	if(!lMatch.hasMatch()) {
+		return false;
+	}
+	int lMajor = lMatch.captured(1).toInt();
+	return lMajor > pMajor || (lMajor == pMajor && lMatch.captured(2).toInt() >= pMinor);
+}
+
+KProcess *ToolCapabilities::startProbe(const QString &pProgram, const QStringList &pArguments, const char *pSlot) {
+	KProcess *lProcess = new KProcess(this);
+	lProcess->setOutputChannelMode(KProcess::MergedChannels);
+	lProcess->setProgram(pProgram, pArguments);
+	connect(lProcess, SIGNAL(finished(int,QProcess::ExitStatus)), pSlot);
+	connect(lProcess, SIGNAL(error(QProcess::ProcessError)), SLOT(probeFailed(QProcess::ProcessError)));
+	++mProbesRunning;
+	lProcess->start();
+	return lProcess;
+}
+
+void ToolCapabilities::bupVersionProbed(int pExitCode, QProcess::ExitStatus pExitStatus) {
+	KProcess *lProcess = qobject_cast<KProcess *>(sender());
+	if(pExitStatus == QProcess::NormalExit && pExitCode == 0) {
+		mBupVersion = QString::fromUtf8(lProcess->readAllStandardOutput());
+		// bup checks itself if par2 is usable
+		startProbe(mNewBup.mPath, QStringList() << QStringLiteral("fsck") << QStringLiteral("--par2-ok"),
+		           SLOT(par2Probed(int,QProcess::ExitStatus)));
+	}
+	lProcess->deleteLater();
+	probeDone();
+}
+
+void ToolCapabilities::par2Probed(int pExitCode, QProcess::ExitStatus pExitStatus) {
+	mPar2Available = pExitStatus == QProcess::NormalExit && pExitCode == 0;
+	sender()->deleteLater();
+	probeDone();
+}
+
+void ToolCapabilities::rsyncVersionProbed(int pExitCode, QProcess::ExitStatus pExitStatus) {
+	KProcess *lProcess = qobject_cast<KProcess *>(sender());
+	if(pExitStatus == QProcess::NormalExit && pExitCode == 0) {
+		// first line is like "rsync  version 3.1.2  protocol version 31"
+		QStringList lWords = QString::fromLocal8Bit(lProcess->readLine()).split(QLatin1Char(' '),
+		                                                                        QString::SkipEmptyParts);
+		if(lWords.count() > 2) {
+			mRsyncVersion = lWords.at(2);
+		}
+	}
+	lProcess->deleteLater();
+	probeDone();
+}
+
+void ToolCapabilities::probeFailed(QProcess::ProcessError pError) {
+	// no finished() signal will follow
+	if(pError == QProcess::FailedToStart) {
+		sender()->deleteLater();
+		probeDone();
+	}
+}
+
+void ToolCapabilities::probeDone() {
+	if(mProbesRunning > 0 && --mProbesRunning > 0) {
+		return;
+	}
+	mBup = mNewBup;
+	mPar2 = mNewPar2;
+	mRsync = mNewRsync;
+	save();
+	emit ready();
+}
+
+void ToolCapabilities::save() {
+	KConfigGroup lBupGroup(mCache, "bup");
+	lBupGroup.writeEntry("Path", mBup.mPath);
+	lBupGroup.writeEntry("Modified", mBup.mModified);
+	lBupGroup.writeEntry("Par2 path", mPar2.mPath);
+	lBupGroup.writeEntry("Par2 modified", mPar2.mModified);
+	lBupGroup.writeEntry("Version", mBupVersion);
+	lBupGroup.writeEntry("Par2 available", mPar2Available);
+	KConfigGroup lRsyncGroup(mCache, "rsync");
+	lRsyncGroup.writeEntry("Path", mRsync.mPath);
+	lRsyncGroup.writeEntry("Modified", mRsync.mModified);
+	lRsyncGroup.writeEntry("Version", mRsyncVersion);
+	mCache->sync();
+}
@@ -0,0 +1,92 @@
+/***************************************************************************
+ *   Copyright Simon Persson                                               *
+ *   simonpersson1@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TOOLCAPABILITIES_H
+#define TOOLCAPABILITIES_H
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+
+class KConfig;
+class KProcess;
+
+// What the installed backup programs are and can do. Finding out means running
+// them, so the results are cached together with the path and modification time
+// of each program and only probed again when one of those has changed. Probing
+// never blocks, call probe() and wait for ready().
+class ToolCapabilities : public QObject
+{
+	Q_OBJECT
+
+public:
+	static ToolCapabilities *instance();
+	// True if the cached results still match the installed programs.
+	bool isCurrent();
+	// Emits ready() when the results are current, right away if they already are.
+	void probe();
+	// output of "bup version", empty if bup is not installed
+	QString bupVersion() const {
+		return mBupVersion;
+	}
+	bool par2Available() const {
+		return mPar2Available;
+	}
+	// for example "3.1.2", empty if rsync is not installed
+	QString rsyncVersion() const {
+		return mRsyncVersion;
+	}
+	bool rsyncVersionAtLeast(int pMajor, int pMinor) const;
+
+signals:
+	void ready();
+
+protected slots:
+	void bupVersionProbed(int pExitCode, QProcess::ExitStatus pExitStatus);
+	void par2Probed(int pExitCode, QProcess::ExitStatus pExitStatus);
+	void rsyncVersionProbed(int pExitCode, QProcess::ExitStatus pExitStatus);
+	void probeFailed(QProcess::ProcessError pError);
+
+protected:
+	ToolCapabilities();
+	virtual ~ToolCapabilities();
+	struct Binary {
+		Binary() : mModified(0) {}
+		QString mPath;
+		qint64 mModified;
+		bool operator ==(const Binary &pOther) const {
+			return mPath == pOther.mPath && mModified == pOther.mModified;
+		}
+	};
+	static Binary findBinary(const QString &pName);
+	KProcess *startProbe(const QString &pProgram, const QStringList &pArguments, const char *pSlot);
+	void probeDone();
+	void save();
+
+	KConfig *mCache;
+	Binary mBup, mPar2, mRsync; // as last probed
+	Binary mNewBup, mNewPar2, mNewRsync; // as installed now, while probing
+	QString mBupVersion;
+	bool mPar2Available;
+	QString mRsyncVersion;
+	int mProbesRunning;
+};
+
+#endif // TOOLCAPABILITIES_H